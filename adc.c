@@ -4,20 +4,66 @@
  * adc.c
  */
 
+volatile char adc_load_sample;
+volatile signed char adc_temperature;
+volatile signed char adc_level_offset;
+volatile signed char adc_charge_offset;
+
+// Temperature sensor calibration (TLV, 12 bit readings at 30 and 85 deg C
+// against the 1.5V reference) and typical values for a chip without it
+#define ADC_TEMPERATURE_CAL30 CALADC12_15V_30C
+#define ADC_TEMPERATURE_CAL85 CALADC12_15V_85C
+#define ADC_TEMPERATURE_TYPICAL30 2041 // 747 mV
+#define ADC_TEMPERATURE_TYPICAL85 2379 // 871 mV
+
+// Threshold offsets per deg C, adc counts x 256
+#define ADC_LEVEL_PER_DEGREE (BATTERY_LEVEL_TEMPCO * 256L / BATTERY_MV_PER_COUNT)
+#define ADC_CHARGE_PER_DEGREE (BATTERY_CHARGE_TEMPCO * 256L / BATTERY_MV_PER_COUNT)
+
+unsigned int adc_temperature_filter; // reading x 16, 0 until the first one
+unsigned int adc_temperature_cal30; // 30 deg C reading, scaled like the filter
+unsigned int adc_temperature_scale; // deg C x 65536 per filter count
+
+// Rounds value / 2^shift (either sign)
+long adc_round(long value, char shift);
+
 // Set up the analog to digital converter
 void adc_initialize()
 {
+	unsigned int cal30 = ADC_TEMPERATURE_CAL30;
+	unsigned int cal85 = ADC_TEMPERATURE_CAL85;
+
+	adc_load_sample = 0;
+	adc_temperature = TEMPERATURE_NOMINAL;
+	adc_level_offset = 0;
+	adc_charge_offset = 0;
+	adc_temperature_filter = 0;
+
+	// Calibration, or typical values if the TLV is blank (or makes no sense)
+	if(cal30 == 0xFFFF || cal85 == 0xFFFF || cal85 < cal30 + 100)
+	{
+		cal30 = ADC_TEMPERATURE_TYPICAL30;
+		cal85 = ADC_TEMPERATURE_TYPICAL85;
+	}
+	adc_temperature_cal30 = cal30 << 4;
+	adc_temperature_scale = (55UL << 16) / ((unsigned long)(cal85 - cal30) << 4);
+
 	ADC_PORT_SEL |= ADC_PIN_BAT_CHARGE | ADC_PIN_SOLARPANEL_VOLTAGE; // Set up pins
 
+	// 1.5V reference for the temperature sensor (settles long before the
+	// first conversion)
+	REFCTL0 = REFMSTR | REFVSEL_0 | REFON;
+
 	// Set up ADC //
-	ADC12CTL0 = ADC12ON | ADC12MSC | ADC12SHT0_2; // Turn on ADC, enable multiple samples, set speed
+	ADC12CTL0 = ADC12ON | ADC12MSC | ADC12SHT0_8; // Turn on ADC, enable multiple samples, sample ~50us (the sensor needs 30)
 	ADC12CTL1 = ADC12SHP | ADC12CONSEQ_1; // Sequence-of-channels mode (no repeat)
-	ADC12CTL2 = ADC12RES_0; // 8 bit resolution
+	ADC12CTL2 = ADC12RES_2; // 12 bit resolution (battery and panel only keep the top 8, the temperature needs the rest)
 
 	ADC12MCTL0 = ADC12INCH_0; // reference Vcc and Vss, channel is A0
-	ADC12MCTL1 = ADC12INCH_1 | ADC12EOS; // reference Vcc and Vss, channel is A1, end of sequence
+	ADC12MCTL1 = ADC12INCH_1; // reference Vcc and Vss, channel is A1
+	ADC12MCTL2 = ADC12SREF_1 | ADC12INCH_10 | ADC12EOS; // 1.5V reference, temperature sensor, end of sequence
 
-	ADC12IE = ADC12IFG1; // Enable interrupts for mctl1
+	ADC12IE = ADC12IFG2; // Enable interrupts for mctl2
 	// (we check all of them when the last one is done)
 
 	ADC12CTL0 |= ADC12ENC; // Enable conversions
@@ -30,3 +76,55 @@ __inline void adc_start_conversion()
 	if(!(ADC12CTL1 & ADC12BUSY))
 		ADC12CTL0 |= ADC12SC;
 }
+
+// Do a conversion for the pump's load estimate
+void adc_start_load_conversion(void)
+{
+	if(!(ADC12CTL1 & ADC12BUSY))
+	{
+		adc_load_sample = 1;
+		ADC12CTL0 |= ADC12SC;
+	}
+}
+
+// Filter a temperature reading and move the thresholds
+void adc_temperature_sample(unsigned int reading)
+{
+	long degrees; // deg C x 65536 from 30
+	int temperature;
+
+	// Moving average, seeded with the first reading
+	if(!adc_temperature_filter)
+		adc_temperature_filter = reading << 4;
+	else
+		adc_temperature_filter = adc_temperature_filter - (adc_temperature_filter >> TEMPERATURE_FILTER_SHIFT)
+			+ (reading << (4 - TEMPERATURE_FILTER_SHIFT));
+
+	degrees = ((long)adc_temperature_filter - adc_temperature_cal30) * adc_temperature_scale;
+	temperature = 30 + (int)adc_round(degrees, 16);
+	adc_temperature = temperature < -128 ? -128 : temperature > 127 ? 127 : temperature;
+
+	// Past the ends the sensor (or the battery chemistry) isn't worth following
+	if(temperature < TEMPERATURE_MIN)
+		temperature = TEMPERATURE_MIN;
+	else if(temperature > TEMPERATURE_MAX)
+		temperature = TEMPERATURE_MAX;
+	temperature -= TEMPERATURE_NOMINAL;
+
+	adc_level_offset = adc_round(temperature * ADC_LEVEL_PER_DEGREE, 8);
+	adc_charge_offset = adc_round(temperature * ADC_CHARGE_PER_DEGREE, 8);
+}
+
+unsigned char adc_compensate(unsigned char threshold, signed char offset)
+{
+	int level = threshold + offset;
+
+	return level < 0 ? 0 : level > 255 ? 255 : level;
+}
+
+long adc_round(long value, char shift)
+{
+	long half = 1L << (shift - 1);
+
+	return value < 0 ? -((-value + half) >> shift) : (value + half) >> shift;
+}
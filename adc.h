@@ -3,6 +3,15 @@
 
 /*
  * adc.h
+ *
+ * Each conversion runs battery (A0), panel (A1) and the chip's own
+ * temperature sensor (A10, against the 1.5V reference). The temperature is
+ * filtered and moves the battery thresholds: every one in definitions.h is
+ * for a battery at TEMPERATURE_NOMINAL, and code comparing a reading
+ * against one goes through BATTERY_LEVEL() (state of charge: lower in the
+ * cold) or CHARGE_LEVEL() (charge voltages: higher in the cold, lower in
+ * the heat). The die sits next to the battery in the same box, close
+ * enough for this.
  */
 
 #ifndef ADC_H_
@@ -16,10 +25,32 @@
 // For solar panel: min 0.5V -> 0.5/3.3 * 256 = 39
 //                  max 2.4V -> 2.4/3.3 * 256 = 186
 
+// Set when the running conversion is a pump load sample instead of the
+// regular once-a-second reading
+extern volatile char adc_load_sample;
+
+extern volatile signed char adc_temperature; // deg C, filtered
+extern volatile signed char adc_level_offset; // adc counts BATTERY_LEVEL adds at this temperature
+extern volatile signed char adc_charge_offset; // adc counts CHARGE_LEVEL adds
+
+// A battery threshold moved for the temperature
+#define BATTERY_LEVEL(threshold) adc_compensate(threshold, adc_level_offset)
+#define CHARGE_LEVEL(threshold) adc_compensate(threshold, adc_charge_offset)
+
 // Initialize the ADC
 void adc_initialize();
 
 // Run a conversion
 __inline void adc_start_conversion();
 
+// Run a conversion for the pump (results go to pump_load_sample)
+void adc_start_load_conversion(void);
+
+// Called from the adc interrupt with a temperature sensor reading (12 bit), filters
+// it and works out the threshold offsets
+void adc_temperature_sample(unsigned int reading);
+
+// threshold + offset, kept within the adc's range
+unsigned char adc_compensate(unsigned char threshold, signed char offset);
+
 #endif /* ADC_H_ */
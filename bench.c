@@ -0,0 +1,132 @@
+#include "bench.h"
+#include "uart.h"
+#include "flash.h"
+#include "inbox.h"
+#include "floatswitch.h"
+#include "stats.h"
+#include "datalog.h"
+#include "trace.h"
+
+/*
+ * bench.c
+ */
+
+#ifdef BENCHMARK
+
+// Kept by main.c
+extern volatile char battery_charge;
+extern volatile char solarpanel_voltage;
+void build_status_report(void);
+void build_diagnostics_report(void);
+
+unsigned int bench_cycles[BenchCount];
+unsigned char bench_slower;
+const char * const bench_names[BenchCount] = { "Inbox", "Status", "Diag", "Level", "Switches", "Stats", "LogAppend" };
+
+// From the last run that was taken as good ("bench" on the service port
+// prints this line), 0 until there is one
+const unsigned int bench_baseline[BenchCount] = { 0, 0, 0, 0, 0, 0, 0 };
+
+// Canned input (the year is 2000, so the clock doesn't get set from it)
+const char bench_header[] = "+CMGL: 3,\"REC UNREAD\",\"+14445556666\",\"\",\"00/01/01,12:00:00-20\"";
+const char bench_text[] = "What's up";
+const struct DatalogRecord bench_record = { 0 };
+
+volatile signed char bench_sink; // keeps the level lookups from being thrown out
+
+// One kernel, fastest of BENCH_RUNS
+unsigned int bench_kernel(char kernel);
+
+void bench_run(void)
+{
+  unsigned char i;
+  unsigned int overhead;
+  unsigned int start;
+  char timer_was_running = (TB0CTL & MC__CONTINUOUS) == MC__CONTINUOUS; // ISR_PROFILING has it
+
+  if(!timer_was_running)
+  {
+    TB0CTL = TBCLR;
+    TB0CTL = TBSSEL__SMCLK | MC__CONTINUOUS;
+  }
+
+  // What reading the timer twice costs
+  start = TB0R;
+  overhead = TB0R - start;
+
+  // Something to report on
+  battery_charge = 215;
+  solarpanel_voltage = 120;
+
+  flash_erase(TRACE_ADDRESS);
+  bench_slower = 0;
+  for(i = 0; i < BenchCount; ++i)
+  {
+    bench_cycles[i] = bench_kernel(i) - overhead;
+    if(bench_baseline[i] && bench_cycles[i] > bench_baseline[i] + (unsigned long)bench_baseline[i] * BENCH_TOLERANCE / 100)
+      bench_slower |= 1 << i;
+  }
+  flash_erase(TRACE_ADDRESS);
+
+  // Put back what the kernels ran over
+  battery_charge = 0;
+  solarpanel_voltage = 0;
+  inbox_reset();
+  inbox_actions = 0;
+  floatswitch_initialize();
+  stats_initialize();
+  tx_buffer_reset();
+
+  if(!timer_was_running)
+    TB0CTL = MC__STOP;
+}
+
+unsigned int bench_kernel(char kernel)
+{
+  unsigned int best = 0xFFFF;
+  unsigned int start;
+  unsigned int time;
+  unsigned char run;
+  unsigned char i;
+
+  for(run = 0; run < BENCH_RUNS; ++run)
+  {
+    start = TB0R;
+    switch(kernel)
+    {
+      case BenchInbox:
+        inbox_parse_line((char *)bench_header);
+        inbox_parse_line((char *)bench_text);
+        break;
+      case BenchStatus:
+        build_status_report();
+        break;
+      case BenchDiag:
+        build_diagnostics_report();
+        break;
+      case BenchLevel:
+        for(i = 0; i < 32; ++i)
+          bench_sink = get_water_level(i);
+        break;
+      case BenchSwitches:
+        floatswitch_tick(0x07, 0);
+        break;
+      case BenchStats:
+        stats_tick(215, 120, 0, 3, 0);
+        break;
+      case BenchLogAppend:
+        flash_write_bytes(TRACE_ADDRESS + run * sizeof(bench_record), (const char *)&bench_record,
+                          sizeof(bench_record));
+        break;
+    }
+    time = TB0R - start;
+    if(time < best)
+      best = time;
+
+    inbox_reset(); // room in the delete list for the next run
+  }
+
+  return best;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * bench.h
+ *
+ * Cycle counts for the code that runs most, built in with BENCHMARK. Timer
+ * B0 runs off SMCLK, which is MCLK here (DCO, 1048576 Hz), so one count is
+ * one CPU cycle. Right after startup, with interrupts still off, every
+ * kernel runs BENCH_RUNS times on canned input and the fastest run counts
+ * (minus what reading the timer costs). Those get checked against
+ * bench_baseline (from an earlier run, pasted in from the "bench" output on
+ * the service port); anything more than BENCH_TOLERANCE percent slower is
+ * flagged. Whatever the kernels touched gets set back up afterwards.
+ *
+ * The uart matcher isn't in here: it's inline in the uart handler, its cost
+ * per byte comes from ISR_PROFILING.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#define BENCH_RUNS 8
+#define BENCH_TOLERANCE 10 // percent over the baseline that counts as slower
+
+enum BenchKernel {
+  BenchInbox, // +CMGL header and text line through inbox_parse_line
+  BenchStatus, // build_status_report
+  BenchDiag, // build_diagnostics_report
+  BenchLevel, // get_water_level for all 32 switch patterns
+  BenchSwitches, // floatswitch_tick
+  BenchStats, // stats_tick (the readings pipeline)
+  BenchLogAppend, // one DatalogRecord written to flash (TRACEBANK, erased around it)
+  BenchCount
+};
+
+#ifdef BENCHMARK
+
+extern unsigned int bench_cycles[BenchCount]; // fastest run of each
+extern const unsigned int bench_baseline[BenchCount]; // 0 -> nothing to compare with yet
+extern const char * const bench_names[BenchCount];
+extern unsigned char bench_slower; // bit per kernel over the baseline
+
+// Runs everything (startup, interrupts off, after the other initialize calls)
+void bench_run(void);
+
+#else
+
+#define bench_run()
+
+#endif
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,207 @@
+#include "boot.h"
+
+/*
+ * boot.c
+ *
+ * All of this goes in .bootloader (BOOT) and runs before RAM is set up, so
+ * no globals, no constant tables and no calls out of this file (rts helpers
+ * included): the code has to come out the same in every build. Interrupts
+ * are still off from the reset.
+ */
+
+#define BOOT_JOURNAL ((unsigned char *)UPDATE_JOURNAL_START)
+#define BOOT_SCRATCH ((char *)UPDATE_SCRATCH_START)
+
+// Image segment index where it runs, and in STAGING
+char *boot_segment(unsigned int index);
+#define boot_staged(index) ((char *)UPDATE_STAGING_START + ((index) << 9))
+
+// Which pass of the swap a segment goes in (0 most, 1 startup code, 2 vectors)
+char boot_pass(unsigned int index);
+
+// Swaps the image and STAGING, skipping steps the journal has done
+// (steps: where they start in the journal). 1 if anything was left to do.
+char boot_swap(unsigned int steps);
+
+// Flash, with the controller's own waits (the CPU stalls while it's busy)
+void boot_erase(char *address);
+void boot_copy(char *to, const char *from);
+char boot_same(const char *a, const char *b);
+void boot_mark(unsigned int offset);
+
+// Starts over from the reset vector (the code that called us may be gone)
+void boot_restart(void);
+
+#pragma CODE_SECTION(_system_pre_init, ".bootloader")
+#pragma CODE_SECTION(boot_segment, ".bootloader")
+#pragma CODE_SECTION(boot_pass, ".bootloader")
+#pragma CODE_SECTION(boot_swap, ".bootloader")
+#pragma CODE_SECTION(boot_erase, ".bootloader")
+#pragma CODE_SECTION(boot_copy, ".bootloader")
+#pragma CODE_SECTION(boot_same, ".bootloader")
+#pragma CODE_SECTION(boot_mark, ".bootloader")
+#pragma CODE_SECTION(boot_restart, ".bootloader")
+
+int _system_pre_init(void)
+{
+  unsigned int trial;
+
+  WDTCTL = WDTPW | WDTHOLD; // main starts it again
+
+  if(boot_journal->magic != UPDATE_MAGIC)
+    return 1;
+
+  // Putting the new image in (or finishing that after a reset)
+  if(boot_swap(BOOT_JOURNAL_STEPS))
+    boot_restart();
+  if(BOOT_JOURNAL[BOOT_JOURNAL_CONFIRM] != 0xFF)
+    return 1;
+
+  // Going back to the old one
+  if(BOOT_JOURNAL[BOOT_JOURNAL_ROLLBACK] != 0xFF)
+  {
+    if(boot_swap(BOOT_JOURNAL_ROLLBACK_STEPS))
+      boot_restart();
+    return 1;
+  }
+
+  // New image on trial: another go, or back to the old one
+  for(trial = 0; trial < UPDATE_TRIAL_BOOTS; ++trial)
+  {
+    if(BOOT_JOURNAL[BOOT_JOURNAL_TRIALS + trial] == 0xFF)
+    {
+      boot_mark(BOOT_JOURNAL_TRIALS + trial);
+      return 1;
+    }
+  }
+  boot_mark(BOOT_JOURNAL_ROLLBACK);
+  boot_swap(BOOT_JOURNAL_ROLLBACK_STEPS);
+  boot_restart();
+  return 1;
+}
+
+char *boot_segment(unsigned int index)
+{
+  if(index < UPDATE_FLASH_SEGMENTS)
+    return (char *)UPDATE_FLASH_START + (index << 9);
+  index -= UPDATE_FLASH_SEGMENTS;
+  if(index < UPDATE_FLASH2_SEGMENTS)
+    return (char *)UPDATE_FLASH2_START + (index << 9);
+  return (char *)UPDATE_VECTORS_START;
+}
+
+char boot_pass(unsigned int index)
+{
+  char *segment = boot_segment(index);
+  char *entry;
+
+  if(index == UPDATE_SEGMENTS - 1)
+    return 2;
+
+  entry = (char *)(unsigned long)boot_journal->old_entry;
+  if(entry + UPDATE_ENTRY_SPAN > segment && entry < segment + FLASH_SEGMENT_SIZE)
+    return 1;
+  entry = (char *)(unsigned long)boot_journal->new_entry;
+  if(entry + UPDATE_ENTRY_SPAN > segment && entry < segment + FLASH_SEGMENT_SIZE)
+    return 1;
+  return 0;
+}
+
+char boot_swap(unsigned int steps)
+{
+  char pass;
+  char worked = 0;
+  unsigned int index;
+  char *active;
+  char *staged;
+
+  for(pass = 0; pass < 3; ++pass)
+  {
+    for(index = 0; index < UPDATE_SEGMENTS; ++index)
+    {
+      if(boot_pass(index) != pass)
+        continue;
+
+      // Three steps per segment: old one to scratch, new one in, old one to staging
+      if(BOOT_JOURNAL[steps + 2] == 0xFF)
+      {
+        worked = 1;
+        active = boot_segment(index);
+        staged = boot_staged(index);
+        if(BOOT_JOURNAL[steps] == 0xFF && boot_same(active, staged))
+        {
+          boot_mark(steps + 2); // nothing to swap
+        }
+        else
+        {
+          if(BOOT_JOURNAL[steps] == 0xFF)
+          {
+            boot_erase(BOOT_SCRATCH);
+            boot_copy(BOOT_SCRATCH, active);
+            boot_mark(steps);
+          }
+          if(BOOT_JOURNAL[steps + 1] == 0xFF)
+          {
+            boot_erase(active);
+            boot_copy(active, staged);
+            boot_mark(steps + 1);
+          }
+          boot_erase(staged);
+          boot_copy(staged, BOOT_SCRATCH);
+          boot_mark(steps + 2);
+        }
+      }
+      steps += 3;
+    }
+  }
+  return worked;
+}
+
+void boot_erase(char *address)
+{
+  while(FCTL3 & BUSY);
+  FCTL3 = FWKEY;
+  FCTL1 = FWKEY + ERASE;
+  *address = 0;
+  while(FCTL3 & BUSY);
+  FCTL1 = FWKEY;
+  FCTL3 = FWKEY + LOCK;
+}
+
+void boot_copy(char *to, const char *from)
+{
+  unsigned int i;
+
+  FCTL3 = FWKEY;
+  FCTL1 = FWKEY + WRT;
+  for(i = 0; i < FLASH_SEGMENT_SIZE; i += 2)
+    if(*(const unsigned int *)(from + i) != 0xFFFF) // erased already
+      *(unsigned int *)(to + i) = *(const unsigned int *)(from + i);
+  FCTL1 = FWKEY;
+  FCTL3 = FWKEY + LOCK;
+}
+
+char boot_same(const char *a, const char *b)
+{
+  unsigned int i;
+
+  for(i = 0; i < FLASH_SEGMENT_SIZE; i += 2)
+    if(*(const unsigned int *)(a + i) != *(const unsigned int *)(b + i))
+      return 0;
+  return 1;
+}
+
+void boot_mark(unsigned int offset)
+{
+  FCTL3 = FWKEY;
+  FCTL1 = FWKEY + WRT;
+  BOOT_JOURNAL[offset] = 0;
+  FCTL1 = FWKEY;
+  FCTL3 = FWKEY + LOCK;
+}
+
+void boot_restart(void)
+{
+  PMMCTL0 = PMMPW | PMMSWBOR;
+  for(;;);
+}
@@ -0,0 +1,82 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+#include "flash.h"
+
+/*
+ * boot.h
+ *
+ * Flash layout for firmware updates, and the installer that runs before
+ * anything else on every reset.
+ *
+ * The image is everything a build puts in FLASH, FLASH2 and the vector
+ * segment (see lnk_msp430f5529.cmd); BOOT (this installer) sits outside it
+ * and never changes, so every image has to be built with the same boot.c.
+ * STAGING is a second bank the same size as the image: update.c rebuilds
+ * the new image there from a delta patch and checks it, then fills in the
+ * journal and resets.
+ *
+ * The installer (_system_pre_init, called by the C startup before RAM is
+ * initialized) then swaps the image and STAGING a segment at a time through
+ * SCRATCH, so afterwards STAGING holds the old image. Each of the three
+ * steps per segment gets a byte in the journal once it's done, and a reset
+ * or power cut picks up at the first step that isn't. The segments holding
+ * the startup code of either image (UPDATE_ENTRY_SPAN from where its reset
+ * vector points) and then the vector segment go last. Only losing power
+ * during those last few segments can leave a board that doesn't start;
+ * the USB BSL in ROM can still load it then.
+ *
+ * The new image gets UPDATE_TRIAL_BOOTS resets to call update_confirm. If it
+ * doesn't, the installer swaps the old one back the same way (using the
+ * journal's second half).
+ *
+ * Journal (two segments, all 0xFF when there's nothing going on):
+ *   header   struct BootJournal, magic written last
+ *   trials   a byte per boot of the new image, 0 when used
+ *   confirm  0 once the new image has confirmed itself
+ *   rollback 0 once the installer has started swapping back
+ *   steps    install steps from BOOT_JOURNAL_STEPS, rollback steps from
+ *            BOOT_JOURNAL_ROLLBACK_STEPS
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+// Image: FLASH, then FLASH2, then the vector segment (keep in step with the linker file)
+#define UPDATE_FLASH_START 0x4A00UL
+#define UPDATE_FLASH_SEGMENTS 59 // 0x4A00 - 0xBFFF
+#define UPDATE_FLASH2_START 0x10000UL
+#define UPDATE_FLASH2_SEGMENTS 49 // 0x10000 - 0x161FF
+#define UPDATE_VECTORS_START 0xFE00UL // segment with the interrupt vectors (0xFF80 up)
+#define UPDATE_SEGMENTS (UPDATE_FLASH_SEGMENTS + UPDATE_FLASH2_SEGMENTS + 1)
+#define UPDATE_IMAGE_SIZE ((unsigned long)UPDATE_SEGMENTS * FLASH_SEGMENT_SIZE)
+
+#define UPDATE_STAGING_START 0x16200UL // UPDATE_IMAGE_SIZE
+#define UPDATE_SCRATCH_START 0x23C00UL // one segment
+#define UPDATE_JOURNAL_START 0x23E00UL // two segments
+
+#define UPDATE_ENTRY_SPAN 64 // startup code past the reset vector that has to stay whole
+#define UPDATE_MAGIC 0x5550 // "UP"
+
+#define BOOT_JOURNAL_TRIALS 0x20 // offsets into the journal
+#define BOOT_JOURNAL_CONFIRM 0x30
+#define BOOT_JOURNAL_ROLLBACK 0x31
+#define BOOT_JOURNAL_STEPS 0x40
+#define BOOT_JOURNAL_ROLLBACK_STEPS 0x200
+
+// Journal header, written by update.c once STAGING checks out
+struct BootJournal {
+  unsigned int old_entry; // reset vector of the running image
+  unsigned int new_entry; // and of the one in STAGING
+  unsigned int old_crc; // image CRCs (CRC-16/CCITT-FALSE)
+  unsigned int new_crc;
+  unsigned int magic; // UPDATE_MAGIC, last
+};
+
+#define boot_journal ((const struct BootJournal *)UPDATE_JOURNAL_START)
+#define boot_journal_byte(offset) (((const unsigned char *)UPDATE_JOURNAL_START)[offset])
+
+// Runs from the C startup before main (TI rts hook), installs or rolls back
+// if the journal says so. Returns 1: go on and initialize RAM.
+int _system_pre_init(void);
+
+#endif /* BOOT_H_ */
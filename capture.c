@@ -0,0 +1,202 @@
+#include "capture.h"
+#include "uart.h"
+#include "profile.h"
+
+/*
+ * capture.c
+ */
+
+#ifdef UART_CAPTURE
+
+#pragma DATA_SECTION(capture_records, ".usbram")
+struct CaptureRecord capture_records[CAPTURE_RECORDS];
+volatile unsigned int capture_count;
+volatile char capture_state;
+volatile char replay_byte;
+
+volatile unsigned int replay_mismatches;
+volatile unsigned int replay_first_mismatch;
+volatile unsigned int replay_overruns;
+volatile unsigned int replay_rx_peak;
+volatile unsigned int replay_latency_max;
+volatile unsigned long replay_latency_total;
+volatile unsigned int replay_latency_count;
+
+volatile unsigned int replay_index; // next record to look at for a byte to feed
+volatile unsigned int replay_expect; // next record to look at for a command/result
+volatile unsigned char replay_speed;
+volatile unsigned int replay_command_time; // TA1R when the last command went out
+
+// Adds a record while recording (stops when full)
+void capture_add(char kind, char byte);
+
+// Index of the next received byte / command or result, from index on
+// (capture_count if there isn't one)
+unsigned int capture_next_byte(unsigned int index);
+unsigned int capture_next_event(unsigned int index);
+
+// Modem back on the uart pins
+void replay_finish(void);
+
+char capture_start(void)
+{
+  if(capture_state == CaptureReplaying || uart_command_state != CommandStateIdle)
+    return 0;
+
+  capture_count = 0;
+  capture_state = CaptureRecording;
+  return 1;
+}
+
+void capture_stop(void)
+{
+  if(capture_state == CaptureRecording)
+    capture_state = CaptureOff;
+}
+
+char replay_start(unsigned char speed)
+{
+  if(capture_state == CaptureRecording || capture_state == CaptureReplaying || !capture_count
+     || uart_command_state != CommandStateIdle)
+    return 0;
+
+  replay_mismatches = 0;
+  replay_first_mismatch = 0xFFFF;
+  replay_overruns = 0;
+  replay_rx_peak = 0;
+  replay_latency_max = 0;
+  replay_latency_total = 0;
+  replay_latency_count = 0;
+  replay_index = 0;
+  replay_expect = 0;
+  replay_speed = speed ? speed : 1;
+  profile_reset(); // handler cost for just the replay
+  capture_state = CaptureReplaying;
+
+  // Modem off the pins (tx idles high), the uart keeps working without them
+  GSM_PORT_OUT |= UART_PIN_TX;
+  GSM_PORT_DIR |= UART_PIN_TX;
+  GSM_PORT_SEL &= ~(UART_PIN_RX | UART_PIN_TX);
+
+  // Timer A2 on ACLK like the recording's timer A1
+  TA2CTL = TACLR;
+  TA2EX0 = 0;
+  TA2CTL = TASSEL__ACLK | MC__CONTINUOUS;
+  TA2CCR0 = REPLAY_START_DELAY;
+  TA2CCTL0 = CCIE;
+  return 1;
+}
+
+void capture_rx(char byte, unsigned int waiting)
+{
+  if(capture_state == CaptureRecording)
+    capture_add(CaptureRx, byte);
+  else if(capture_state == CaptureReplaying && waiting > replay_rx_peak)
+    replay_rx_peak = waiting;
+}
+
+void capture_tx(char byte)
+{
+  if(capture_state == CaptureRecording)
+    capture_add(CaptureTx, byte);
+}
+
+void capture_event(char kind, char value)
+{
+  if(capture_state == CaptureRecording)
+  {
+    capture_add(kind, value);
+    return;
+  }
+  if(capture_state != CaptureReplaying)
+    return;
+
+  // Same thing as last time?
+  replay_expect = capture_next_event(replay_expect);
+  if(replay_expect >= capture_count || capture_records[replay_expect].kind != kind
+     || capture_records[replay_expect].byte != (unsigned char)value)
+  {
+    if(!replay_mismatches)
+      replay_first_mismatch = replay_expect;
+    replay_mismatches++;
+  }
+  if(replay_expect < capture_count)
+    replay_expect++;
+
+  // Command turnaround
+  if(kind == CaptureCommand)
+    replay_command_time = TA1R;
+  else
+  {
+    unsigned int latency = TA1R - replay_command_time;
+    if(latency > replay_latency_max)
+      replay_latency_max = latency;
+    replay_latency_total += latency;
+    replay_latency_count++;
+  }
+}
+
+void capture_add(char kind, char byte)
+{
+  struct CaptureRecord *record;
+
+  if(capture_count >= CAPTURE_RECORDS)
+  {
+    capture_state = CaptureOff; // full
+    return;
+  }
+  record = &capture_records[capture_count++];
+  record->time = TA1R;
+  record->kind = kind;
+  record->byte = byte;
+}
+
+unsigned int capture_next_byte(unsigned int index)
+{
+  while(index < capture_count && capture_records[index].kind != CaptureRx)
+    index++;
+  return index;
+}
+
+unsigned int capture_next_event(unsigned int index)
+{
+  while(index < capture_count && (capture_records[index].kind == CaptureRx || capture_records[index].kind == CaptureTx))
+    index++;
+  return index;
+}
+
+void replay_finish(void)
+{
+  TA2CCTL0 = 0;
+  TA2CTL = MC__STOP;
+  GSM_PORT_SEL |= UART_PIN_RX | UART_PIN_TX;
+  capture_state = CaptureReplayed;
+}
+
+// Feeds the next received byte to the uart handler and sets up the one after
+#pragma vector=TIMER2_A0_VECTOR
+__interrupt void replay_interrupt_handler()
+{
+  unsigned int next;
+  unsigned int gap;
+
+  replay_index = capture_next_byte(replay_index);
+  if(replay_index >= capture_count)
+  {
+    replay_finish();
+    LPM0_EXIT;
+    return;
+  }
+
+  if(UCA0IFG & UCRXIFG) // last one is still waiting (rx interrupts are off, or it's slow)
+    replay_overruns++;
+  replay_byte = capture_records[replay_index].byte;
+  UCA0IFG |= UCRXIFG; // uart handler takes it as if it came in
+
+  next = capture_next_byte(replay_index + 1);
+  gap = next < capture_count ? (capture_records[next].time - capture_records[replay_index].time) / replay_speed : 0;
+  TA2CCR0 += gap > REPLAY_MIN_GAP ? gap : REPLAY_MIN_GAP;
+  replay_index++;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * capture.h
+ *
+ * Modem traffic recording and playback, built in with UART_CAPTURE. Every
+ * modem is a little different (URCs, echo, timing) and the uart handler's
+ * bugs only show up against the real thing, so: "capture start" on the
+ * service port while idle records every byte each way with its time (timer
+ * A1, 32768 Hz), plus every command going out and what it came back with,
+ * until the buffer fills or "capture stop".
+ *
+ * "replay <speed>" (idle again) takes the modem off the uart pins and feeds
+ * the recorded received bytes to the uart handler at their original spacing
+ * divided by speed, by setting UCRXIFG with the byte waiting in replay_byte.
+ * The firmware answers the way it would have; every command and result gets
+ * checked against the recording. Afterwards "capture" shows the
+ * mismatches, how full the receive buffer got, the slowest command and, with
+ * ISR_PROFILING, what the handler cost per byte. Timer A2 paces it (free once
+ * warm_operational stops the boot timer).
+ *
+ * "capture dump" sends the raw records; tools/capturedump.py prints them as a
+ * transcript.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#define CAPTURE_RECORDS 160 // 640 bytes, in USBRAM with the other service buffers
+#define REPLAY_START_DELAY 3277 // timer A2 counts before the first byte (100 ms)
+#define REPLAY_MIN_GAP 2 // counts between bytes at the least (~60 us)
+
+enum CaptureKind {
+  CaptureRx, // byte: received
+  CaptureTx, // byte: sent
+  CaptureCommand, // byte: CommandState a command went out in
+  CaptureResult // byte: ReturnResult it finished with
+};
+
+enum CaptureState {
+  CaptureOff,
+  CaptureRecording,
+  CaptureReplaying,
+  CaptureReplayed // results are in
+};
+
+// One byte or event, 4 bytes (little endian, as stored)
+struct CaptureRecord {
+  unsigned int time; // TA1R (wraps every 2 s, gaps longer than that come out short)
+  unsigned char kind; // CaptureKind
+  unsigned char byte;
+};
+
+#ifdef UART_CAPTURE
+
+extern struct CaptureRecord capture_records[CAPTURE_RECORDS];
+extern volatile unsigned int capture_count;
+extern volatile char capture_state;
+extern volatile char replay_byte; // next "received" byte while replaying
+
+// Replay results
+extern volatile unsigned int replay_mismatches; // commands/results that came out different
+extern volatile unsigned int replay_first_mismatch; // record it was at (0xFFFF none)
+extern volatile unsigned int replay_overruns; // bytes fed before the last one was taken
+extern volatile unsigned int replay_rx_peak; // most bytes waiting in the rx buffer/ring
+extern volatile unsigned int replay_latency_max; // command sent -> result, timer A1 counts
+extern volatile unsigned long replay_latency_total;
+extern volatile unsigned int replay_latency_count;
+
+// Starts recording (1), or 0 if the uart isn't idle
+char capture_start(void);
+void capture_stop(void);
+
+// Plays the recording back, original spacing / speed. 0 if there's nothing
+// to play or the uart isn't idle
+char replay_start(unsigned char speed);
+
+// Hooks in uart.c
+void capture_rx(char byte, unsigned int waiting);
+void capture_tx(char byte);
+void capture_event(char kind, char value);
+
+#define CAPTURE_RX_BYTE() (capture_state == CaptureReplaying ? replay_byte : UCA0RXBUF)
+#define CAPTURE_RX(byte, waiting) capture_rx(byte, waiting)
+#define CAPTURE_TX(byte) capture_tx(byte)
+#define CAPTURE_EVENT(kind, value) capture_event(kind, value)
+
+#else
+
+#define CAPTURE_RX_BYTE() UCA0RXBUF
+#define CAPTURE_RX(byte, waiting)
+#define CAPTURE_TX(byte)
+#define CAPTURE_EVENT(kind, value)
+
+#endif
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,173 @@
+#include "charge.h"
+#include "trace.h"
+#include "adc.h"
+
+/*
+ * charge.c
+ */
+
+volatile char charge_stage;
+volatile unsigned int charge_duty;
+volatile unsigned long charge_on_seconds;
+
+volatile char charge_connected; // power.c has the panel on
+volatile unsigned int charge_stage_seconds; // in absorption / under CHARGE_REBULK in float
+volatile unsigned int charge_on_fraction; // duty counts toward the next charge_on_seconds
+volatile unsigned char charge_step; // duty step for holding a voltage
+volatile signed char charge_direction; // last step went up (1) or down (-1)
+
+// Moves to a stage
+void charge_set_stage(char stage);
+
+// One perturb and observe step toward target
+void charge_hold(unsigned char battery, unsigned char target);
+
+// Puts the duty on the switch
+void charge_apply(void);
+
+void charge_initialize(void)
+{
+  charge_stage = ChargeBulk;
+  charge_duty = CHARGE_PWM_PERIOD;
+  charge_on_seconds = 0;
+  charge_connected = 0;
+  charge_stage_seconds = 0;
+  charge_on_fraction = 0;
+  charge_step = CHARGE_STEP_MIN;
+  charge_direction = 0;
+  TA1CCTL2 = 0;
+}
+
+void charge_tick(char battery)
+{
+  unsigned char level = battery;
+  unsigned char absorb = CHARGE_LEVEL(CHARGE_ABSORB); // moved for the temperature
+  unsigned char rebulk = CHARGE_LEVEL(CHARGE_REBULK);
+
+  switch(charge_stage)
+  {
+    case ChargeBulk:
+    {
+      charge_duty = CHARGE_PWM_PERIOD;
+      if(level >= absorb)
+        charge_set_stage(ChargeAbsorb);
+      break;
+    }
+    case ChargeAbsorb:
+    {
+      charge_hold(level, absorb);
+      if(level < rebulk) // something big is pulling it down, start over
+        charge_set_stage(ChargeBulk);
+      else if(++charge_stage_seconds >= CHARGE_ABSORB_SECONDS)
+        charge_set_stage(ChargeFloat);
+      break;
+    }
+    case ChargeFloat:
+    {
+      charge_hold(level, CHARGE_LEVEL(CHARGE_FLOAT));
+      if(level >= rebulk)
+        charge_stage_seconds = 0;
+      else if(++charge_stage_seconds >= CHARGE_REBULK_SECONDS)
+        charge_set_stage(ChargeBulk);
+      break;
+    }
+  }
+
+  if(charge_connected)
+  {
+    charge_on_fraction += charge_duty;
+    while(charge_on_fraction >= CHARGE_PWM_PERIOD)
+    {
+      charge_on_fraction -= CHARGE_PWM_PERIOD;
+      charge_on_seconds++;
+    }
+  }
+
+  charge_apply();
+}
+
+void charge_connect(void)
+{
+  charge_connected = 1;
+  charge_apply();
+}
+
+void charge_disconnect(void)
+{
+  charge_connected = 0;
+  TA1CCTL2 = 0;
+  PUMPSOLAR_PORT_OUT &= ~SOLARPANEL_CONTROL;
+}
+
+void charge_pwm_interrupt(void)
+{
+  if(PUMPSOLAR_PORT_OUT & SOLARPANEL_CONTROL) // on phase is over
+  {
+    PUMPSOLAR_PORT_OUT &= ~SOLARPANEL_CONTROL;
+    TA1CCR2 += CHARGE_PWM_PERIOD - charge_duty;
+  }
+  else
+  {
+    PUMPSOLAR_PORT_OUT |= SOLARPANEL_CONTROL;
+    TA1CCR2 += charge_duty;
+  }
+}
+
+void charge_set_stage(char stage)
+{
+  charge_stage = stage;
+  charge_stage_seconds = 0;
+  charge_step = CHARGE_STEP_MIN;
+  charge_direction = 0;
+  if(stage == ChargeBulk)
+    charge_duty = CHARGE_PWM_PERIOD;
+  trace_event(TraceCharge, stage);
+}
+
+void charge_hold(unsigned char battery, unsigned char target)
+{
+  signed char direction;
+
+  if(battery == target)
+    return;
+  direction = battery > target ? -1 : 1; // too high -> less on-time
+
+  // Still heading the same way: bigger steps. Went past it: smaller ones.
+  if(direction == charge_direction)
+  {
+    if(charge_step < CHARGE_STEP_MAX)
+      charge_step <<= 1;
+  }
+  else if(charge_step > CHARGE_STEP_MIN)
+    charge_step >>= 1;
+  charge_direction = direction;
+
+  if(direction > 0)
+    charge_duty = charge_duty + charge_step > CHARGE_PWM_PERIOD ? CHARGE_PWM_PERIOD : charge_duty + charge_step;
+  else
+    charge_duty = charge_duty > charge_step ? charge_duty - charge_step : 0;
+}
+
+void charge_apply(void)
+{
+  if(!charge_connected)
+    return;
+
+  // Too close to fully on/off for the timer: just hold the pin
+  if(charge_duty >= CHARGE_PWM_PERIOD - CHARGE_PWM_MIN_PHASE)
+  {
+    TA1CCTL2 = 0;
+    PUMPSOLAR_PORT_OUT |= SOLARPANEL_CONTROL;
+  }
+  else if(charge_duty <= CHARGE_PWM_MIN_PHASE)
+  {
+    TA1CCTL2 = 0;
+    PUMPSOLAR_PORT_OUT &= ~SOLARPANEL_CONTROL;
+  }
+  else if(!(TA1CCTL2 & CCIE)) // start it with an on phase, the interrupt picks up the new duty by itself
+  {
+    PUMPSOLAR_PORT_OUT |= SOLARPANEL_CONTROL;
+    TA1CCR2 = TA1R + charge_duty;
+    TA1CCTL2 = CCIE;
+  }
+}
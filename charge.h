@@ -0,0 +1,51 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * charge.h
+ *
+ * Battery charging through the panel switch. Instead of leaving the panel
+ * on the battery whenever power.c connects it, the switch is pulse width
+ * modulated (timer A1 CCR2, 128 Hz; P1.6 isn't a timer pin, so the
+ * interrupt flips it) and the duty follows the usual lead-acid stages:
+ *   bulk        fully on until the battery reaches CHARGE_ABSORB
+ *   absorption  held at CHARGE_ABSORB for CHARGE_ABSORB_SECONDS
+ *   float       held at CHARGE_FLOAT, back to bulk once the battery has
+ *               been under CHARGE_REBULK for CHARGE_REBULK_SECONDS
+ * All three voltages follow the temperature (CHARGE_LEVEL, see adc.h).
+ * Holding a voltage is perturb and observe on the duty: every second the
+ * duty takes a step, and the step size doubles while the battery keeps
+ * moving the right way and halves when it overshoots.
+ *
+ * The panel is tied straight to the battery while the switch is on, so
+ * there's no operating point to move along the panel's curve (that needs a
+ * buck stage); what this buys is not boiling the battery on long sunny days.
+ */
+
+#ifndef CHARGE_H_
+#define CHARGE_H_
+
+enum ChargeStage {
+  ChargeBulk,
+  ChargeAbsorb,
+  ChargeFloat
+};
+
+extern volatile char charge_stage;
+extern volatile unsigned int charge_duty; // timer A1 counts on out of CHARGE_PWM_PERIOD
+extern volatile unsigned long charge_on_seconds; // panel switch on-time so far (duty weighted)
+
+void charge_initialize(void);
+
+// Called once a second with the battery reading (adc counts), works out the
+// stage and the duty
+void charge_tick(char battery);
+
+// power.c turning the panel on (pwm at the current duty) and off
+void charge_connect(void);
+void charge_disconnect(void);
+
+// Called from the timer A1 interrupt for CCR2, ends the on or off phase
+void charge_pwm_interrupt(void);
+
+#endif /* CHARGE_H_ */
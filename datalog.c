@@ -0,0 +1,136 @@
+#include "datalog.h"
+#include "flash.h"
+#include "pump.h"
+#include "rtc.h"
+
+/*
+ * datalog.c
+ */
+
+volatile unsigned int datalog_count;
+volatile unsigned int datalog_next_sequence;
+volatile unsigned int datalog_pending;
+
+#define datalog_bank ((const struct DatalogRecord *) DATALOG_ADDRESS)
+#define datalog_next(sequence) ((sequence) + 1 == DATALOG_BLANK ? 0 : (sequence) + 1)
+
+volatile unsigned int datalog_slot; // where the next record goes
+volatile unsigned int datalog_seconds; // into the current interval
+unsigned long datalog_last_runtime; // pump_runtime at the last record
+unsigned int datalog_last_cycles; // pump_cycles at the last record
+
+// Adds up a record's bytes (0 for a good one)
+unsigned char datalog_sum(const struct DatalogRecord *record);
+
+void datalog_initialize(void)
+{
+  unsigned int i;
+
+  datalog_count = 0;
+  datalog_next_sequence = 0;
+  datalog_slot = 0;
+  datalog_seconds = 0;
+  datalog_last_runtime = pump_runtime;
+  datalog_last_cycles = pump_cycles;
+
+  // The newest record is the one that isn't followed by the next sequence
+  for(i = 0; i < DATALOG_RECORDS; ++i)
+  {
+    const struct DatalogRecord *record = &datalog_bank[i];
+    const struct DatalogRecord *after = &datalog_bank[(i + 1) % DATALOG_RECORDS];
+
+    if(record->sequence == DATALOG_BLANK || datalog_sum(record) != 0)
+      continue;
+    datalog_count++;
+    if(after->sequence != datalog_next(record->sequence) || datalog_sum(after) != 0)
+    {
+      datalog_next_sequence = datalog_next(record->sequence);
+      datalog_slot = (i + 1) % DATALOG_RECORDS;
+    }
+  }
+
+  // Don't know what made it up before the restart, send it all again
+  datalog_pending = datalog_count;
+}
+
+void datalog_tick(char battery, char panel, char switches, int level, unsigned char flags)
+{
+  struct DatalogRecord record;
+
+  if(++datalog_seconds < DATALOG_INTERVAL)
+    return;
+  datalog_seconds = 0;
+
+  record.time = rtc_get_time();
+  record.sequence = datalog_next_sequence;
+  record.battery_mv = (unsigned char)battery * BATTERY_MV_PER_COUNT;
+  record.pump_seconds = pump_runtime - datalog_last_runtime;
+  record.panel = panel;
+  record.level = level;
+  record.flags = flags;
+  record.switches = switches;
+  record.pump_cycles = pump_cycles - datalog_last_cycles;
+  record.checksum = 0;
+  record.checksum = -datalog_sum(&record);
+
+  datalog_last_runtime = pump_runtime;
+  datalog_last_cycles = pump_cycles;
+
+  // Starting a segment: erase it first (the oldest records go)
+  if(datalog_slot % DATALOG_RECORDS_PER_SEGMENT == 0)
+  {
+    flash_erase(DATALOG_ADDRESS + datalog_slot * sizeof(record));
+    if(datalog_count > DATALOG_RECORDS - DATALOG_RECORDS_PER_SEGMENT)
+      datalog_count = DATALOG_RECORDS - DATALOG_RECORDS_PER_SEGMENT;
+    if(datalog_pending > datalog_count)
+      datalog_pending = datalog_count;
+  }
+  flash_write_bytes(DATALOG_ADDRESS + datalog_slot * sizeof(record), (const char *)&record, sizeof(record));
+
+  datalog_count++;
+  datalog_pending++;
+  datalog_next_sequence = datalog_next(datalog_next_sequence);
+  datalog_slot = (datalog_slot + 1) % DATALOG_RECORDS;
+}
+
+unsigned int datalog_span(unsigned int from, const char **data)
+{
+  unsigned int count = from < datalog_count ? datalog_count - from : 0;
+  unsigned int slot = (datalog_slot + DATALOG_RECORDS - count) % DATALOG_RECORDS;
+
+  if(count > DATALOG_RECORDS - slot) // stop at the end of the bank
+    count = DATALOG_RECORDS - slot;
+
+  *data = (const char *)&datalog_bank[slot];
+  return count;
+}
+
+unsigned int datalog_upload_batch(const char **data, unsigned int max)
+{
+  unsigned int count = datalog_span(datalog_count - datalog_pending, data); // oldest pending
+
+  return count < max ? count : max;
+}
+
+void datalog_uploaded(unsigned int count)
+{
+  datalog_pending = count < datalog_pending ? datalog_pending - count : 0;
+}
+
+void datalog_upload_rewind(unsigned int count)
+{
+  datalog_pending += count;
+  if(datalog_pending > datalog_count)
+    datalog_pending = datalog_count;
+}
+
+unsigned char datalog_sum(const struct DatalogRecord *record)
+{
+  const unsigned char *bytes = (const unsigned char *)record;
+  unsigned char sum = 0;
+  unsigned int i;
+
+  for(i = 0; i < sizeof(struct DatalogRecord); ++i)
+    sum += bytes[i];
+  return sum;
+}
@@ -0,0 +1,65 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * datalog.h
+ *
+ * History kept in main flash (LOGBANK in the linker file) so it can be
+ * uploaded later. Records go around the bank as a ring; a segment is erased
+ * right before it gets written again, which drops the oldest
+ * DATALOG_RECORDS_PER_SEGMENT records. Every record has a sequence number so
+ * an upload can pick up where it left off and the collector can throw out
+ * repeats.
+ */
+
+#ifndef DATALOG_H_
+#define DATALOG_H_
+
+#define DATALOG_ADDRESS (char *) 0xC000 // LOGBANK
+#define DATALOG_SIZE 0x3C00
+#define DATALOG_RECORDS (DATALOG_SIZE / sizeof(struct DatalogRecord)) // 960, ~10 days at DATALOG_INTERVAL
+#define DATALOG_RECORDS_PER_SEGMENT (FLASH_SEGMENT_SIZE / sizeof(struct DatalogRecord))
+#define DATALOG_BLANK 0xFFFF // sequence of an erased record
+
+// One record, 16 bytes (multi-byte fields are little endian, as stored)
+struct DatalogRecord {
+  unsigned long time; // rtc_get_time
+  unsigned int sequence; // counts up, skips DATALOG_BLANK
+  unsigned int battery_mv;
+  unsigned int pump_seconds; // pump on-time during the interval
+  unsigned char panel; // adc counts
+  signed char level; // water level
+  unsigned char flags; // TelemetryFlag bits
+  unsigned char switches; // float switches as read
+  unsigned char pump_cycles; // pump starts during the interval
+  unsigned char checksum; // all 16 bytes add up to 0 (catches half written records)
+};
+
+extern volatile unsigned int datalog_count; // valid records in the bank
+extern volatile unsigned int datalog_next_sequence; // sequence the next record gets
+extern volatile unsigned int datalog_pending; // newest records not uploaded yet
+
+// Finds the newest record (scans the bank, only done at startup)
+void datalog_initialize(void);
+
+// Called once a second, writes a record every DATALOG_INTERVAL
+void datalog_tick(char battery, char panel, char switches, int level, unsigned char flags);
+
+// Records in flash order starting with the from-th oldest: points data at
+// the first and returns how many follow it contiguously (the rest, if any,
+// start over at the beginning of the bank)
+unsigned int datalog_span(unsigned int from, const char **data);
+
+// Where the next records to upload are. They're contiguous in flash so they
+// can be sent straight from there; returns how many (at most max, fewer at the
+// end of the bank).
+unsigned int datalog_upload_batch(const char **data, unsigned int max);
+
+// The records from the last datalog_upload_batch made it (first next time is
+// the one after them)
+void datalog_uploaded(unsigned int count);
+
+// Connection dropped: go back a batch, the collector throws out repeats
+void datalog_upload_rewind(unsigned int count);
+
+#endif /* DATALOG_H_ */
@@ -41,9 +41,6 @@
 #define LED_MSP BIT4 // P6.4
 #define LED_MSP_2 BIT5 // P6.5
 
-#define FLOAT_PORT_OUT P1OUT
-#define FLOAT_PORT_DIR P1DIR
-#define FLOAT_PORT_REN P1REN
 #define FLOATSWITCH_0 BIT0 // P1.0
 #define FLOATSWITCH_1 BIT1 // P1.1
 #define FLOATSWITCH_2 BIT2 // P1.2
@@ -51,8 +48,18 @@
 #define FLOATSWITCH_4 BIT4 // P1.4
 #define FLOATSWITCH_5 BIT5 // P1.5 (are we using this)
 
+// Float switch pin map: each group is a run of switches on one port that keeps
+// its bit order, { port, pins, shift right to line them up with the logical
+// bits (bit 0 = lowest switch) }. A board with switches 0-2 on P1.0-P1.2 and
+// 3-4 on P2.4-P2.5 would use two groups:
+//   { FLOATSWITCH_PORT(1), BIT0 | BIT1 | BIT2, 0 }, { FLOATSWITCH_PORT(2), BIT4 | BIT5, 1 }
+#define FLOATSWITCH_GROUP_COUNT 1
+#define FLOATSWITCH_GROUPS \
+  { FLOATSWITCH_PORT(1), FLOATSWITCH_0 | FLOATSWITCH_1 | FLOATSWITCH_2 | FLOATSWITCH_3 | FLOATSWITCH_4, 0 }
+
 #define PUMPSOLAR_PORT_OUT P1OUT
 #define PUMPSOLAR_PORT_DIR P1DIR
+#define PUMPSOLAR_PORT_SEL P1SEL // P1.7 doubles as TA1.0 for the pump pwm
 #define SOLARPANEL_CONTROL BIT6 // P1.6
 #define PUMP_CONTROL BIT7 // P1.7
 
@@ -74,15 +81,127 @@
 #define GSM_POWER_CONTROL BIT0 // P3.0
 #define GSM_POWER_STATUS BIT5 // P3.5
 
+// Optional hardware flow control with the modem on spare port 3 pins
+//#define UART_FLOW_CONTROL
+#define UART_PIN_RTS BIT1 // P3.1, output, low -> modem may send to us
+#define UART_PIN_CTS BIT2 // P3.2, input, low -> we may send to the modem
+
 #define GSMPOWER_PORT_OUT P4OUT
 #define GSMPOWER_PORT_DIR P4DIR
 #define GSMPOWER_ENABLE_PIN BIT0 // P4.0
 
 #endif
 
-#define TIMEOUT_SMS 65535 //(Don't set this more than 65535) 15 seconds with a 4096hz timer
 #define MAX_SMS_INDEX_DIGITS 5 // sms index can have up to 5 digits (99999)
+#define MAX_PHONE_LENGTH 16 // like +14445556666
 #define BATTERY_THRESHOLD_LOW 140 // when the bat is losing charge, is pumping, and should stop now (aka very low)
 #define BATTERY_THRESHOLD_HIGH 210 // when the bat is charging, not pumping, and can start now (aka very full)
+#define BATTERY_MV_PER_COUNT 57 // 228 -> 12.9V, so each adc count is about 57mV
+#define DIGEST_TIME 64800 // seconds into the day the daily digest text goes out (18:00, an RTC alarm, the service port can change it)
+
+// Clock (RTC calendar, set from the network)
+#define RTC_YEAR_MIN 2016 // calendar starts here until it's set, anything not after it is a modem that doesn't know
+#define RTC_SYNC_PERIOD 86400 // seconds between checks with the network clock
+#define RTC_SYNC_RETRY 3600 // seconds between tries while the network hasn't given us the time
+#define QUIET_HOURS_START 22 // warning texts wait from this hour...
+#define QUIET_HOURS_END 7 // ...until this one (local time)
+
+// Water pump pwm (timer A1 runs off ACLK, so one count is ~30us)
+#define PUMP_PWM_PERIOD 64 // counts per pwm period (512 Hz)
+#define PUMP_PWM_MIN_PHASE 8 // shortest on/off phase we ask the timer for (leaves time for the isr)
+#define PUMP_DUTY_START 16 // soft-start duty, out of PUMP_PWM_PERIOD (25%)
+#define PUMP_DUTY_RUN 64 // running duty, out of PUMP_PWM_PERIOD (64 -> fully on, no pwm)
+#define PUMP_RAMP_STEP_PERIODS 21 // pwm periods per duty step (48 steps * 21 periods ~= 2 seconds)
+
+// Water pump fault detection (battery sag under load, in adc counts)
+#define PUMP_SAG_DRYRUN 1 // sag at or below this means the pump is spinning without water
+#define PUMP_SAG_STALL 12 // sag at or above this means the rotor is stuck
+#define PUMP_FAULT_SECONDS 15 // a condition has to last this long to count as a fault
+#define PUMP_FAULT_LOCKOUT 1800 // seconds the pump stays off after a fault
+#define BATTERY_RESISTANCE_MOHM 50 // battery + wiring resistance, used to turn sag into current
+
+// Solar panel / pump switching (timer A0 runs at 4096 Hz)
+#define POWER_DEADTIME 205 // ticks between opening one switch and closing another (50 ms)
+#define POWER_PANEL_KEEP 113 // keep charging while pumping if the panel is above this (medium charge rate)
+#define POWER_PANEL_HYST 8 // panel has to come back this far above POWER_PANEL_KEEP to reconnect mid-run
+
+// Charging (panel switch pwm on timer A1 CCR2, battery in adc counts, see charge.h)
+#define CHARGE_PWM_PERIOD 256 // timer A1 counts per pwm period (128 Hz)
+#define CHARGE_PWM_MIN_PHASE 8 // shortest on/off phase we ask the timer for
+#define CHARGE_ABSORB 252 // 14.4V, bulk ends / absorption holds here
+#define CHARGE_FLOAT 238 // 13.6V, float holds here
+#define CHARGE_REBULK 221 // 12.6V, under this for CHARGE_REBULK_SECONDS goes back to bulk
+#define CHARGE_ABSORB_SECONDS 7200 // time in absorption before float
+#define CHARGE_REBULK_SECONDS 300
+#define CHARGE_STEP_MIN 1 // duty steps while holding a voltage (counts)
+#define CHARGE_STEP_MAX 32
+
+// Temperature compensation (adc internal sensor; thresholds above are for a battery at TEMPERATURE_NOMINAL)
+#define TEMPERATURE_NOMINAL 25 // deg C
+#define TEMPERATURE_MIN -20 // compensation stops moving outside these (deg C)
+#define TEMPERATURE_MAX 50
+#define TEMPERATURE_FILTER_SHIFT 4 // each reading moves the filtered temperature 1/16 of the way (~16 s, 4 at most)
+#define BATTERY_LEVEL_TEMPCO 12 // mV per deg C on the level thresholds (a cold battery sags more for the same charge)
+#define BATTERY_CHARGE_TEMPCO -30 // mV per deg C on the charge voltages (-5 mV per cell, 6 cells)
+
+// Network (registration, signal, when to send)
+#define NETWORK_RSSI_MIN 8 // AT+CSQ at or above this is worth sending on (0-31, 8 ~ -97 dBm)
+#define NETWORK_CSQ_PERIOD 600 // seconds between signal checks
+#define NETWORK_CSQ_PERIOD_WAITING 30 // seconds between signal checks while a text is waiting
+#define NETWORK_RETRY_MIN 15 // seconds before trying a failed text again (doubles each failure)
+#define NETWORK_RETRY_MAX 960 // longest wait between tries
+#define NETWORK_SEND_TIMEOUT 60 // seconds to wait for the modem to send a text
+
+// History log and uploading it (GPRS)
+#define DATALOG_INTERVAL 900 // seconds between log records
+#define DATALOG_BATCH 64 // records per AT+CIPSEND (1 kB)
+#define DATALOG_UPLOAD_AT 288 // upload by itself once this many records are waiting (3 days)
+#define GPRS_APN "internet" // carrier's access point
+#define GPRS_COLLECTOR_HOST "collector.example.com" // where the log goes (TCP)
+#define GPRS_COLLECTOR_PORT "5140"
+#define GPRS_CONNECT_TIMEOUT 60 // seconds to wait for CONNECT OK / the bearer to come up
+
+// Firmware updates (delta patches from the collector at the end of an upload session, see update.h)
+#define UPDATE_CHECK_FIRST 900 // seconds after a reset before the first check
+#define UPDATE_CHECK_INTERVAL 86400UL // seconds between checks after that
+#define UPDATE_SESSION_WAIT 120 // seconds between sessions while a patch is coming in
+#define UPDATE_SESSION_WINDOWS 16 // windows per session (the modem is free for texts in between)
+#define UPDATE_STALL_SESSIONS 3 // sessions in a row without a byte of patch before giving up on it
+#define UPDATE_FIFO_SIZE 512 // patch bytes asked for per window, applied while the modem is quiet
+#define UPDATE_SLICE 64 // bytes written to STAGING (or checked) per main loop pass
+#define UPDATE_TRIAL_BOOTS 3 // resets a new image gets to confirm itself in (16 at most)
+#define UPDATE_CONFIRM_SECONDS 600 // registered this long -> new image is good
+
+// USB service port (needs TI's USB API in the project, see service.h)
+//#define USB_SERVICE_PORT
+
+// Stack watch (see stack.h)
+#define STACK_HEADROOM_MIN 512 // Diag text warns when the stack has come closer than this to the statics
+
+// Event trace (see trace.h)
+#define TRACE_READING_DELTA 4 // adc counts a reading has to move to get traced
+#define TRACE_FLUSH_HOLDOFF 3600 // seconds between stall flushes to flash (spares the segment)
+
+// Interrupt handler timing on timer B0 (see profile.h), for bench builds
+//#define ISR_PROFILING
+
+// Modem traffic recording and replay over the service port (see capture.h), for bench builds
+//#define UART_CAPTURE
+
+// Cycle counts of the busiest code at startup (see bench.h), for bench builds
+//#define BENCHMARK
+
+// Uart flow control (timer A0 ticks)
+#define UART_CTS_POLL 4 // how often to check CTS while the modem holds us off (~1 ms)
+
+// Port registers for a float switch group (in, out, dir, ren)
+#define FLOATSWITCH_PORT(n) &P##n##IN, &P##n##OUT, &P##n##DIR, &P##n##REN
+
+// Float switch diagnostics
+#define FLOATSWITCH_COUNT 5 // switches 0-4 (FLOATSWITCH_5 isn't wired up)
+#define FLOAT_STUCK_SECONDS 900 // a switch that stays on this long while pumping is stuck on
+#define FLOAT_CONTRADICTION_LIMIT 30 // bad readings blamed on a switch before it is suspect
+#define FLOAT_DEGRADED_MAX_RUN 300 // with a suspect switch, pump at most this many seconds...
+#define FLOAT_DEGRADED_REST 900 // ...then rest this long before pumping again
 
 #endif /* DEFINITIONS_H_ */
@@ -0,0 +1,86 @@
+/*
+ * flash.c
+ *
+ *  Created on: Feb 21, 2016
+ *      Author: Patrick Fant
+ */
+
+#include "flash.h"
+#include "stack.h"
+#include <string.h>
+
+
+// Interrupts go off while the flash controller is busy. These put them back
+// the way they were, so it's fine to call from an interrupt handler too.
+#define flash_lock_interrupts(sr) do { (sr) = __get_SR_register(); _DINT(); } while(0)
+#define flash_unlock_interrupts(sr) do { if((sr) & GIE) _EINT(); } while(0)
+
+
+void flash_erase(char * address)
+{
+	unsigned int sr;
+
+	STACK_MARK(StackFlash);
+	uart_rx_hold(); // can't take bytes with interrupts off
+	flash_lock_interrupts(sr);
+	while(BUSY & FCTL3);
+	FCTL1 = FWKEY + ERASE;
+	FCTL3 = FWKEY;
+
+	// Erase flash segment.
+	*address = 0;
+
+	while(BUSY & FCTL3);
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+	flash_unlock_interrupts(sr);
+	uart_rx_release();
+}
+
+
+void flash_write(char * address, char * buffer)
+{
+	flash_write_bytes(address, buffer, FLASH_BUFFER_SIZE);
+}
+
+
+void flash_write_bytes(char * address, const char * data, unsigned int length)
+{
+	unsigned int sr;
+	unsigned int i;
+
+	STACK_MARK(StackFlash);
+	uart_rx_hold();
+	flash_lock_interrupts(sr);
+	FCTL3 = FWKEY;
+	FCTL1 = FWKEY + WRT;
+
+	// Copy buffer into memory.
+	for (i = 0; i < length; ++i)
+		*address++ = data[i];
+
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+	flash_unlock_interrupts(sr);
+	uart_rx_release();
+}
+
+
+void flash_write_phone_number(char * phone_number, unsigned char max_length)
+{
+	// Borrow a block to pad it out in (only the flash writer ever takes the
+	// last one)
+	char *buffer = pool_take(PoolOwnerFlash, 1);
+	int i;
+
+	if(!buffer)
+		return;
+	memset(buffer, 0, FLASH_BUFFER_SIZE);
+
+	// Copy phone number into buffer.
+	for (i = 0; i < max_length; ++i)
+		buffer[i] = phone_number[i];
+
+	flash_write(PHONE_ADDRESS, buffer);
+	pool_give(buffer, 1);
+}
@@ -10,66 +10,36 @@
 
 
 #include <msp430f5529.h>
+#include "uart.h"
 
 
-#define FLASH_BUFFER_SIZE 128
+#define FLASH_BUFFER_SIZE POOL_BLOCK_SIZE
 #define PHONE_ADDRESS (char *) 0x1900	// Address of phone number in memory.
+#define FLASH_SEGMENT_SIZE 512 // main flash erases in 512 byte segments (info flash: 128)
 
 
 /**
  * Erase flash segment pointed to by address.
  */
-void flash_erase(char * address)
-{
-	_DINT();
-	while(BUSY & FCTL3);
-	FCTL1 = FWKEY + ERASE;
-	FCTL3 = FWKEY;
-
-	// Erase flash segment.
-	*address = 0;
-
-	while(BUSY & FCTL3);
-	FCTL1 = FWKEY;
-	FCTL3 = FWKEY + LOCK;
-	_EINT();
-}
+void flash_erase(char * address);
 
 
 /**
  * Write buffer to flash segment pointed to by address.
  */
-void flash_write(char * address, char * buffer)
-{
-	_DINT();
-	FCTL3 = FWKEY;
-	FCTL1 = FWKEY + WRT;
+void flash_write(char * address, char * buffer);
 
-	// Copy buffer into memory.
-	int i;
-	for (i = 0; i < FLASH_BUFFER_SIZE; ++i)
-		*address++ = buffer[i];
 
-	FCTL1 = FWKEY;
-	FCTL3 = FWKEY + LOCK;
-	_EINT();
-}
+/**
+ * Write length bytes to already erased flash at address.
+ */
+void flash_write_bytes(char * address, const char * data, unsigned int length);
 
 
 /**
  * Write phone number to flash memory.
  */
-void flash_write_phone_number(char * phone_number, unsigned char max_length)
-{
-	char buffer[FLASH_BUFFER_SIZE] = {0};
-
-	// Copy phone number into buffer.
-	int i;
-	for (i = 0; i < max_length; ++i)
-		buffer[i] = phone_number[i];
-
-	flash_write(PHONE_ADDRESS, buffer);
-}
+void flash_write_phone_number(char * phone_number, unsigned char max_length);
 
 
 #endif /* FLASH_H_ */
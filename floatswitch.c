@@ -0,0 +1,203 @@
+#include "floatswitch.h"
+#include <stdbool.h>
+
+/*
+ * floatswitch.c
+ */
+
+volatile char floatswitch_suspect_high;
+volatile char floatswitch_suspect_low;
+volatile int floatswitch_level;
+volatile char floatswitch_degraded;
+volatile unsigned int floatswitch_transitions[FLOATSWITCH_COUNT];
+volatile unsigned char floatswitch_contradictions[FLOATSWITCH_COUNT];
+
+// Where the switches are wired up
+const struct FloatswitchGroup floatswitch_groups[FLOATSWITCH_GROUP_COUNT] = { FLOATSWITCH_GROUPS };
+
+volatile char last_switches; // reading from the last tick
+volatile unsigned int pumping_seconds[FLOATSWITCH_COUNT]; // seconds on while pumping without moving
+
+// Degraded mode pump limiting
+volatile unsigned int degraded_run_seconds;
+volatile unsigned int degraded_rest_seconds;
+
+// Figures out which switches an impossible reading is most likely the fault of
+void blame_switches(char switches);
+
+void floatswitch_initialize(void)
+{
+  int i;
+
+  // Inputs with pull-ups (the float pulls the pin to ground when the switch is NOT active)
+  for(i = 0; i < FLOATSWITCH_GROUP_COUNT; ++i)
+  {
+    *floatswitch_groups[i].dir &= ~floatswitch_groups[i].pins;
+    *floatswitch_groups[i].ren |= floatswitch_groups[i].pins;
+    *floatswitch_groups[i].out |= floatswitch_groups[i].pins;
+  }
+
+  for(i = 0; i < FLOATSWITCH_COUNT; ++i)
+  {
+    floatswitch_transitions[i] = 0;
+    floatswitch_contradictions[i] = 0;
+    pumping_seconds[i] = 0;
+  }
+  floatswitch_suspect_high = 0;
+  floatswitch_suspect_low = 0;
+  floatswitch_level = 0;
+  floatswitch_degraded = 0;
+  last_switches = 0;
+  degraded_run_seconds = 0;
+  degraded_rest_seconds = 0;
+}
+
+char floatswitch_read(void)
+{
+  unsigned char snapshot[FLOATSWITCH_GROUP_COUNT];
+  char switches = 0;
+  int i;
+
+  // Grab all the ports back to back first, then sort out the bits
+  for(i = 0; i < FLOATSWITCH_GROUP_COUNT; ++i)
+    snapshot[i] = *floatswitch_groups[i].in;
+
+  for(i = 0; i < FLOATSWITCH_GROUP_COUNT; ++i)
+  {
+    unsigned char bits = snapshot[i] & floatswitch_groups[i].pins;
+    if(floatswitch_groups[i].shift >= 0)
+      switches |= bits >> floatswitch_groups[i].shift;
+    else
+      switches |= bits << -floatswitch_groups[i].shift;
+  }
+  return switches;
+}
+
+void floatswitch_tick(char switches, char pumping)
+{
+  char changed = switches ^ last_switches;
+  bool valid = get_water_level(switches) >= 0;
+  char clean;
+  int i;
+
+  for(i = 0; i < FLOATSWITCH_COUNT; ++i)
+  {
+    char bit = 1 << i;
+
+    if(changed & bit)
+    {
+      floatswitch_transitions[i]++;
+      pumping_seconds[i] = 0;
+
+      // It moved and agrees with its neighbours, so it's working
+      if(valid)
+      {
+        floatswitch_contradictions[i] = 0;
+        floatswitch_suspect_high &= ~bit;
+        floatswitch_suspect_low &= ~bit;
+      }
+    }
+    else if((switches & bit) && pumping)
+    {
+      // Water should be going down while we pump
+      if(pumping_seconds[i] < FLOAT_STUCK_SECONDS)
+        pumping_seconds[i]++;
+      else
+        floatswitch_suspect_high |= bit;
+    }
+  }
+
+  if(!valid)
+    blame_switches(switches);
+  last_switches = switches;
+
+  // Leave out switches stuck on, and count switches stuck off as on if a
+  // good switch above them is on
+  clean = switches & ~floatswitch_suspect_high;
+  for(i = FLOATSWITCH_COUNT - 1; i >= 0; --i)
+  {
+    char bit = 1 << i;
+    if((floatswitch_suspect_low & bit) && (clean & ~((bit << 1) - 1)))
+      clean |= bit;
+  }
+  floatswitch_level = get_water_level(clean);
+  floatswitch_degraded = !valid || floatswitch_suspect_high || floatswitch_suspect_low;
+
+  // Degraded mode: we can't fully trust the level, so don't let the pump run
+  // the battery flat. Run for a while, then rest.
+  if(!floatswitch_degraded)
+  {
+    degraded_run_seconds = 0;
+    degraded_rest_seconds = 0;
+  }
+  else if(degraded_rest_seconds)
+    degraded_rest_seconds--;
+  else if(pumping && ++degraded_run_seconds >= FLOAT_DEGRADED_MAX_RUN)
+  {
+    degraded_run_seconds = 0;
+    degraded_rest_seconds = FLOAT_DEGRADED_REST;
+  }
+}
+
+int floatswitch_wants_pump(void)
+{
+  // A reading that still doesn't make sense counts as water (safe side), the
+  // rest period keeps that from draining the battery
+  return floatswitch_level != 0 && degraded_rest_seconds == 0;
+}
+
+void blame_switches(char switches)
+{
+  int bottom = 0; // number of active switches in a row from the bottom
+  int top = 0; // one past the highest active switch
+  int active_above = 0; // active switches above the bottom run
+  int gaps = 0; // inactive switches between the bottom run and the top
+  int i;
+
+  while(bottom < FLOATSWITCH_COUNT && ((switches >> bottom) & 1))
+    bottom++;
+  for(i = bottom; i < FLOATSWITCH_COUNT; ++i)
+  {
+    if((switches >> i) & 1)
+    {
+      active_above++;
+      top = i + 1;
+    }
+  }
+  gaps = top - bottom - active_above;
+
+  // If more switches are on above the gap than off in it, the ones in the gap
+  // are probably stuck off. Otherwise the ones above are probably stuck on.
+  for(i = bottom; i < top; ++i)
+  {
+    char bit = 1 << i;
+    bool active = switches & bit;
+    if(active == (active_above > gaps))
+      continue;
+
+    if(floatswitch_contradictions[i] < FLOAT_CONTRADICTION_LIMIT)
+      floatswitch_contradictions[i]++;
+    else if(active)
+      floatswitch_suspect_high |= bit;
+    else
+      floatswitch_suspect_low |= bit;
+  }
+}
+
+
+/**
+ * A floatswitch reading is valid if no active switch is higher than an
+ * inactive switch, i.e. the active switches are a solid run from bit 0 up.
+ * Adding 1 to such a run carries all the way through it, so p & (p + 1) is
+ * zero exactly for the valid patterns, and the level is the number of bits set.
+ */
+#define FS_BITS(p) ((p) & ((1 << FLOATSWITCH_COUNT) - 1))
+#define FS_COUNT(p) (((p) & 1) + (((p) >> 1) & 1) + (((p) >> 2) & 1) + \
+                     (((p) >> 3) & 1) + (((p) >> 4) & 1) + (((p) >> 5) & 1))
+#define FS_LEVEL(p) ((FS_BITS(p) & (FS_BITS(p) + 1)) ? WATER_LEVEL_INVALID : FS_COUNT(FS_BITS(p)))
+#define FS_LEVEL4(p) FS_LEVEL(p), FS_LEVEL((p) + 1), FS_LEVEL((p) + 2), FS_LEVEL((p) + 3)
+#define FS_LEVEL16(p) FS_LEVEL4(p), FS_LEVEL4((p) + 4), FS_LEVEL4((p) + 8), FS_LEVEL4((p) + 12)
+
+const signed char water_level_table[WATER_LEVEL_TABLE_SIZE] = {
+  FS_LEVEL16(0), FS_LEVEL16(16), FS_LEVEL16(32), FS_LEVEL16(48)
+};
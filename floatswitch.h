@@ -0,0 +1,70 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * floatswitch.h
+ *
+ * Float switch health tracking. Every reading is checked against the one
+ * before it: switches that never let go while pumping are suspected of
+ * being stuck on, and impossible patterns are blamed on whichever switches
+ * make the least sense. Suspect switches are left out of the water level,
+ * and the pump is duty limited until they behave again.
+ */
+
+#ifndef FLOATSWITCH_H_
+#define FLOATSWITCH_H_
+
+// Bit masks (bit 0 = lowest switch) of switches we don't trust
+extern volatile char floatswitch_suspect_high; // stuck on
+extern volatile char floatswitch_suspect_low;  // stuck off
+
+// Water level after leaving out suspect switches (-1 if it still makes no sense)
+extern volatile int floatswitch_level;
+
+// 1 if any switch is suspect or the reading is bad
+extern volatile char floatswitch_degraded;
+
+// Statistics per switch
+extern volatile unsigned int floatswitch_transitions[FLOATSWITCH_COUNT];
+extern volatile unsigned char floatswitch_contradictions[FLOATSWITCH_COUNT];
+
+// One run of switches on a port (see FLOATSWITCH_GROUPS in definitions.h)
+struct FloatswitchGroup {
+  const volatile unsigned char *in;
+  volatile unsigned char *out;
+  volatile unsigned char *dir;
+  volatile unsigned char *ren;
+  unsigned char pins;
+  signed char shift; // right shift from pin bits to logical bits (negative -> left)
+};
+
+// Set up the switch pins (inputs, pulled up) and reset all statistics
+void floatswitch_initialize(void);
+
+// Reads every switch port once and returns the logical switch bits
+// (bit 0 = lowest switch, 1 = active). Call with interrupts off so all the
+// ports come from the same instant.
+char floatswitch_read(void);
+
+// Called once a second with the switch bits and whether the pump is running
+void floatswitch_tick(char switches, char pumping);
+
+// Returns 1 if there is water to pump (and degraded mode isn't resting the pump)
+int floatswitch_wants_pump(void);
+
+#if FLOATSWITCH_COUNT > 6
+#error "water_level_table only covers 6 float switches"
+#endif
+
+// Water level for every switch pattern (bit 0 = lowest switch), built by the
+// preprocessor from FLOATSWITCH_COUNT. A pattern is valid if no active switch
+// is higher than an inactive one; bits above FLOATSWITCH_COUNT are ignored.
+#define WATER_LEVEL_TABLE_SIZE 64
+#define WATER_LEVEL_INVALID -1
+extern const signed char water_level_table[WATER_LEVEL_TABLE_SIZE];
+
+// Returns the water level, or WATER_LEVEL_INVALID if the reading makes no sense.
+// (a masked table lookup, ~6 cycles; the old bit loop was ~80 for 5 switches)
+#define get_water_level(switches) (water_level_table[(switches) & (WATER_LEVEL_TABLE_SIZE - 1)])
+
+#endif /* FLOATSWITCH_H_ */
@@ -0,0 +1,106 @@
+#include "inbox.h"
+#include "rtc.h"
+#include "stack.h"
+#include <string.h>
+
+/*
+ * inbox.c
+ */
+
+volatile char inbox_actions;
+char inbox_phone[MAX_PHONE_LENGTH];
+unsigned int inbox_delete[INBOX_MAX_DELETE];
+volatile char inbox_delete_count;
+volatile char inbox_overflow;
+
+// Message we're in the middle of
+volatile char inbox_in_message; // 1 after a +CMGL header, until the next one
+char inbox_sender[MAX_PHONE_LENGTH];
+
+void inbox_reset(void)
+{
+  inbox_delete_count = 0;
+  inbox_overflow = 0;
+  inbox_in_message = 0;
+  memset(inbox_sender, '\0', MAX_PHONE_LENGTH);
+}
+
+void inbox_parse_line(char *line)
+{
+  STACK_MARK(StackInbox);
+
+  // +CMGL: <index>,"<status>","<origin number>","<??>","<timestamp>"
+  // text contents here
+  if(strncmp(line, "+CMGL: ", 7) == 0)
+  {
+    unsigned int index = 0;
+    char *begin_ptr_phone;
+    char *end_ptr_phone;
+    char *stamp_ptr;
+    char *next_ptr;
+
+    inbox_in_message = 0;
+
+    // Index
+    line += 7;
+    if(*line < '0' || *line > '9')
+      return;
+    while(*line >= '0' && *line <= '9')
+      index = index * 10 + (*line++ - '0');
+
+    // Remember it so it gets deleted
+    if(inbox_delete_count >= INBOX_MAX_DELETE)
+    {
+      inbox_overflow = 1; // leave it for the next listing
+      return;
+    }
+    inbox_delete[inbox_delete_count++] = index;
+    inbox_in_message = 1;
+
+    // Number is the 2nd quoted field: skip ,"<status>" then find ,"
+    memset(inbox_sender, '\0', MAX_PHONE_LENGTH);
+    begin_ptr_phone = strstr(line, "\",\"");
+    if(!begin_ptr_phone)
+      return;
+    begin_ptr_phone += 3; // Move to the beginning of the number
+
+    // find the ending quotation mark
+    end_ptr_phone = strchr(begin_ptr_phone, '"');
+    if(!end_ptr_phone || end_ptr_phone - begin_ptr_phone >= MAX_PHONE_LENGTH)
+      return;
+    strncpy(inbox_sender, begin_ptr_phone, end_ptr_phone - begin_ptr_phone);
+
+    // Timestamp is the last quoted field, good enough for the clock until
+    // the network gives us the time
+    stamp_ptr = 0;
+    next_ptr = end_ptr_phone;
+    while((next_ptr = strstr(next_ptr + 1, ",\"")) != 0)
+      stamp_ptr = next_ptr + 2;
+    if(stamp_ptr)
+      rtc_set_from_modem(stamp_ptr, RtcSourceText);
+    return;
+  }
+
+  // Text of a message (texts can span more than one line)
+  if(!inbox_in_message)
+    return;
+
+  // Check for the "password"
+  if(strstr(line, "978SolMate") && inbox_sender[0] != '\0')
+  {
+    inbox_actions |= InboxActionPhone;
+    strncpy(inbox_phone, inbox_sender, MAX_PHONE_LENGTH);
+  }
+  // Status report?
+  if(strstr(line, "What's up"))
+    inbox_actions |= InboxActionStatus;
+  // Diagnostics report?
+  if(strstr(line, "Diag"))
+    inbox_actions |= InboxActionDiag;
+  // Telemetry frame?
+  if(strstr(line, "Data"))
+    inbox_actions |= InboxActionTelemetry;
+  // Log upload?
+  if(strstr(line, "Upload"))
+    inbox_actions |= InboxActionUpload;
+}
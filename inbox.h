@@ -0,0 +1,44 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * inbox.h
+ *
+ * Works through the SIM inbox in one AT+CMGL="ALL" listing. Lines are fed in
+ * as they stream off the uart; every command found is noted down (several
+ * status requests turn into one reply) along with the index of each message
+ * so only messages we have actually seen get deleted.
+ */
+
+#ifndef INBOX_H_
+#define INBOX_H_
+
+#define INBOX_MAX_DELETE 16 // messages handled per listing (the rest wait for the next one)
+
+// Things the texts asked for
+enum InboxAction {
+  InboxActionPhone = 0x1, // "978SolMate": make the sender the phone number
+  InboxActionStatus = 0x2, // "What's up"
+  InboxActionDiag = 0x4, // "Diag"
+  InboxActionTelemetry = 0x8, // "Data": binary telemetry frame (PDU mode)
+  InboxActionPhoneAck = 0x10, // number is saved, tell them so
+  InboxActionUpload = 0x20 // "Upload": send the log over GPRS
+};
+extern volatile char inbox_actions; // kept across listings until they're done
+
+// Sender of the last password text
+extern char inbox_phone[MAX_PHONE_LENGTH];
+
+// SIM indexes of the messages in this listing
+extern unsigned int inbox_delete[INBOX_MAX_DELETE];
+extern volatile char inbox_delete_count;
+extern volatile char inbox_overflow; // more messages than INBOX_MAX_DELETE, list again afterwards
+
+// Forget the last listing (actions not done yet are kept, listing the same
+// texts again just asks for the same things)
+void inbox_reset(void);
+
+// Handle one line of the AT+CMGL response (without the \r\n)
+void inbox_parse_line(char *line);
+
+#endif /* INBOX_H_ */
@@ -57,13 +57,20 @@ MEMORY
     PERIPHERALS_8BIT        : origin = 0x0010, length = 0x00F0
     PERIPHERALS_16BIT       : origin = 0x0100, length = 0x0100
     RAM                     : origin = 0x2400, length = 0x2000
-    USBRAM                  : origin = 0x1C00, length = 0x0800
+    USBBUF                  : origin = 0x1C00, length = 0x0100 /* usb endpoint buffers (USB API, START_OF_USB_BUFFER) */
+    USBRAM                  : origin = 0x1D00, length = 0x0620 /* rest of it up to the endpoint descriptors, service.c buffers */
     INFOA                   : origin = 0x1980, length = 0x0080
     INFOB                   : origin = 0x1900, length = 0x0080
     INFOC                   : origin = 0x1880, length = 0x0080
     INFOD                   : origin = 0x1800, length = 0x0080
-    FLASH                   : origin = 0x4400, length = 0xBB80
-    FLASH2                  : origin = 0x10000,length = 0x14400
+    BOOT                    : origin = 0x4400, length = 0x0600 /* boot.c installer, never updated */
+    FLASH                   : origin = 0x4A00, length = 0x7600
+    LOGBANK                 : origin = 0xC000, length = 0x3C00 /* datalog.c, kept out of the code space */
+    TRACEBANK               : origin = 0xFC00, length = 0x0200 /* trace.c, one segment */
+    FLASH2                  : origin = 0x10000,length = 0x6200
+    STAGING                 : origin = 0x16200,length = 0xDA00 /* update.c, next image (boot.h layout) */
+    SCRATCH                 : origin = 0x23C00,length = 0x0200 /* boot.c, one segment */
+    JOURNAL                 : origin = 0x23E00,length = 0x0400 /* boot.c/update.c, two segments */
     INT00                   : origin = 0xFF80, length = 0x0002
     INT01                   : origin = 0xFF82, length = 0x0002
     INT02                   : origin = 0xFF84, length = 0x0002
@@ -136,11 +143,14 @@ MEMORY
 
 SECTIONS
 {
-    .bss        : {} > RAM                  /* Global & static vars              */
-    .data       : {} > RAM                  /* Global & static vars              */
-    .TI.noinit  : {} > RAM                  /* For #pragma noinit                */
-    .sysmem     : {} > RAM                  /* Dynamic memory allocation area    */
-    .stack      : {} > RAM (HIGH)           /* Software system stack             */
+    /* start/end symbols are for stack.c (what's left between them is stack) */
+    .bss        : {} > RAM, RUN_START(bss_start), RUN_END(bss_end)         /* Global & static vars */
+    .data       : {} > RAM, RUN_START(data_start), RUN_END(data_end)       /* Global & static vars */
+    .TI.noinit  : {} > RAM, RUN_START(noinit_start), RUN_END(noinit_end)   /* For #pragma noinit   */
+    .sysmem     : {} > RAM, RUN_START(sysmem_start), RUN_END(sysmem_end)   /* Dynamic memory allocation area */
+    .stack      : {} > RAM (HIGH), RUN_END(stack_end)                      /* Software system stack */
+    .usbram     : {} > USBRAM               /* #pragma DATA_SECTION buffers      */
+    .bootloader : {} > BOOT                 /* boot.c, #pragma CODE_SECTION      */
 
 #ifndef __LARGE_DATA_MODEL__
     .text       : {}>> FLASH                /* Code                              */
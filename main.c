@@ -4,7 +4,24 @@
 #include "adc.h"
 #include "flash.h"
 #include "rtc.h"
-#include <stdbool.h>
+#include "pump.h"
+#include "power.h"
+#include "floatswitch.h"
+#include "inbox.h"
+#include "pdu.h"
+#include "telemetry.h"
+#include "stats.h"
+#include "network.h"
+#include "datalog.h"
+#include "service.h"
+#include "warm.h"
+#include "profile.h"
+#include "trace.h"
+#include "stack.h"
+#include "bench.h"
+#include "charge.h"
+#include "text.h"
+#include "update.h"
 #include <string.h>
 
 /*
@@ -21,19 +38,89 @@ volatile char battery_can_drain; // 0 -> need to wait for bat to charge to use p
                                   // 1 -> can pump until battery reaches its lower threshold
 
 // Keep track of time
-volatile char tryagain_timeelapsed; // counts units of time (we can specify how long the units are)
 volatile unsigned long last_sent_warningtext; // the time when we last sent out a warning text message
 
 // Toggles power for the GSM module.
 void toggle_gsm_power(void);
 
-// Returns an int representing the water level, so long as the floatswitch
-// reading is valid.
-int get_water_level(char switches, int number_of_switches);
+// Asks the modem to switch to uart_bauds[uart_baud_best] (AT+IPR)
+void request_baud_change(void);
 
+// Sends AT+CMGF=1 (last step of bringing up the modem)
+void request_sms_mode(void);
+
+// Sends AT+CMGL="ALL" to go through every message on the SIM at once
+void request_inbox_list(void);
+
+// Next thing to do for the inbox listing (replies, then deleting what we
+// read), goes idle when there's nothing left
+void inbox_next(void);
+
+// Asks the modem for the time (AT+CCLK?), lists the inbox afterwards
+void request_clock_read(void);
+
+// Sends AT+CMGS to phone_number, state is the Prepare*SMS state to go to
+void request_sms(char state);
+
+// Sends AT+CMGF=1 to go back to text mode after a PDU text
+void request_text_mode(void);
+
+// A text didn't go out, try again from state (a Prepare*SMS state) later
+void sms_failed(char state);
+
+// Sends AT+CSQ
+void request_signal_check(void);
+
+
+// Which report CommandStatePrepareStatusSMS puts together
+enum ReportType {
+  ReportStatus, // "What's up"
+  ReportDiagnostics, // "Diag"
+  ReportDigest // once a day at DIGEST_TIME
+};
+volatile char report_type;
+volatile char digest_pending; // digest time came, waiting for the modem
+volatile unsigned long digest_time; // seconds into the day it goes out (service port can move it)
+
+// Puts the status text ("What's up": battery, charge, water, pump) into tx_buffer
+void build_status_report(void);
+
+// Puts the daily digest (stats_day) into tx_buffer
+void build_digest_report(void);
+
+// Puts the diagnostics text (counters etc.) into tx_buffer
+void build_diagnostics_report(void);
+
+// Telemetry text being sent (built once so the length given to AT+CMGS matches)
+unsigned char telemetry_frame[TELEMETRY_FRAME_SIZE];
+unsigned char telemetry_length;
+
+// Log upload over GPRS
+volatile char upload_pending; // asked for (or enough records piled up)
+volatile unsigned int upload_retry_wait; // seconds before trying again after a failed session
+volatile char upload_failed; // something in this session went wrong
+const char *upload_data; // batch being sent (straight out of flash)
+unsigned int upload_count; // records in it
+#define UPLOAD_RETRY_WAIT 600
+
+// Starts a GPRS session (AT+CIPSHUT first to start clean)
+void request_upload(void);
+
+// Sends the next batch of records, or closes the connection when there's none left
+void upload_next_batch(void);
+
+// Shuts the connection (ok = 0 -> try again in UPLOAD_RETRY_WAIT)
+void upload_finish(char ok);
+
+// Asks the collector for the next window of a firmware patch, or closes the
+// connection when the session has had enough (see update.h)
+void update_next_window(void);
+
+// Sends a command during the GPRS session (state is what to go to): text
+// (TextId), then the configured part if there's one (GPRS_APN...)
+void gprs_command(char state, unsigned int text, const char *setting, char timeout);
 
 // Phone numba
-#define MAX_PHONE_LENGTH 16
 char phone_number[MAX_PHONE_LENGTH]; // like +14445556666
 
 int main(void)
@@ -41,31 +128,48 @@ int main(void)
   // Stop watchdog timer for now
   WDTCTL = WDTPW | WDTHOLD;
 
+  // Mark the free RAM so we can tell how deep the stack gets
+  stack_paint();
+
+  // Why we're here, and whether what was going on before still holds
+  warm_initialize();
+  trace_initialize(warm_state.reset_cause);
+
   // Enable JTAG (keep this line here)
   SYSCTL |= SYSJTAGPIN;
 
   // Initialize state variables
 //floatswitch_active = 0;
   floatswitches = 0;
+  floatswitch_initialize(); // also sets up the float switch pins
   battery_charge = 0;
   solarpanel_voltage = 0;
   pump_active = 0;
-  tryagain_timeelapsed = 0;
+  network_initialize();
+  upload_pending = 0;
+  upload_retry_wait = 0;
+  upload_failed = 0;
   last_sent_warningtext = 0;
+  report_type = ReportStatus;
+  digest_pending = 0;
+  digest_time = DIGEST_TIME;
+  stats_initialize();
 
   // Read in the saved phone number from memory, if it is there
   memset(phone_number, '\0', MAX_PHONE_LENGTH);
   if(strncmp(PHONE_ADDRESS, "+1", 2) == 0) // Phone numbers start with +1
     strncpy(phone_number, PHONE_ADDRESS, MAX_PHONE_LENGTH); // copy from flash into ram
 
-  // Set up float switches
-  FLOAT_PORT_DIR &= ~(FLOATSWITCH_0 | FLOATSWITCH_1 | FLOATSWITCH_2 | FLOATSWITCH_3 | FLOATSWITCH_4);
-  FLOAT_PORT_REN |= FLOATSWITCH_0 | FLOATSWITCH_1 | FLOATSWITCH_2 | FLOATSWITCH_3 | FLOATSWITCH_4;
-  FLOAT_PORT_OUT |= FLOATSWITCH_0 | FLOATSWITCH_1 | FLOATSWITCH_2 | FLOATSWITCH_3 | FLOATSWITCH_4;
+  // Start up Timer A1 free running off the aux clock (32.768 kHz)
+  // CCR0 -> pump pwm, CCR1 -> gsm power button pulse, CCR2 -> panel pwm
+  TA1CTL = TACLR;
+  TA1CTL = TASSEL__ACLK | MC__CONTINUOUS;
 
   // Set up water pump and solarpanel on/off
-  PUMPSOLAR_PORT_DIR |= PUMP_CONTROL | SOLARPANEL_CONTROL;
-  PUMPSOLAR_PORT_OUT &= ~(PUMP_CONTROL | SOLARPANEL_CONTROL);
+  pump_initialize();
+  power_initialize();
+  charge_initialize();
+  datalog_initialize(); // finds where the log left off
 
   // Set up msp430 LEDs
   LED_PORT_DIR |= (LED_MSP | LED_MSP_2);
@@ -92,9 +196,17 @@ int main(void)
   // Initialize the uart and ADC, start ADC conversion
   uart_initialize();
   adc_initialize();
+  service_initialize(); // USB service port, comes up when a cable is plugged in
+  profile_initialize(); // nothing unless ISR_PROFILING
+  bench_run(); // nothing unless BENCHMARK
+
+  // Pick up where we were before a reset (rate limiter, pump lockout, modem speed...)
+  warm_restore();
+  update_initialize(); // after the installer: on trial, rolled back...
 
-  // Wait a bit
-  __delay_cycles(1048576); // 1 second
+  // Wait a bit (not needed if everything kept running)
+  if(!warm_restored)
+    __delay_cycles(1048576); // 1 second
 
   // Enable watchdog interrupts and interrupts in general
   SFRIE1 |= WDTIE;
@@ -106,16 +218,31 @@ int main(void)
   // Check if GSM module is on
   while(!(GSM_PORT_IN & GSM_POWER_STATUS)) // is off
   {
+    warm_modem_ready = 0; // starting from scratch
     toggle_gsm_power();
     __delay_cycles(20000000); // wait
   }
 
-  // Send an AT first
-	LED_PORT_OUT |= LED_MSP;
+  if(warm_modem_ready)
+  {
+    // Modem kept its setup through the reset, just see where registration
+    // is at (the full bring-up starts over if it doesn't answer)
+    uart_command_state = CommandStateCheckRegistration;
+    tx_buffer_reset();
+    text_copy(TextAtRegistration);
+    uart_send_command();
+    uart_set_timeout(UART_PROBE_TIMEOUT);
+  }
+  else
+  {
+    // Send an AT first
+    LED_PORT_OUT |= LED_MSP;
 
-	tx_buffer_reset();
-  strcpy(tx_buffer, "AT\r\n");
-  uart_send_command();
+    tx_buffer_reset();
+    text_copy(TextAt);
+    uart_send_command();
+    uart_set_timeout(UART_PROBE_TIMEOUT); // modem might be at another speed
+  }
 
   // Start up Timer A0
   TA0CTL = TACLR; // clear first
@@ -124,8 +251,9 @@ int main(void)
   TA0CCR0 = 4096; // reduces rate to 1 times/sec
   TA0CTL |= MC__UP; // start the timer in up mode (counts to TA0CCR0 then resets to 0)
 
-  // start the clock
+  // start the clock, digest goes off it
   rtc_initialize();
+  rtc_set_alarm(digest_time);
 
   // Turn CPU off
   LPM0;
@@ -133,9 +261,27 @@ int main(void)
   // Main loop
   while(1)
   {
+    STACK_MARK(StackMain);
+
+    // Go through the inbox listing (or a window of patch) a line at a time as it comes in
+    if(uart_command_state == CommandStateListSMS)
+    {
+      char *line;
+      while((line = uart_read_line()) != 0)
+        inbox_parse_line(line);
+    }
+    else if(uart_command_state == CommandStateGprsUpdateReceive)
+    {
+      char *line;
+      while((line = uart_read_line()) != 0)
+        update_parse_line(line);
+    }
+
     // Check if a UART command has finished and respond accordingly
     if(uart_command_has_completed)
     {
+      uart_command_has_completed = 0; // handled (states that do nothing just wait for the next command)
+
       switch(uart_command_state)
       {
       case CommandStateSendingAT:
@@ -145,21 +291,87 @@ int main(void)
           // Send ATE0 because we do not need a copy of what we send
             uart_command_state = CommandStateTurnOffEcho;
             tx_buffer_reset();
-            strcpy(tx_buffer, "ATE0\r\n");
+            text_copy(TextAtEchoOff);
             uart_send_command();
         }
+        else
+        {
+          // No answer, the modem may still be at a speed we set before a reset.
+          // Try the next one.
+          uart_set_baud((uart_baud_index + 1) % UART_BAUD_COUNT);
+          tx_buffer_reset();
+          text_copy(TextAt);
+          uart_send_command();
+          uart_set_timeout(UART_PROBE_TIMEOUT);
+        }
         break;
       }
       case CommandStateTurnOffEcho: // Got a response after sending AT
       {
         if(uart_command_result == UartResultOK)
         {
-          // Send cmgf
-          // This puts the cell module into SMS mode, as opposed to data mode
-          uart_command_state = CommandStateGoToSMSMode;
+          if(uart_baud_index != uart_baud_best)
+            request_baud_change(); // go as fast as the modem lets us first
+          else
+            request_sms_mode();
+        }
+        break;
+      }
+
+      case CommandStateSetBaud: // Got a response after sending AT+IPR
+      {
+        if(uart_command_result == UartResultOK)
+        {
+          // Modem has switched, follow it and make sure we can still talk
+          uart_set_baud(uart_baud_best);
+          uart_baud_errors = 0;
+          uart_command_state = CommandStateCheckBaud;
           tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGF=1\r\n");
+          text_copy(TextAt);
           uart_send_command();
+          uart_set_timeout(UART_PROBE_TIMEOUT);
+        }
+        else if(uart_command_result == UartResultError)
+        {
+          // Modem doesn't do that speed, try the next slower one
+          if(++uart_baud_best >= UART_BAUD_COUNT)
+            uart_baud_best = uart_baud_index;
+
+          if(uart_baud_index != uart_baud_best)
+            request_baud_change();
+          else
+            request_sms_mode();
+        }
+        else
+        {
+          // Lost track of the modem's speed, find it again
+          uart_command_state = CommandStateSendingAT;
+          tx_buffer_reset();
+          text_copy(TextAt);
+          uart_send_command();
+          uart_set_timeout(UART_PROBE_TIMEOUT);
+        }
+        break;
+      }
+
+      case CommandStateCheckBaud: // Got a response after sending AT at the new speed
+      {
+        if(uart_command_result == UartResultOK && uart_baud_errors == 0)
+        {
+          // This speed works, keep it
+          request_sms_mode();
+        }
+        else
+        {
+          // Not reliable at this speed. Never go this fast again, find the modem
+          // and step down from there.
+          if(uart_baud_index < UART_BAUD_COUNT - 1)
+            uart_baud_best = uart_baud_index + 1;
+          uart_command_state = CommandStateSendingAT;
+          tx_buffer_reset();
+          text_copy(TextAt);
+          uart_send_command();
+          uart_set_timeout(UART_PROBE_TIMEOUT);
         }
         break;
       }
@@ -170,9 +382,94 @@ int main(void)
         {
           LED_PORT_OUT &= ~(LED_MSP | LED_MSP_2); // leds off
 
-          // We are now ready to send a text whenever the system needs to
+          // Have the modem tell us when registration changes
+          uart_command_state = CommandStateEnableRegistration;
+          tx_buffer_reset();
+          text_copy(TextAtRegistrationReports);
+          uart_send_command();
+        }
+        else
           uart_enter_idle_mode();
+        break;
+      }
+
+      case CommandStateEnableRegistration: // Got a response after sending AT+CREG=1
+      {
+        // Have the modem clock follow the network (NITZ)
+        uart_command_state = CommandStateEnableClock;
+        tx_buffer_reset();
+        text_copy(TextAtNetworkTime);
+        uart_send_command();
+        break;
+      }
+
+      case CommandStateEnableClock: // Got a response after sending AT+CLTS=1 (not every modem has it)
+      {
+        // Ask where registration is at now (the uart picks up the +CREG line)
+        uart_command_state = CommandStateCheckRegistration;
+        tx_buffer_reset();
+        text_copy(TextAtRegistration);
+        uart_send_command();
+        break;
+      }
+
+      case CommandStateCheckRegistration: // Got a response after sending AT+CREG?
+      {
+        if(uart_command_result != UartResultOK && warm_modem_ready)
+        {
+          // Skipped the setup after a reset but the modem isn't answering
+          // (lost power too?), start over
+          warm_modem_ready = 0;
+          uart_command_state = CommandStateSendingAT;
+          tx_buffer_reset();
+          text_copy(TextAt);
+          uart_send_command();
+          uart_set_timeout(UART_PROBE_TIMEOUT);
+          break;
+        }
+
+        // Set up and ready to go
+        warm_modem_ready = 1;
+        warm_operational();
+        request_clock_read();
+        break;
+      }
+
+      case CommandStateReadClock: // Got a response after sending AT+CCLK?
+      {
+        // +CCLK: "yy/MM/dd,hh:mm:ss+zz"
+        char *clock_ptr = strstr(rx_buffer, "+CCLK: \"");
+
+        if(uart_command_result == UartResultOK && clock_ptr)
+          rtc_set_from_modem(clock_ptr + 8, RtcSourceNetwork);
+
+        // Catch up on texts that came in while we were off (or busy), then
+        // we're ready to send a text whenever the system needs to
+        request_inbox_list();
+        break;
+      }
+
+      case CommandStateCheckSignal: // Got a response after sending AT+CSQ
+      {
+        // +CSQ: <rssi>,<ber>
+        char *rssi_ptr = strstr(rx_buffer, "+CSQ: ");
+        unsigned char rssi = 0;
+
+        if(uart_command_result == UartResultOK && rssi_ptr)
+        {
+          rssi_ptr += 6;
+          while(*rssi_ptr >= '0' && *rssi_ptr <= '9')
+            rssi = rssi * 10 + (*rssi_ptr++ - '0');
+          network_signal_update(rssi);
         }
+        else
+          network_signal_update(NETWORK_RSSI_UNKNOWN);
+
+        // Check the clock while we're at it (once a day, hourly until the
+        // network gives us the time). Anything that was waiting on coverage
+        // gets picked up by the main loop/timer.
+        if(rtc_sync_due())
+          request_clock_read();
         else
           uart_enter_idle_mode();
         break;
@@ -185,9 +482,12 @@ int main(void)
           // Send the text now
           uart_command_state = CommandStateSendWarningSMS;
           tx_buffer_reset();
-          strcpy(tx_buffer, "Msg from Sol-Mate: Check your boat; water level is getting high.\r\n\x1A");
+          text_copy(TextWaterWarning);
           uart_send_command();
+          uart_set_timeout(NETWORK_SEND_TIMEOUT);
         }
+        else
+          sms_failed(CommandStatePrepareWarningSMS);
         break;
       }
 
@@ -197,36 +497,13 @@ int main(void)
         {
           LED_PORT_OUT &= ~LED_MSP; // red LED off
           sent_text = 1; // Do not send the text again (this is for testing purposes--to send another text you have to restart the MSP)
+          network_sent(1, 0);
 
-          // Delete all stored messages.
-          uart_command_state = CommandStateDeleteSMS;
-          tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGD=1,4\r\n");
-          uart_send_command();
-        }
-        else if(uart_command_result == UartResultError) // sms failed to send
-        {
-          LED_PORT_OUT |= LED_MSP;
-
-          // Set up timer to try again
-          TA2CTL = TACLR;
-          TA2CTL = TASSEL__ACLK | ID__8 | MC__STOP;
-          TA2CCTL0 = CCIE;
-          TA2CCR0 = TIMEOUT_SMS;
-
-          // Prepare again
-          uart_command_state = CommandStatePrepareWarningSMS;
-          tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGS=\"");
-          strcat(tx_buffer, phone_number);
-          strcat(tx_buffer, "\"\r\n");
-
-          // Enable timer, go to sleep (uart will be disabled too because LPM2)
-          TA2CTL |= MC__UP;
-          LPM2;
+          // Pick up anything that came in while sending
+          inbox_next();
         }
-        else
-          uart_enter_idle_mode();
+        else // sms failed to send (or the modem never answered)
+          sms_failed(CommandStatePrepareWarningSMS);
 
         break;
       }
@@ -240,31 +517,10 @@ int main(void)
         // +CMTI: "SM",3\r\n
         if(strstr(rx_buffer, "+CMTI")) // strstr returns null/0 if not found
         {
-          // Find the comma
-          char *begin_ptr = strchr(rx_buffer, ',');
-          if(!begin_ptr) {
-            uart_enter_idle_mode();
-            break;
-          }
-          begin_ptr++; // should point to the beginning of the SMS index we need
-
-          // Find the '\r' which is directly following the last character of the SMS index
-          char *end_ptr = strchr(begin_ptr, '\r');
-          if(!end_ptr) {
-            uart_enter_idle_mode();
-            break;
-          }
-
-          // Create the command to read the sms
-          tx_buffer_reset();
-          strcat(tx_buffer, "AT+CMGR=");
-          strncat(tx_buffer, begin_ptr, end_ptr - begin_ptr); // SMS index
-          strcat(tx_buffer, "\r\n");
-
-          // Send the command
-          LED_PORT_OUT &= ~LED_MSP; // red LED on
-          uart_command_state = CommandStateReadSMS;
-          uart_send_command();
+          // Read everything that's waiting (not just this one), texts that
+          // show up in the meantime get picked up after
+          LED_PORT_OUT &= ~LED_MSP;
+          request_inbox_list();
         }
         else // unrecognized
         {
@@ -275,98 +531,16 @@ int main(void)
         break;
       }
 
-      case CommandStateReadSMS:
+      case CommandStateListSMS: // AT+CMGL is done, all the lines have been parsed
       {
-        LED_PORT_OUT |= LED_MSP; // red LED on
-        if(uart_command_result == UartResultOK)
-        {
-          // +CMGR: "<status>","<origin number>","<??>","<timestamp>"\r\n
-          // text contents here\r\n
-          // \r\n
-          // OK\r\n
-
-          // find the 1st comma
-          char *begin_ptr_phone = strchr(rx_buffer, ',');
-          if(!begin_ptr_phone || *(begin_ptr_phone+1) != '"') {
-            uart_enter_idle_mode();
-            break;
-          }
-          begin_ptr_phone += 2; // Move to the beginning of the number
-
-          // find the ending quotation mark
-          char *end_ptr_phone = strchr(begin_ptr_phone, '"');
-          if(!end_ptr_phone) {
-            uart_enter_idle_mode();
-            break;
-          }
-
-          // Check if it's too long
-          if(end_ptr_phone - begin_ptr_phone > MAX_PHONE_LENGTH) {
-            uart_enter_idle_mode();
-            break;
-          }
-
-          // Look at the contents of the text - it starts right after the first \r\n
-          char *begin_ptr_sms = strchr(rx_buffer, '\n');
-          if(!begin_ptr_sms) {
-            uart_enter_idle_mode();
-            break;
-          }
-          begin_ptr_sms++; // Move to the beginning of the text
-
-          // The text ends right before the next \r\n
-          char *end_ptr_sms = strchr(begin_ptr_sms, '\r');
-          if(!end_ptr_sms) {
-            uart_enter_idle_mode();
-            break;
-          }
-
-          // Check for the "password"
-          if(strstr(begin_ptr_sms, "978SolMate"))
-          {
-            // copy the phone number into ram
-            memset(phone_number, '\0', MAX_PHONE_LENGTH);
-            strncpy(phone_number, begin_ptr_phone, end_ptr_phone - begin_ptr_phone);
-
-            // Now copy it into flash memory
-            flash_erase(PHONE_ADDRESS);
-            flash_write_phone_number(phone_number, MAX_PHONE_LENGTH);
-
-            // Send the user an acknowledgement
-            LED_PORT_OUT &= ~LED_MSP; // red LED off
-            uart_command_state = CommandStatePreparePhoneSMS;
-            tx_buffer_reset();
-            strcpy(tx_buffer, "AT+CMGS=\"");
-            strncat(tx_buffer, phone_number, MAX_PHONE_LENGTH);
-            strcat(tx_buffer, "\"\r\n");
-            uart_send_command();
-          }
-          // Status report?
-          else if(strstr(begin_ptr_sms, "What's up"))
-          {
-            // Send user the status report
-            LED_PORT_OUT &= ~LED_MSP;
-            uart_command_state = CommandStatePrepareStatusSMS;
-            tx_buffer_reset();
-            strcpy(tx_buffer, "AT+CMGS=\"");
-            strncat(tx_buffer, phone_number, MAX_PHONE_LENGTH);
-            strcat(tx_buffer, "\"\r\n");
-            uart_send_command();
-          }
-          else // Unrecognized text
-          {
-            LED_PORT_OUT &= ~LED_MSP;
+        uart_stream_stop();
+        if(uart_stream_lost) // part of the listing got dropped, go through it again after
+          inbox_overflow = 1;
 
-            // Delete all stored messages.
-            uart_command_state = CommandStateDeleteSMS;
-            tx_buffer_reset();
-            strcpy(tx_buffer, "AT+CMGD=1,4\r\n");
-            uart_send_command();
-          }
-        }
+        if(uart_command_result == UartResultOK)
+          inbox_next();
         else
           uart_enter_idle_mode();
-
         break;
       }
 
@@ -379,78 +553,41 @@ int main(void)
           // Send the text now
           uart_command_state = CommandStateSendPhoneSMS;
           tx_buffer_reset();
-          strcpy(tx_buffer, "Msg from Sol-Mate: Your phone number has been successfully changed.\r\n\x1A");
+          text_copy(TextPhoneChanged);
           uart_send_command();
+          uart_set_timeout(NETWORK_SEND_TIMEOUT);
         }
+        else
+          sms_failed(CommandStatePreparePhoneSMS);
         break;
       }
 
       case CommandStatePrepareStatusSMS:
       {
         LED_PORT_OUT |= LED_MSP; // red led
-        if(uart_command_result == UartResultInput)
+        if(uart_command_result == UartResultInput && report_type == ReportDiagnostics)
         {
-          // Put together the status text
           uart_command_state = CommandStateSendStatusSMS;
-          tx_buffer_reset();
-          strcpy(tx_buffer, "Msg from Sol-Mate: Here's your status report.\r\n");
-
-          // Battery status
-          if(battery_charge > 228) // 12.9V
-            strcat(tx_buffer, "Battery level: Full\r\n");
-          else if(battery_charge > 210) // About 50% - 12.55V
-            strcat(tx_buffer, "Battery level: Medium\r\n");
-          else if(battery_charge > 190) // 12.2V
-            strcat(tx_buffer, "Battery level: Low\r\n");
-          else
-            strcat(tx_buffer, "Battery level: Very Low\r\n");
-
-          // Solar panel charge
-          if(solarpanel_voltage > 186)
-            strcat(tx_buffer, "Charge rate: High\r\n");
-          else if(solarpanel_voltage > 113)
-            strcat(tx_buffer, "Charge rate: Medium\r\n");
-          else if(solarpanel_voltage > 39)
-            strcat(tx_buffer, "Charge rate: Low\r\n");
-          else
-            strcat(tx_buffer, "Charge rate: None\r\n");
-
-          // Water depth
-          int water_level = get_water_level(floatswitches, 5);
-          switch(water_level)
-          {
-            case 0: // No floatswitches are active.
-              strcat(tx_buffer, "Water level: None\r\n");
-              break;
-            case 1: // Lowest floatswitch is active.
-              strcat(tx_buffer, "Water level: Very low\r\n");
-              break;
-            case 2: // Two lowest floatswitches are active.
-              strcat(tx_buffer, "Water level: Low\r\n");
-              break;
-            case 3: // All three floatswitches are active.
-              strcat(tx_buffer, "Water level: Medium\r\n");
-              break;
-            case 4:
-              strcat(tx_buffer, "Water level: High\r\n");
-              break;
-            case 5:
-              strcat(tx_buffer, "Water level: Very high\r\n");
-              break;
-            default: // Any other combination.
-              strcat(tx_buffer, "Water level: ERR INVALID READING\r\n");
-              break;
-          }
-
-          // Bailer
-          if(pump_active)
-            strcat(tx_buffer, "Water pump: On");
-          else
-            strcat(tx_buffer, "Water pump: Off");
-
-          strcat(tx_buffer, "\r\n\x1A");
+          build_diagnostics_report();
           uart_send_command();
+          uart_set_timeout(NETWORK_SEND_TIMEOUT);
         }
+        else if(uart_command_result == UartResultInput && report_type == ReportDigest)
+        {
+          uart_command_state = CommandStateSendStatusSMS;
+          build_digest_report();
+          uart_send_command();
+          uart_set_timeout(NETWORK_SEND_TIMEOUT);
+        }
+        else if(uart_command_result == UartResultInput)
+        {
+          uart_command_state = CommandStateSendStatusSMS;
+          build_status_report();
+          uart_send_command();
+          uart_set_timeout(NETWORK_SEND_TIMEOUT);
+        }
+        else
+          sms_failed(CommandStatePrepareStatusSMS);
         break;
       }
 
@@ -458,84 +595,270 @@ int main(void)
       {
         if(uart_command_result == UartResultOK)
         {
-          // Delete all stored messages.
-          uart_command_state = CommandStateDeleteSMS;
+          network_sent(1, 0);
+          inbox_next(); // on to the next reply, or deleting
+        }
+        else // sms failed to send (or the modem never answered)
+          sms_failed(CommandStatePreparePhoneSMS);
+
+        break;
+      }
+      case CommandStateSendStatusSMS:
+      {
+        if(uart_command_result == UartResultOK)
+        {
+          network_sent(1, 0);
+          inbox_next(); // on to the next reply, or deleting
+        }
+        else // sms failed to send (or the modem never answered)
+          sms_failed(CommandStatePrepareStatusSMS);
+
+        break;
+      }
+
+      case CommandStateDeleteSMS:
+      {
+        inbox_next(); // next index (a failed delete just gets listed again next time)
+        break;
+      }
+
+      case CommandStateSetPDUMode: // Got a response after sending AT+CMGF=0
+      {
+        if(uart_command_result == UartResultOK)
+        {
+          int length;
+
+          // Build the PDU once to find out how long it is
+          telemetry_length = telemetry_build(telemetry_frame, battery_charge, solarpanel_voltage, floatswitches);
+          length = pdu_build(phone_number, PDU_DCS_8BIT, telemetry_frame, telemetry_length);
+
+          uart_command_state = CommandStatePrepareTelemetrySMS;
           tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGD=1,4\r\n");
+          text_copy(TextAtSendSmsLength);
+          tx_buffer_append_number(length);
+          text_append(TextNewline);
+          uart_send_command();
+        }
+        else
+          request_text_mode();
+        break;
+      }
+
+      case CommandStatePrepareTelemetrySMS:
+      {
+        if(uart_command_result == UartResultInput)
+        {
+          uart_command_state = CommandStateSendTelemetrySMS;
+          pdu_build(phone_number, PDU_DCS_8BIT, telemetry_frame, telemetry_length);
           uart_send_command();
+          uart_set_timeout(NETWORK_SEND_TIMEOUT);
         }
-        else if(uart_command_result == UartResultError) // sms failed to send
+        else
+          request_text_mode();
+        break;
+      }
+
+      case CommandStateSendTelemetrySMS:
+      {
+        // No retry for these, they get asked for again if they don't show up
+        network_send_attempts++;
+        if(uart_command_result != UartResultOK)
         {
           LED_PORT_OUT |= LED_MSP;
+          network_send_failures++;
+        }
+        request_text_mode();
+        break;
+      }
 
-          // Set up timer to try again
-          TA2CTL = TACLR;
-          TA2CTL = TASSEL__ACLK | ID__8 | MC__STOP;
-          TA2CCTL0 = CCIE;
-          TA2CCR0 = TIMEOUT_SMS; // 4096 times 10 -> 10 seconds
+      case CommandStateSetTextMode: // Back in text mode (the inbox listing needs it)
+      {
+        inbox_next();
+        break;
+      }
 
-          // Prepare again
-          uart_command_state = CommandStatePreparePhoneSMS;
-          tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGS=\"");
-          strcat(tx_buffer, phone_number);
-          strcat(tx_buffer, "\"\r\n");
+      // Log upload: bring up GPRS, connect to the collector, send the records
+      // back to back (DATALOG_BATCH at a time, straight out of flash)
+      case CommandStateGprsReset: // SHUT OK (or an error if there was nothing to shut)
+      {
+        gprs_command(CommandStateGprsAttach, TextAtGprsAttach, 0, GPRS_CONNECT_TIMEOUT);
+        break;
+      }
 
-          // Enable timer, go to sleep (uart will be disabled too because LPM2)
-          TA2CTL |= MC__UP;
-          LPM2;
-        }
+      case CommandStateGprsAttach:
+      {
+        if(uart_command_result == UartResultOK)
+          gprs_command(CommandStateGprsApn, TextAtGprsApn, GPRS_APN "\"\r\n", UART_PROBE_TIMEOUT);
+        else
+          upload_finish(0);
+        break;
+      }
+
+      case CommandStateGprsApn:
+      {
+        if(uart_command_result == UartResultOK)
+          gprs_command(CommandStateGprsBringUp, TextAtGprsBringUp, 0, GPRS_CONNECT_TIMEOUT);
+        else
+          upload_finish(0);
+        break;
+      }
 
+      case CommandStateGprsBringUp:
+      {
+        if(uart_command_result == UartResultOK)
+          gprs_command(CommandStateGprsAddress, TextAtGprsAddress, 0, UART_PROBE_TIMEOUT);
+        else
+          upload_finish(0);
         break;
       }
-      case CommandStateSendStatusSMS:
+
+      case CommandStateGprsAddress: // just the address comes back, so this ends in a timeout
+      {
+        if(strchr(rx_buffer, '.'))
+          gprs_command(CommandStateGprsConnect, TextAtGprsConnect,
+                       GPRS_COLLECTOR_HOST "\",\"" GPRS_COLLECTOR_PORT "\"\r\n",
+                       GPRS_CONNECT_TIMEOUT);
+        else
+          upload_finish(0);
+        break;
+      }
+
+      case CommandStateGprsConnect: // OK now, CONNECT OK once the connection is up
       {
         if(uart_command_result == UartResultOK)
         {
-          // Delete all stored messages.
-          uart_command_state = CommandStateDeleteSMS;
-          tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGD=1,4\r\n");
-          uart_send_command();
+          uart_command_state = CommandStateGprsConnected;
+          uart_listen();
+          uart_set_timeout(GPRS_CONNECT_TIMEOUT);
         }
-        else if(uart_command_result == UartResultError) // sms failed to send
-        {
-          LED_PORT_OUT |= LED_MSP;
+        else
+          upload_finish(0);
+        break;
+      }
+
+      case CommandStateGprsConnected: // CONNECT OK ends in OK too (CONNECT FAIL times out)
+      {
+        if(uart_command_result == UartResultOK)
+          upload_next_batch();
+        else
+          upload_finish(0);
+        break;
+      }
 
-          // Set up timer to try again
-          TA2CTL = TACLR;
-          TA2CTL = TASSEL__ACLK | ID__8 | MC__STOP;
-          TA2CCTL0 = CCIE;
-          TA2CCR0 = TIMEOUT_SMS; // 4096 times 10 -> 10 seconds
+      case CommandStateGprsPrepareSend:
+      {
+        if(uart_command_result == UartResultInput)
+        {
+          uart_command_state = CommandStateGprsSend;
+          uart_send_data(upload_data, upload_count * sizeof(struct DatalogRecord));
+          uart_set_timeout(GPRS_CONNECT_TIMEOUT);
+        }
+        else
+          upload_finish(0);
+        break;
+      }
 
-          // Prepare again
-          uart_command_state = CommandStatePrepareStatusSMS;
-          tx_buffer_reset();
-          strcpy(tx_buffer, "AT+CMGS=\"");
-          strcat(tx_buffer, phone_number);
-          strcat(tx_buffer, "\"\r\n");
+      case CommandStateGprsSend: // SEND OK
+      {
+        if(uart_command_result == UartResultOK)
+        {
+          datalog_uploaded(upload_count);
+          upload_next_batch();
+        }
+        else
+          upload_finish(0);
+        break;
+      }
 
-          // Enable timer, go to sleep (uart will be disabled too because LPM2)
-          TA2CTL |= MC__UP;
-          LPM2;
+      case CommandStateGprsClose:
+      {
+        if(upload_failed)
+        {
+          // The last batch the modem took may not have made it, send it again
+          // next time (the collector throws out repeats by sequence)
+          datalog_upload_rewind(DATALOG_BATCH);
+          upload_retry_wait = UPLOAD_RETRY_WAIT;
         }
+        else
+          upload_pending = 0;
+        update_session_end();
+        inbox_next();
+        break;
+      }
 
+      // Firmware update: after the records, the collector sends a window of
+      // patch at a time, applied while the connection sits quiet
+      case CommandStateGprsUpdatePrepare:
+      {
+        if(uart_command_result == UartResultInput)
+        {
+          uart_command_state = CommandStateGprsUpdateSend;
+          update_request();
+          uart_send_command();
+          uart_set_timeout(GPRS_CONNECT_TIMEOUT);
+        }
+        else
+          upload_finish(0);
         break;
       }
 
-      case CommandStateDeleteSMS:
+      case CommandStateGprsUpdateSend: // SEND OK, the collector answers a moment later
       {
         if(uart_command_result == UartResultOK)
-          LED_PORT_OUT &= ~LED_MSP; // red LED off
+        {
+          uart_command_state = CommandStateGprsUpdateReceive;
+          uart_stream_start();
+          uart_listen();
+          uart_set_timeout(GPRS_CONNECT_TIMEOUT);
+        }
+        else
+          upload_finish(0);
+        break;
+      }
 
-        uart_enter_idle_mode();
+      case CommandStateGprsUpdateReceive: // the collector's OK, lines were parsed as they came
+      {
+        uart_stream_stop();
+        if(uart_command_result == UartResultOK)
+          uart_command_state = CommandStateGprsUpdateApply; // below, then the next window
+        else
+          upload_finish(0);
         break;
       }
+      }
     }
 
-    // Turn CPU off until someone calls LPM0_EXIT (uart interrupt handler will)
-    LPM0;
-    }
+    // New texts showed up while we were busy with something else
+    if(uart_command_state == CommandStateIdle && uart_inbox_pending)
+      request_inbox_list();
+
+    // Replies that were waiting for coverage
+    if(uart_command_state == CommandStateIdle && inbox_actions && network_can_send())
+      inbox_next();
+
+    // Service port commands and output
+    service_poll();
+
+    // The modem stalled, keep the trace that led up to it
+    if(trace_flush_wanted)
+      trace_flush();
+
+    // Firmware update: a window that came in goes into flash before the next
+    // one is asked for; otherwise image CRCs and checking, a slice a pass
+    if(uart_command_state == CommandStateGprsUpdateApply && !update_applying())
+      update_next_window();
+    else if(update_busy())
+      update_work();
+
+    // Turn CPU off until someone calls LPM0_EXIT (uart interrupt handler will).
+    // Check for work with interrupts off so a wake up can't sneak in between
+    // the check and going to sleep (GIE comes back on with the LPM bits).
+    // Stay up while the service port is plugged in or there's update work.
+    _DINT();
+    if(uart_command_has_completed || uart_line_ready() || service_connected || update_busy())
+      _EINT();
+    else
+      __bis_SR_register(LPM0_bits | GIE);
   }
 }
 
@@ -545,42 +868,463 @@ int main(void)
 
 void toggle_gsm_power(void)
 {
+	trace_event(TraceModemPower, 0);
+
 	// Set output to be LOW
 	GSM_PORT_OUT &= ~GSM_POWER_CONTROL; // low
 	GSM_PORT_DIR |= GSM_POWER_CONTROL; // output mode
 
-	// Start timer and run for 1.5 seconds, and call the interrupt handler when it's done
-	TA1CTL = TACLR;
-	TA1CTL = TASSEL__ACLK | ID__8 | MC__STOP; // aux clock, divide by 8 (so 4096 hz)
-	TA1CCTL0 = CCIE; // interrupt enable for ccr0
-	TA1CCR0 = 6144 - 1; // 1.5 secs (4096 * 1.5)
-	TA1CTL |= MC__UP; // activate timer
+	// Timer A1 is free running at 32768 hz; call the interrupt handler in 1.5 seconds
+	TA1CCR1 = TA1R + 49152; // 1.5 secs (32768 * 1.5)
+	TA1CCTL1 = CCIE; // interrupt enable for ccr1 (also clears the flag)
 }
 
 
-/**
- * A floatswitch reading is valid if no active switch is higher than an
- * inactive switch.  This function iterates through the floatswitches from
- * lowest to highest and takes note when it encounters an inactive switch so as
- * to identify erroneous readings.
- */
-int get_water_level(char switch_states, int number_of_switches)
+void build_status_report(void)
+{
+  STACK_MARK(StackReport);
+  tx_buffer_reset();
+  text_copy(TextStatusHeader);
+
+  // Battery status
+  if(battery_charge > BATTERY_LEVEL(228)) // 12.9V (at TEMPERATURE_NOMINAL, as below)
+    text_append(TextBatteryFull);
+  else if(battery_charge > BATTERY_LEVEL(210)) // About 50% - 12.55V
+    text_append(TextBatteryMedium);
+  else if(battery_charge > BATTERY_LEVEL(190)) // 12.2V
+    text_append(TextBatteryLow);
+  else
+    text_append(TextBatteryVeryLow);
+
+  // Solar panel charge
+  if(solarpanel_voltage > 186)
+    text_append(TextChargeHigh);
+  else if(solarpanel_voltage > 113)
+    text_append(TextChargeMedium);
+  else if(solarpanel_voltage > 39)
+    text_append(TextChargeLow);
+  else
+    text_append(TextChargeNone);
+
+  // Water depth
+  int water_level = floatswitch_level; // suspect switches left out
+  switch(water_level)
+  {
+    case 0: // No floatswitches are active.
+      text_append(TextWaterNone);
+      break;
+    case 1: // Lowest floatswitch is active.
+      text_append(TextWaterVeryLow);
+      break;
+    case 2: // Two lowest floatswitches are active.
+      text_append(TextWaterLow);
+      break;
+    case 3: // All three floatswitches are active.
+      text_append(TextWaterMedium);
+      break;
+    case 4:
+      text_append(TextWaterHigh);
+      break;
+    case 5:
+      text_append(TextWaterVeryHigh);
+      break;
+    default: // Any other combination.
+      text_append(TextWaterInvalid);
+      break;
+  }
+
+  // Switches we don't trust, like "Switch fault: 1H 3L" (1 = lowest, H = stuck on, L = stuck off)
+  if(floatswitch_suspect_high || floatswitch_suspect_low)
+  {
+    int i;
+    char entry[4] = " 0?";
+    text_append(TextSwitchFault);
+    for(i = 0; i < FLOATSWITCH_COUNT; ++i)
+    {
+      entry[1] = '1' + i;
+      if(floatswitch_suspect_high & (1 << i))
+        entry[2] = 'H';
+      else if(floatswitch_suspect_low & (1 << i))
+        entry[2] = 'L';
+      else
+        continue;
+      strcat(tx_buffer, entry);
+    }
+    text_append(TextNewline);
+  }
+
+  // Bailer
+  if(pump_active)
+    text_append(TextPumpOn);
+  else if(pump_fault == PumpFaultDryRun)
+    text_append(TextPumpDryRun);
+  else if(pump_fault == PumpFaultStall)
+    text_append(TextPumpStall);
+  else
+    text_append(TextPumpOff);
+
+  text_append(TextSmsEnd);
+}
+
+
+void build_diagnostics_report(void)
+{
+  STACK_MARK(StackReport);
+  tx_buffer_reset();
+  text_copy(TextDiagHeader);
+
+  // Modem link: speed, overruns, framing errors, dropped bytes
+  text_append(TextDiagUart);
+  strcat(tx_buffer, uart_bauds[uart_baud_index].name);
+  text_append(TextDiagOverrun);
+  tx_buffer_append_number(uart_overrun_count);
+  text_append(TextDiagFraming);
+  tx_buffer_append_number(uart_framing_count);
+  text_append(TextDiagDropped);
+  tx_buffer_append_number(uart_dropped_count);
+  text_append(TextNewline);
+
+  // Network: registration, signal, texts that failed/tried, times registration was lost
+  text_append(TextDiagNetwork);
+  tx_buffer_append_number(network_registration);
+  text_append(TextDiagSignal);
+  tx_buffer_append_number(network_rssi);
+  text_append(TextDiagFailed);
+  tx_buffer_append_number(network_send_failures);
+  text_append(TextSlash);
+  tx_buffer_append_number(network_send_attempts);
+  text_append(TextDiagLost);
+  tx_buffer_append_number(network_lost_count);
+  text_append(TextNewline);
+
+  // History log: records kept, not uploaded yet
+  text_append(TextDiagLog);
+  tx_buffer_append_number(datalog_count);
+  text_append(TextDiagPending);
+  tx_buffer_append_number(datalog_pending);
+  text_append(TextNewline);
+
+  // Resets since power up, why the last one, how long it took to get going
+  text_append(TextDiagResets);
+  tx_buffer_append_number(warm_state.resets);
+  text_append(TextDiagCause);
+  tx_buffer_append_number(warm_state.reset_cause);
+  text_append(TextDiagBoot);
+  tx_buffer_append_number(warm_state.boot_ms);
+  text_append(TextDiagBootUnit);
+
+  // Only when it's getting tight (there's no room in the text otherwise)
+  if(stack_headroom() < STACK_HEADROOM_MIN)
+  {
+    text_append(TextDiagStackLow);
+    tx_buffer_append_number(stack_headroom());
+    text_append(TextDiagStackUnit);
+  }
+
+  // Running image and how the last update went
+  text_append(TextDiagFirmware);
+  tx_buffer_append_number(update_image_crc);
+  text_append(TextDiagUpdate);
+  tx_buffer_append_number(update_state);
+  text_append(TextNewline);
+
+#ifdef ISR_PROFILING
+  // Longest uart handler, longest tick, worst latency (the rest is on the service port)
+  text_append(TextDiagIsr);
+  tx_buffer_append_number(profile_stats[ProfileUart].max);
+  text_append(TextSlash);
+  tx_buffer_append_number(profile_stats[ProfileTick].max);
+  text_append(TextSlash);
+  tx_buffer_append_number(profile_stats[ProfileLatency].max);
+  text_append(TextDiagIsrUnit);
+#endif
+
+  text_append(TextCtrlZ);
+}
+
+
+void build_digest_report(void)
+{
+  STACK_MARK(StackReport);
+  tx_buffer_reset();
+  text_copy(TextDigestHeader);
+
+  // Battery min-max avg in mV
+  text_append(TextDigestBattery);
+  tx_buffer_append_number((unsigned long)stats_day.battery_min * BATTERY_MV_PER_COUNT);
+  text_append(TextDash);
+  tx_buffer_append_number((unsigned long)stats_day.battery_max * BATTERY_MV_PER_COUNT);
+  text_append(TextAverage);
+  tx_buffer_append_number((unsigned long)stats_battery_mean(&stats_day) * BATTERY_MV_PER_COUNT);
+  text_append(TextDigestBatteryUnit);
+
+  // Panel min-max avg (adc counts, 186 -> full sun)
+  text_append(TextDigestPanel);
+  tx_buffer_append_number(stats_day.panel_min);
+  text_append(TextDash);
+  tx_buffer_append_number(stats_day.panel_max);
+  text_append(TextAverage);
+  tx_buffer_append_number(stats_panel_mean(&stats_day));
+  text_append(TextNewline);
+
+  text_append(TextDigestPump);
+  tx_buffer_append_number(stats_day.pump_seconds);
+  text_append(TextDigestPumpUnit);
+  tx_buffer_append_number(stats_day.pump_cycles);
+  text_append(TextDigestStarts);
+
+  text_append(TextDigestPeak);
+  tx_buffer_append_number(stats_day.level_peak);
+  text_append(TextDigestWarnings);
+  tx_buffer_append_number(stats_day.warnings);
+  text_append(TextSmsEnd);
+}
+
+
+void request_baud_change(void)
+{
+  uart_command_state = CommandStateSetBaud;
+  tx_buffer_reset();
+  text_copy(TextAtBaud);
+  strcat(tx_buffer, uart_bauds[uart_baud_best].name);
+  text_append(TextNewline);
+  uart_send_command();
+  uart_set_timeout(UART_PROBE_TIMEOUT);
+}
+
+
+void request_sms_mode(void)
+{
+  // Send cmgf
+  // This puts the cell module into SMS mode, as opposed to data mode
+  uart_command_state = CommandStateGoToSMSMode;
+  tx_buffer_reset();
+  text_copy(TextAtTextMode);
+  uart_send_command();
+}
+
+
+void request_inbox_list(void)
+{
+  uart_inbox_pending = 0; // anything after this shows up in the listing or sets it again
+  inbox_reset();
+  uart_command_state = CommandStateListSMS;
+  tx_buffer_reset();
+  text_copy(TextAtListSms);
+  uart_stream_start();
+  uart_send_command();
+}
+
+
+void inbox_next(void)
+{
+  // Log upload asked for (goes when there's coverage)
+  if(inbox_actions & InboxActionUpload)
+  {
+    inbox_actions &= ~InboxActionUpload;
+    upload_pending = 1;
+    upload_retry_wait = 0;
+  }
+
+  // Password text: sender becomes the phone number (right away, the
+  // acknowledgement can wait for coverage)
+  if(inbox_actions & InboxActionPhone)
+  {
+    inbox_actions = (inbox_actions & ~InboxActionPhone) | InboxActionPhoneAck;
+
+    // copy the phone number into ram
+    memset(phone_number, '\0', MAX_PHONE_LENGTH);
+    strncpy(phone_number, inbox_phone, MAX_PHONE_LENGTH);
+
+    // Now copy it into flash memory
+    flash_erase(PHONE_ADDRESS);
+    flash_write_phone_number(phone_number, MAX_PHONE_LENGTH);
+  }
+
+  // Nobody to send replies to
+  if(phone_number[0] == '\0')
+    inbox_actions = 0;
+
+  // Replies wait until they have a decent chance of getting through (they're
+  // kept until then, the texts can be deleted already)
+  if(inbox_actions && network_can_send())
+  {
+    // Send the user an acknowledgement
+    if(inbox_actions & InboxActionPhoneAck)
+    {
+      inbox_actions &= ~InboxActionPhoneAck;
+      request_sms(CommandStatePreparePhoneSMS);
+      return;
+    }
+
+    // Reports (one of each no matter how many texts asked)
+    if(inbox_actions & InboxActionStatus)
+    {
+      inbox_actions &= ~InboxActionStatus;
+      report_type = ReportStatus;
+      request_sms(CommandStatePrepareStatusSMS);
+      return;
+    }
+    if(inbox_actions & InboxActionDiag)
+    {
+      inbox_actions &= ~InboxActionDiag;
+      report_type = ReportDiagnostics;
+      request_sms(CommandStatePrepareStatusSMS);
+      return;
+    }
+    if(inbox_actions & InboxActionTelemetry)
+    {
+      // Binary frame, needs PDU mode (back to text mode after)
+      inbox_actions &= ~InboxActionTelemetry;
+      uart_command_state = CommandStateSetPDUMode;
+      tx_buffer_reset();
+      text_copy(TextAtPduMode);
+      uart_send_command();
+      return;
+    }
+  }
+
+  // Delete the messages we read, one at a time (anything that came in after
+  // the listing stays put)
+  if(inbox_delete_count)
+  {
+    inbox_delete_count--;
+    uart_command_state = CommandStateDeleteSMS;
+    tx_buffer_reset();
+    text_copy(TextAtDeleteSms);
+    tx_buffer_append_number(inbox_delete[inbox_delete_count]);
+    text_append(TextNewline);
+    uart_send_command();
+    return;
+  }
+
+  // More waiting than fit in one listing, or new ones came in
+  if(inbox_overflow || uart_inbox_pending)
+  {
+    request_inbox_list();
+    return;
+  }
+
+  LED_PORT_OUT &= ~LED_MSP; // red LED off
+  uart_enter_idle_mode();
+}
+
+
+void request_sms(char state)
 {
-  bool inactive_switch_found = false;
-  int active_switch_count = 0;
-  
-  int i;
-  for (i = 0; i < number_of_switches; ++i)
+  LED_PORT_OUT &= ~LED_MSP;
+  uart_command_state = state;
+  tx_buffer_reset();
+  text_copy(TextAtSendSmsTo);
+  strncat(tx_buffer, phone_number, MAX_PHONE_LENGTH);
+  text_append(TextQuoteNewline);
+  uart_send_command();
+}
+
+
+void sms_failed(char state)
+{
+  LED_PORT_OUT |= LED_MSP;
+  network_sent(0, state); // the timer starts it again when it's time
+  uart_enter_idle_mode();
+}
+
+
+void request_upload(void)
+{
+  upload_failed = 0;
+  gprs_command(CommandStateGprsReset, TextAtGprsShut, 0, UART_PROBE_TIMEOUT);
+}
+
+
+void upload_next_batch(void)
+{
+  upload_count = datalog_upload_batch(&upload_data, DATALOG_BATCH);
+  if(upload_count == 0)
   {
-    bool switch_is_active = (switch_states >> i) & 1;
-    if (switch_is_active && !inactive_switch_found)
-      ++active_switch_count;
-    else if (switch_is_active && inactive_switch_found)
-      return -1;
-    else // switch is inactive
-      inactive_switch_found = true;
+    update_next_window(); // all caught up, firmware next (closes if there's nothing to ask)
+    return;
   }
-  return active_switch_count;
+
+  uart_command_state = CommandStateGprsPrepareSend;
+  tx_buffer_reset();
+  text_copy(TextAtGprsSend);
+  tx_buffer_append_number(upload_count * sizeof(struct DatalogRecord));
+  text_append(TextNewline);
+  uart_send_command();
+  uart_set_timeout(UART_PROBE_TIMEOUT);
+}
+
+
+void upload_finish(char ok)
+{
+  if(!ok)
+    upload_failed = 1;
+  gprs_command(CommandStateGprsClose, TextAtGprsShut, 0, UART_PROBE_TIMEOUT);
+}
+
+
+void update_next_window(void)
+{
+  unsigned int length;
+
+  if(!update_window_start())
+  {
+    upload_finish(1);
+    return;
+  }
+
+  // Request goes out after the prompt, built once now for its length
+  update_request();
+  length = strlen(tx_buffer);
+  uart_command_state = CommandStateGprsUpdatePrepare;
+  tx_buffer_reset();
+  text_copy(TextAtGprsSend);
+  tx_buffer_append_number(length);
+  text_append(TextNewline);
+  uart_send_command();
+  uart_set_timeout(UART_PROBE_TIMEOUT);
+}
+
+
+void gprs_command(char state, unsigned int text, const char *setting, char timeout)
+{
+  uart_command_state = state;
+  tx_buffer_reset();
+  text_copy(text);
+  if(setting)
+    strcat(tx_buffer, setting);
+  uart_send_command();
+  uart_set_timeout(timeout);
+}
+
+
+void request_signal_check(void)
+{
+  uart_command_state = CommandStateCheckSignal;
+  tx_buffer_reset();
+  text_copy(TextAtSignal);
+  uart_send_command();
+  uart_set_timeout(UART_PROBE_TIMEOUT);
+}
+
+
+void request_clock_read(void)
+{
+  rtc_sync_attempt();
+  uart_command_state = CommandStateReadClock;
+  tx_buffer_reset();
+  text_copy(TextAtClock);
+  uart_send_command();
+}
+
+
+void request_text_mode(void)
+{
+  uart_command_state = CommandStateSetTextMode;
+  tx_buffer_reset();
+  text_copy(TextAtTextMode);
+  uart_send_command();
 }
 
 
@@ -590,39 +1334,63 @@ int get_water_level(char switch_states, int number_of_switches)
 #pragma vector=TIMER0_A0_VECTOR
 __interrupt void timerA0_interrupt_handler()
 {
+  PROFILE_ENTER();
+  STACK_MARK(StackTick);
+
+  uart_rx_hold(); // this takes a while, ask the modem to wait
+
   // Get the current time (seconds since the msp started)
-  unsigned long current_time = RTCTIM1;
-  current_time <<= 16;
-  current_time += RTCTIM0;
-
-	// Check the switches
-	floatswitches = 0;
-	floatswitches |= (P1IN & FLOATSWITCH_0) ? 0x1 : 0; // false means ground -> switch NOT active
-	floatswitches |= (P1IN & FLOATSWITCH_1) ? 0x2 : 0;
-	floatswitches |= (P1IN & FLOATSWITCH_2) ? 0x4 : 0;
-	floatswitches |= (P1IN & FLOATSWITCH_3) ? 0x8 : 0;
-	floatswitches |= (P1IN & FLOATSWITCH_4) ? 0x10 : 0;
-
-	// Figure out whether the bat is low or not
-	if(battery_charge > BATTERY_THRESHOLD_HIGH)
+  unsigned long current_time = rtc_get_time();
+  char warning = 0; // not enough charge to pump the water out
+
+	trace_tick(current_time);
+
+	// Give up on modem commands that have timed out
+	if(uart_tick())
+	  LPM0_EXIT;
+
+	// Too many garbled bytes at this speed, step down a notch
+	if(uart_command_state == CommandStateIdle && uart_baud_errors >= UART_FRAMING_LIMIT
+	   && uart_baud_index < UART_BAUD_COUNT - 1)
+	{
+	  uart_baud_best = uart_baud_index + 1;
+	  request_baud_change();
+	}
+
+	// Check the switches (one read per port, ground -> switch NOT active)
+	floatswitches = floatswitch_read();
+
+	// Keep track of how the switches behave (works out the level we trust)
+	floatswitch_tick(floatswitches, pump_state != PumpStateOff);
+
+	// Let the pump check its load (this can shut it off)
+	pump_tick(battery_charge);
+
+	// Figure out whether the bat is low or not (thresholds follow the temperature)
+	// (ignore the dip while the pump is soft-starting)
+	if(battery_charge > BATTERY_LEVEL(BATTERY_THRESHOLD_HIGH))
 	  battery_can_drain = 1;
-	else if(battery_charge < BATTERY_THRESHOLD_LOW)
+	else if(battery_charge < BATTERY_LEVEL(BATTERY_THRESHOLD_LOW) && !pump_is_ramping())
 	  battery_can_drain = 0;
 
 	// Check water depth
-	if(floatswitches > 0)
+	if(floatswitch_wants_pump() && pump_can_run())
 	{
-		if(battery_charge > BATTERY_THRESHOLD_HIGH || (battery_charge > BATTERY_THRESHOLD_LOW && battery_can_drain))
+		if(battery_charge > BATTERY_LEVEL(BATTERY_THRESHOLD_HIGH) || (battery_charge > BATTERY_LEVEL(BATTERY_THRESHOLD_LOW) && battery_can_drain))
       pump_active = 1;
 		else
 		{
 			pump_active = 0;
 
-			if(get_water_level(floatswitches, 5) >= 2)
+			if(floatswitch_level >= 2 || floatswitch_level < 0)
 			{
+				warning = 1;
+
 				// There is not enough charge and too much water, notify over text
 			  // 0x15180 is 86400 (seconds)
-				if(uart_command_state == CommandStateIdle && current_time - last_sent_warningtext > 0x15180)
+				// (not at night, once we know when that is)
+				if(uart_command_state == CommandStateIdle && current_time - last_sent_warningtext > 0x15180
+				   && network_can_send() && !rtc_quiet_hours())
 				{
 				  LED_PORT_OUT |= LED_MSP; // red LED on
 
@@ -632,9 +1400,9 @@ __interrupt void timerA0_interrupt_handler()
 						// Send the text!!
 						uart_command_state = CommandStatePrepareWarningSMS;
 						tx_buffer_reset();
-						strcpy(tx_buffer, "AT+CMGS=\"");
+						text_copy(TextAtSendSmsTo);
 						strcat(tx_buffer, phone_number);
-						strcat(tx_buffer, "\"\r\n");
+						text_append(TextQuoteNewline);
 						uart_send_command();
 
 						// save the current time
@@ -647,61 +1415,153 @@ __interrupt void timerA0_interrupt_handler()
 	else // No water
 		pump_active = 0;
 
-	// Set water pump output and solar panel output
-	if(pump_active)
-	{
-		PUMPSOLAR_PORT_OUT |= PUMP_CONTROL;
-		PUMPSOLAR_PORT_OUT &= ~SOLARPANEL_CONTROL;
-	}
-	else
+	// Set water pump output and solar panel output (the panel stays on while
+	// pumping if it can, and nothing closes until whatever opened has settled)
+	power_update(pump_active, solarpanel_voltage);
+
+	// Charge stage and panel pwm duty (only matters while the panel is connected)
+	charge_tick(battery_charge);
+
+	// Hour/day aggregates for the digest
+	stats_tick(battery_charge, solarpanel_voltage, pump_state != PumpStateOff, floatswitch_level, warning);
+
+	// Keep an eye on the signal, more so while texts are waiting on it. A
+	// failed text goes first once its wait is up.
+	if(network_tick(digest_pending || inbox_actions) && uart_command_state == CommandStateIdle)
+	  request_signal_check();
+	else if(uart_command_state == CommandStateIdle && network_retry_due())
+	  request_sms(network_retry_state);
+
+	// Daily digest (the RTC alarm asks for it, goes out once the modem is free
+	// and there's coverage)
+	if(digest_pending && uart_command_state == CommandStateIdle && network_can_send())
 	{
-	  PUMPSOLAR_PORT_OUT &= ~PUMP_CONTROL;
-	  PUMPSOLAR_PORT_OUT |= SOLARPANEL_CONTROL;
+	  digest_pending = 0;
+	  report_type = ReportDigest;
+	  request_sms(CommandStatePrepareStatusSMS);
 	}
 
+	// History log, and sending it off when enough has piled up (or someone asked)
+	datalog_tick(battery_charge, solarpanel_voltage, floatswitches, floatswitch_level, telemetry_flags());
+	if(datalog_pending >= DATALOG_UPLOAD_AT)
+	  upload_pending = 1;
+	if(upload_retry_wait)
+	  upload_retry_wait--;
+	else if((upload_pending || update_wanted()) && uart_command_state == CommandStateIdle && network_can_send())
+	  request_upload();
+
+	// Firmware updates: checks coming due, a new image confirming itself
+	update_tick();
+	if(update_busy())
+	  LPM0_EXIT;
+
+	// Replies that were waiting on coverage (main loop sends them)
+	if(uart_command_state == CommandStateIdle && inbox_actions && network_can_send())
+	  LPM0_EXIT;
+
+	// Keep what a reset shouldn't lose
+	warm_save();
+
+	// Cable plugged in: main loop looks after the service port
+	if(service_tick())
+	  LPM0_EXIT;
+
 	// New conversion
 	adc_start_conversion();
+
+	uart_rx_release();
+
+	PROFILE_EXIT(ProfileTick);
+}
+
+#pragma vector=TIMER0_A1_VECTOR // TA0CCR1-4 one shots (TA0CCR0 is the 1 second tick)
+__interrupt void timerA0_oneshot_interrupt_handler()
+{
+	PROFILE_ENTER();
+
+	switch(TA0IV)
+	{
+		case TA0IV_TACCR1: // pump/panel dead time is over
+			TA0CCTL1 &= ~CCIE;
+			power_deadtime_elapsed();
+			break;
+#ifdef UART_FLOW_CONTROL
+		case TA0IV_TACCR2: // check CTS again
+			TA0CCTL2 &= ~CCIE;
+			uart_cts_poll();
+			break;
+#endif
+		default:
+			break;
+	}
+
+	PROFILE_EXIT(ProfileOneshot);
 }
 
-#pragma vector=TIMER1_A0_VECTOR // TA1CCR0 only
+#pragma vector=TIMER1_A1_VECTOR // TA1CCR1, TA1CCR2 (TA1CCR0 is the pump pwm)
 __interrupt void timerA1_interrupt_handler()
 {
-	// Stop timer
-	TA1CTL |= MC__STOP;
+	PROFILE_ENTER();
+
+	switch(TA1IV)
+	{
+		case TA1IV_TACCR1: // gsm power pulse is over
+			TA1CCTL1 &= ~CCIE; // one shot
+
+			// Set gsm power output back to input/floating mode
+			GSM_PORT_DIR &= ~GSM_POWER_CONTROL;
+			break;
+		case TA1IV_TACCR2: // panel pwm phase is over
+			charge_pwm_interrupt();
+			break;
+		default:
+			break;
+	}
 
-	// Set gsm power output back to input/floating mode
-	GSM_PORT_DIR &= ~GSM_POWER_CONTROL;
+	PROFILE_EXIT(ProfileTimerA1);
 }
 
-#pragma vector=TIMER2_A0_VECTOR
-__interrupt void timerA2_interrupt_handler() // for TA2CCR0 only
+#pragma vector=RTC_VECTOR
+__interrupt void rtc_interrupt_handler()
 {
-  if(tryagain_timeelapsed >= 8) // if TIMEOUT_SMS is 15 seconds then this is 2 minutes (8*15 sec)
-  {
-    // Reset time counter and stop timer
-    TA2CTL |= MC__STOP;
-    tryagain_timeelapsed = 0;
+	PROFILE_ENTER();
 
-    // Finished waiting, now try again and send the command
-    LED_PORT_OUT &= ~LED_MSP;
-    uart_send_command();
-    LPM2_EXIT;
-  }
-  else
-    tryagain_timeelapsed++;
+	switch(RTCIV)
+	{
+		case RTCIV_RTCAIFG: // digest time (timer tick sends it)
+			if(phone_number[0] != '\0')
+				digest_pending = 1;
+			break;
+		default:
+			break;
+	}
+
+	PROFILE_EXIT(ProfileRtc);
 }
 
 #pragma vector=ADC12_VECTOR
 __interrupt void ADC_interrupt_handler()
 {
+	PROFILE_ENTER();
+
 	// Check the interrupt flags
 	switch(ADC12IV)
 	{
-		case ADC12IV_ADC12IFG1: // All readings have finished
-			battery_charge = ADC12MEM0; // Save reading
-			solarpanel_voltage = ADC12MEM1; // save reading
+		case ADC12IV_ADC12IFG2: // All readings have finished (12 bit, we keep the top 8 of the voltages)
+			if(adc_load_sample) // taken mid pump pwm on-phase
+			{
+				adc_load_sample = 0;
+				pump_load_sample(ADC12MEM0 >> 4);
+				break;
+			}
+			battery_charge = ADC12MEM0 >> 4; // Save reading
+			solarpanel_voltage = ADC12MEM1 >> 4; // save reading
+			adc_temperature_sample(ADC12MEM2);
+			trace_reading(battery_charge, solarpanel_voltage);
 			break;
 		default:
 			break;
 	}
+
+	PROFILE_EXIT(ProfileAdc);
 }
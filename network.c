@@ -0,0 +1,118 @@
+#include "network.h"
+#include "trace.h"
+
+/*
+ * network.c
+ */
+
+volatile unsigned char network_registration;
+volatile unsigned char network_rssi;
+volatile char network_retry_pending;
+volatile char network_retry_state;
+volatile unsigned int network_send_attempts;
+volatile unsigned int network_send_failures;
+volatile unsigned int network_lost_count;
+volatile unsigned long network_deferred_seconds;
+
+volatile unsigned int network_csq_wait; // seconds until the next signal check
+volatile unsigned int network_retry_wait; // seconds until the retry can go
+volatile unsigned int network_retry_backoff; // what the next failure waits
+
+// Registration stats that mean we're on the network
+#define network_is_registered(stat) ((stat) == 1 || (stat) == 5)
+
+void network_initialize(void)
+{
+  network_registration = 0;
+  network_rssi = NETWORK_RSSI_UNKNOWN;
+  network_retry_pending = 0;
+  network_retry_state = 0;
+  network_send_attempts = 0;
+  network_send_failures = 0;
+  network_lost_count = 0;
+  network_deferred_seconds = 0;
+  network_csq_wait = 0; // check right away
+  network_retry_wait = 0;
+  network_retry_backoff = NETWORK_RETRY_MIN;
+}
+
+void network_registration_update(unsigned char stat)
+{
+  if(stat != network_registration)
+    trace_event(TraceNetwork, stat);
+
+  if(network_is_registered(network_registration) && !network_is_registered(stat))
+    network_lost_count++;
+
+  // Back on the network: that's the best time to try again, don't sit out
+  // the rest of the backoff
+  if(!network_is_registered(network_registration) && network_is_registered(stat))
+  {
+    network_retry_wait = 0;
+    network_retry_backoff = NETWORK_RETRY_MIN;
+    network_csq_wait = 0;
+  }
+
+  network_registration = stat;
+}
+
+void network_signal_update(unsigned char rssi)
+{
+  network_rssi = rssi;
+  network_csq_wait = NETWORK_CSQ_PERIOD;
+}
+
+int network_ready(void)
+{
+  return network_is_registered(network_registration)
+      && network_rssi != NETWORK_RSSI_UNKNOWN && network_rssi >= NETWORK_RSSI_MIN;
+}
+
+int network_can_send(void)
+{
+  return network_ready() && !network_retry_pending;
+}
+
+void network_sent(char ok, char retry_state)
+{
+  network_send_attempts++;
+  if(ok)
+  {
+    network_retry_backoff = NETWORK_RETRY_MIN;
+    return;
+  }
+
+  network_send_failures++;
+  network_retry_pending = 1;
+  network_retry_state = retry_state;
+  network_retry_wait = network_retry_backoff;
+  if(network_retry_backoff < NETWORK_RETRY_MAX)
+    network_retry_backoff <<= 1;
+  network_csq_wait = 0; // see what the signal is like now
+}
+
+int network_tick(char waiting)
+{
+  waiting |= network_retry_pending;
+
+  if(network_retry_wait)
+    network_retry_wait--;
+
+  if(waiting && !network_ready())
+    network_deferred_seconds++;
+
+  // Check more often while something is waiting on coverage
+  if(waiting && network_csq_wait > NETWORK_CSQ_PERIOD_WAITING)
+    network_csq_wait = NETWORK_CSQ_PERIOD_WAITING;
+  if(network_csq_wait)
+    network_csq_wait--;
+  return network_csq_wait == 0;
+}
+
+int network_retry_due(void)
+{
+  if(!network_retry_pending || network_retry_wait || !network_ready())
+    return 0;
+  network_retry_pending = 0;
+  return 1;
+}
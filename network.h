@@ -0,0 +1,57 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * network.h
+ *
+ * Keeps track of whether the modem is registered (+CREG) and how good the
+ * signal is (AT+CSQ), and holds texts back until they have a decent chance
+ * of getting through. Failed texts are tried again with a growing wait,
+ * which starts over as soon as the modem gets back on the network.
+ */
+
+#ifndef NETWORK_H_
+#define NETWORK_H_
+
+#define NETWORK_RSSI_UNKNOWN 99 // what AT+CSQ says when it can't tell
+
+extern volatile unsigned char network_registration; // last +CREG stat (1 home, 5 roaming)
+extern volatile unsigned char network_rssi; // last AT+CSQ rssi (0-31, NETWORK_RSSI_UNKNOWN)
+
+// A failed text waiting to be tried again
+extern volatile char network_retry_pending;
+extern volatile char network_retry_state; // Prepare*SMS state to start over from
+
+// Counters (for diagnostics)
+extern volatile unsigned int network_send_attempts;
+extern volatile unsigned int network_send_failures;
+extern volatile unsigned int network_lost_count; // times registration was lost
+extern volatile unsigned long network_deferred_seconds; // seconds a text waited on coverage
+
+void network_initialize(void);
+
+// From the uart interrupt whenever a +CREG stat comes in
+void network_registration_update(unsigned char stat);
+
+// With the rssi from an AT+CSQ response
+void network_signal_update(unsigned char rssi);
+
+// Registered, with enough signal
+int network_ready(void);
+
+// Ready and not holding a failed text (new texts would get in its way)
+int network_can_send(void);
+
+// After a text went out (ok = 1) or failed. A failed one gets tried again
+// from retry_state once network_retry_due says so.
+void network_sent(char ok, char retry_state);
+
+// Called once a second, waiting is 1 if a text is being held back. Returns 1
+// when it's time to check the signal (keeps returning 1 until
+// network_signal_update, so it's fine to skip it while the modem is busy).
+int network_tick(char waiting);
+
+// Returns 1 (once) when the failed text should be tried again
+int network_retry_due(void);
+
+#endif /* NETWORK_H_ */
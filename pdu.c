@@ -0,0 +1,99 @@
+#include "pdu.h"
+#include "uart.h"
+#include <string.h>
+
+/*
+ * pdu.c
+ */
+
+const char hex_digits[] = "0123456789ABCDEF";
+
+// Adds one octet to tx_buffer as two hex digits
+void pdu_append_octet(unsigned char octet);
+
+unsigned char pdu_pack_7bit(const char *text, unsigned char length, unsigned char *out)
+{
+  unsigned int bits = 0; // bits waiting to go out, lowest first
+  unsigned char count = 0; // how many
+  unsigned char written = 0;
+  unsigned char i;
+
+  for(i = 0; i < length; ++i)
+  {
+    bits |= (unsigned int)(text[i] & 0x7F) << count;
+    count += 7;
+    if(count >= 8)
+    {
+      out[written++] = bits & 0xFF;
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+  if(count)
+    out[written++] = bits & 0xFF;
+  return written;
+}
+
+int pdu_build(const char *phone, unsigned char dcs, const unsigned char *data, unsigned char length)
+{
+  unsigned char packed[PDU_MAX_USER_DATA];
+  unsigned char digits;
+  unsigned char octets; // user data octets
+  unsigned char i;
+
+  if(*phone == '+')
+    phone++;
+  digits = strlen(phone);
+
+  // 7-bit text gets packed first, the length field counts characters then
+  if(dcs == PDU_DCS_7BIT)
+  {
+    if((length * 7 + 7) / 8 > PDU_MAX_USER_DATA)
+      return 0;
+    octets = pdu_pack_7bit((const char *)data, length, packed);
+    data = packed;
+  }
+  else
+  {
+    if(length > PDU_MAX_USER_DATA)
+      return 0;
+    octets = length;
+  }
+
+  tx_buffer_reset();
+  pdu_append_octet(0x00); // use the SMSC stored on the SIM
+  pdu_append_octet(0x01); // SMS-SUBMIT, no validity period
+  pdu_append_octet(0x00); // message reference (modem fills it in)
+
+  // Destination: digit count, international format, digits swapped in pairs
+  // (odd count padded with F)
+  pdu_append_octet(digits);
+  pdu_append_octet(0x91);
+  for(i = 0; i < digits; i += 2)
+  {
+    unsigned char low = phone[i] - '0';
+    unsigned char high = i + 1 < digits ? phone[i + 1] - '0' : 0xF;
+    pdu_append_octet((high << 4) | low);
+  }
+
+  pdu_append_octet(0x00); // protocol id
+  pdu_append_octet(dcs);
+  pdu_append_octet(length); // septets for 7-bit, octets for 8-bit
+  for(i = 0; i < octets; ++i)
+    pdu_append_octet(data[i]);
+
+  strcat(tx_buffer, "\x1A");
+
+  // Everything but the SMSC octet: first octet, reference, address (2 + digits/2),
+  // protocol id, coding, length, data
+  return 1 + 1 + 2 + (digits + 1) / 2 + 1 + 1 + 1 + octets;
+}
+
+void pdu_append_octet(unsigned char octet)
+{
+  char hex[3];
+  hex[0] = hex_digits[octet >> 4];
+  hex[1] = hex_digits[octet & 0xF];
+  hex[2] = '\0';
+  strncat(tx_buffer, hex, MAX_TX_BUFFER - 1 - strlen(tx_buffer));
+}
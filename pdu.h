@@ -0,0 +1,31 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * pdu.h
+ *
+ * SMS-SUBMIT PDUs for sending in PDU mode (AT+CMGF=0). The modem wants the
+ * whole PDU as hex, so it's written straight into tx_buffer.
+ */
+
+#ifndef PDU_H_
+#define PDU_H_
+
+// Data coding schemes
+#define PDU_DCS_7BIT 0x00 // GSM default alphabet, 7 bits a character (160 a text)
+#define PDU_DCS_8BIT 0x04 // raw bytes (140 a text)
+
+// Most user data that still fits in tx_buffer as hex (after the header and ctrl-z)
+#define PDU_MAX_USER_DATA 64
+
+// Packs 7-bit characters 8 to every 7 bytes, returns the number of bytes
+// written to out (needs (length * 7 + 7) / 8 bytes)
+unsigned char pdu_pack_7bit(const char *text, unsigned char length, unsigned char *out);
+
+// Builds the hex PDU for data (bytes for PDU_DCS_8BIT, characters for
+// PDU_DCS_7BIT) to phone (like +14445556666) into tx_buffer, ending with
+// ctrl-z. Returns the length AT+CMGS= needs (octets after the SMSC part),
+// 0 if it doesn't fit.
+int pdu_build(const char *phone, unsigned char dcs, const unsigned char *data, unsigned char length);
+
+#endif /* PDU_H_ */
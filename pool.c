@@ -0,0 +1,47 @@
+#include "pool.h"
+
+/*
+ * pool.c
+ */
+
+char pool_arena[POOL_BLOCKS][POOL_BLOCK_SIZE];
+volatile unsigned char pool_owner[POOL_BLOCKS]; // starts out all PoolOwnerFree
+volatile unsigned char pool_in_use;
+volatile unsigned char pool_peak;
+volatile unsigned char pool_failures;
+
+char *pool_take(char owner, unsigned char count)
+{
+  unsigned char first;
+  unsigned char i;
+
+  for(first = 0; first + count <= POOL_BLOCKS; ++first)
+  {
+    for(i = 0; i < count && pool_owner[first + i] == PoolOwnerFree; ++i);
+    if(i == count)
+    {
+      pool_pass(pool_arena[first], count, owner);
+      return pool_arena[first];
+    }
+  }
+
+  pool_failures++;
+  return 0;
+}
+
+void pool_pass(char *block, unsigned char count, char owner)
+{
+  unsigned char index = (block - pool_arena[0]) / POOL_BLOCK_SIZE;
+
+  for(; count && index < POOL_BLOCKS; --count, ++index)
+  {
+    if(pool_owner[index] == PoolOwnerFree && owner != PoolOwnerFree)
+      pool_in_use++;
+    else if(pool_owner[index] != PoolOwnerFree && owner == PoolOwnerFree)
+      pool_in_use--;
+    pool_owner[index] = owner;
+  }
+
+  if(pool_in_use > pool_peak)
+    pool_peak = pool_in_use;
+}
@@ -0,0 +1,46 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * pool.h
+ *
+ * Fixed blocks out of one RAM arena. Every block has an owner and only the
+ * owner touches it; it gets passed on or given back when that part is done.
+ * Who has what:
+ *   uart rx (PoolOwnerRx, 2 blocks)  response to the command in flight, line
+ *                                    copies while streaming
+ *   uart tx (PoolOwnerTx, 4 blocks)  commands and texts are built in the
+ *                                    first 2; while AT+CMGL streams in, the
+ *                                    whole run is the rx ring (PoolOwnerRing)
+ *   flash writer (PoolOwnerFlash, 1) padded copy of what's being written
+ * Only the main loop takes, passes and gives blocks.
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#define POOL_BLOCK_SIZE 128
+#define POOL_BLOCKS 7 // 896 bytes
+
+enum PoolOwner {
+  PoolOwnerFree,
+  PoolOwnerRx,
+  PoolOwnerTx,
+  PoolOwnerRing,
+  PoolOwnerFlash
+};
+
+extern volatile unsigned char pool_owner[POOL_BLOCKS];
+extern volatile unsigned char pool_in_use; // blocks taken
+extern volatile unsigned char pool_peak; // most ever taken at once
+extern volatile unsigned char pool_failures; // takes that found no room
+
+// count contiguous blocks for owner, 0 if there's no run that long
+char *pool_take(char owner, unsigned char count);
+
+// Hands count blocks starting at block over to owner (PoolOwnerFree gives
+// them back)
+void pool_pass(char *block, unsigned char count, char owner);
+#define pool_give(block, count) pool_pass(block, count, PoolOwnerFree)
+
+#endif /* POOL_H_ */
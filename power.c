@@ -0,0 +1,113 @@
+#include "power.h"
+#include "pump.h"
+#include "trace.h"
+#include "charge.h"
+
+/*
+ * power.c
+ */
+
+volatile char power_panel_connected;
+volatile char power_switching;
+volatile unsigned int power_cycle_seconds;
+volatile unsigned int power_cycle_panel;
+volatile unsigned long power_recovered_seconds;
+
+// What we want the switches to end up as
+volatile char target_pump;
+volatile char target_panel;
+
+// Running totals for the pump cycle in progress
+volatile unsigned int cycle_seconds;
+volatile unsigned long cycle_panel_sum;
+
+void power_initialize(void)
+{
+  power_panel_connected = 0;
+  power_switching = 0;
+  power_cycle_seconds = 0;
+  power_cycle_panel = 0;
+  power_recovered_seconds = 0;
+  target_pump = 0;
+  target_panel = 0;
+  cycle_seconds = 0;
+  cycle_panel_sum = 0;
+
+  PUMPSOLAR_PORT_DIR |= SOLARPANEL_CONTROL;
+  PUMPSOLAR_PORT_OUT &= ~SOLARPANEL_CONTROL;
+}
+
+void power_update(char pump_on, char panel_voltage)
+{
+  char opened = 0;
+
+  // Panel policy: always charge when not pumping; while pumping only if the
+  // panel is putting out enough to be worth it
+  target_pump = pump_on;
+  if(!pump_on)
+    target_panel = 1;
+  else if(power_panel_connected)
+    target_panel = panel_voltage > POWER_PANEL_KEEP;
+  else
+    target_panel = panel_voltage > POWER_PANEL_KEEP + POWER_PANEL_HYST;
+
+  // Keep track of the charging we got during this pump cycle
+  if(pump_state != PumpStateOff)
+  {
+    if(power_panel_connected)
+    {
+      cycle_seconds++;
+      cycle_panel_sum += panel_voltage;
+      power_recovered_seconds++;
+    }
+  }
+  else if(cycle_seconds || cycle_panel_sum)
+  {
+    power_cycle_seconds = cycle_seconds;
+    power_cycle_panel = cycle_seconds ? cycle_panel_sum / cycle_seconds : 0;
+    cycle_seconds = 0;
+    cycle_panel_sum = 0;
+  }
+
+  // Break: open everything that has to open right away
+  if(!target_pump && pump_state != PumpStateOff)
+  {
+    pump_stop();
+    opened = 1;
+  }
+  if(!target_panel && power_panel_connected)
+  {
+    charge_disconnect();
+    power_panel_connected = 0;
+    trace_event(TracePanel, 0);
+    opened = 1;
+  }
+
+  // Make: close things after the dead time, or right now if nothing opened
+  if(opened)
+  {
+    power_switching = 1;
+    TA0CCR1 = TA0R + POWER_DEADTIME;
+    if(TA0CCR1 > TA0CCR0) // timer A0 wraps at TA0CCR0
+      TA0CCR1 -= TA0CCR0 + 1;
+    TA0CCTL1 = CCIE; // one shot (also clears the flag)
+  }
+  else if(!power_switching)
+    power_deadtime_elapsed();
+}
+
+// Close whatever the targets say should be closed
+void power_deadtime_elapsed(void)
+{
+  power_switching = 0;
+
+  if(target_panel && !power_panel_connected)
+  {
+    charge_connect(); // pwm at whatever the charge stage wants
+    power_panel_connected = 1;
+    trace_event(TracePanel, 1);
+  }
+  if(target_pump)
+    pump_start(); // soft-start (nothing happens if it's already on)
+}
+
@@ -0,0 +1,35 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * power.h
+ *
+ * Power path between the battery, the solar panel and the pump. Decides
+ * whether the panel can stay connected while the pump runs and sequences the
+ * switches so something is always opened (and given POWER_DEADTIME to
+ * settle) before anything else is closed. While the panel is connected,
+ * charge.c decides how much of the time the switch is actually on.
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+extern volatile char power_panel_connected; // 1 if SOLARPANEL_CONTROL is on
+extern volatile char power_switching; // 1 while waiting out the dead time
+
+// Charging kept up while the pump was running
+extern volatile unsigned int power_cycle_seconds; // last pump cycle: seconds the panel stayed connected
+extern volatile unsigned int power_cycle_panel; // last pump cycle: average panel reading while connected
+extern volatile unsigned long power_recovered_seconds; // total over all pump cycles
+
+// Set up the panel switch (pump has its own init)
+void power_initialize(void);
+
+// Called once a second with what the pump should be doing and the latest
+// panel reading
+void power_update(char pump_on, char panel_voltage);
+
+// Called from the timer A0 interrupt when the dead time (TA0CCR1) is over
+void power_deadtime_elapsed(void);
+
+#endif /* POWER_H_ */
@@ -0,0 +1,74 @@
+#include "profile.h"
+
+/*
+ * profile.c
+ */
+
+#ifdef ISR_PROFILING
+
+struct ProfileStats profile_stats[ProfileCount];
+const char * const profile_names[ProfileCount] = { "Uart", "Tick", "Oneshot", "TA1", "Pwm", "Adc", "Rtc", "Latency" };
+
+void profile_initialize(void)
+{
+  profile_reset();
+
+  // SMCLK (1048576 Hz), continuous, probe on CCR0
+  TB0CTL = TBCLR;
+  TB0CCR0 = PROFILE_PROBE_PERIOD;
+  TB0CCTL0 = CCIE;
+  TB0CTL = TBSSEL__SMCLK | MC__CONTINUOUS;
+}
+
+void profile_reset(void)
+{
+  unsigned char i;
+  unsigned char j;
+
+  for(i = 0; i < ProfileCount; ++i)
+  {
+    profile_stats[i].count = 0;
+    profile_stats[i].min = 0xFFFF;
+    profile_stats[i].max = 0;
+    profile_stats[i].total = 0;
+    for(j = 0; j < PROFILE_BUCKETS; ++j)
+      profile_stats[i].histogram[j] = 0;
+  }
+}
+
+void profile_record(char id, unsigned int time)
+{
+  struct ProfileStats *stats = &profile_stats[(unsigned char)id];
+  unsigned int scaled = time >> 4; // bucket 0 is under 16, each one after that twice as wide
+  unsigned char bucket = 0;
+
+  while(scaled && bucket < PROFILE_BUCKETS - 1)
+  {
+    scaled >>= 1;
+    bucket++;
+  }
+
+  if(time < stats->min)
+    stats->min = time;
+  if(time > stats->max)
+    stats->max = time;
+  if(stats->count != 0xFFFF)
+  {
+    stats->count++;
+    stats->total += time;
+  }
+  if(stats->histogram[bucket] != 0xFFFF)
+    stats->histogram[bucket]++;
+}
+
+// Latency probe, records how late it got in (it runs for next to nothing)
+#pragma vector=TIMER0_B0_VECTOR
+__interrupt void profile_probe_interrupt_handler()
+{
+  unsigned int late = TB0R - TB0CCR0;
+
+  TB0CCR0 += PROFILE_PROBE_PERIOD;
+  profile_record(ProfileLatency, late);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * profile.h
+ *
+ * Interrupt handler timing, built in with ISR_PROFILING. Timer B0 runs free
+ * off SMCLK (~1 us a count) and every handler notes the count on the way in
+ * and out. Per handler: how many times it ran, shortest, longest, and a
+ * histogram in powers of two. A TB0CCR0 probe every PROFILE_PROBE_PERIOD
+ * counts measures latency: how late its own interrupt gets in, which is how
+ * long something else had interrupts off.
+ *
+ * At 115200 baud a byte takes ~87 us and the uart can hold two, so anything
+ * that keeps interrupts off much past ~170 us can cost us received bytes.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#define PROFILE_BUCKETS 8 // <16, <32, <64, ... <1024, 1024 and up (us)
+#define PROFILE_PROBE_PERIOD 8192 // counts between latency probes (~8 ms)
+
+enum ProfileId {
+  ProfileUart, // USCI_A0
+  ProfileTick, // TA0CCR0, the 1 second tick
+  ProfileOneshot, // TA0CCR1-4
+  ProfileTimerA1, // TA1CCR1-2
+  ProfilePwm, // TA1CCR0
+  ProfileAdc,
+  ProfileRtc,
+  ProfileLatency, // probe: how late it got in, not how long it ran
+  ProfileCount
+};
+
+struct ProfileStats {
+  unsigned int count; // stops at 0xFFFF
+  unsigned int min; // us
+  unsigned int max;
+  unsigned long total; // for the average
+  unsigned int histogram[PROFILE_BUCKETS];
+};
+
+#ifdef ISR_PROFILING
+
+extern struct ProfileStats profile_stats[ProfileCount];
+extern const char * const profile_names[ProfileCount];
+
+// Starts timer B0 and the latency probe, clears everything
+void profile_initialize(void);
+
+// Forget what's been collected
+void profile_reset(void);
+
+// Adds one run of a handler
+void profile_record(char id, unsigned int time);
+
+// First thing in a handler, and on every way out of it
+#define PROFILE_ENTER() unsigned int profile_start = TB0R
+#define PROFILE_EXIT(id) profile_record(id, TB0R - profile_start)
+#define PROFILE_RETURN(id) do { PROFILE_EXIT(id); return; } while(0)
+
+#else
+
+#define profile_initialize()
+#define profile_reset()
+#define PROFILE_ENTER()
+#define PROFILE_EXIT(id)
+#define PROFILE_RETURN(id) return
+
+#endif
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,214 @@
+#include "pump.h"
+#include "profile.h"
+#include "adc.h"
+#include "trace.h"
+
+/*
+ * pump.c
+ */
+
+volatile char pump_state;
+volatile char pump_fault;
+volatile unsigned int pump_lockout;
+volatile char pump_load_sag;
+volatile unsigned long pump_runtime;
+volatile unsigned int pump_cycles;
+
+// Pwm state (only touched by the timer interrupt once the pump is started)
+volatile char pump_duty; // on time in timer counts, out of PUMP_PWM_PERIOD
+volatile char pwm_output_high; // level of TA1.0 after the last compare
+volatile char pwm_ramp_periods; // periods since the last duty step
+volatile char pwm_sample_requested; // take a load sample in the next on phase
+volatile char pwm_sample_pending; // the next compare is the middle of the on phase
+
+// Fault detection
+volatile char pump_rest_battery; // battery reading with the pump off
+volatile char pump_loaded_battery; // battery reading mid on-phase
+volatile unsigned int dryrun_seconds;
+volatile unsigned int stall_seconds;
+
+void pump_initialize(void)
+{
+  pump_state = PumpStateOff;
+  pump_fault = PumpFaultNone;
+  pump_lockout = 0;
+  pump_load_sag = 0;
+  pump_runtime = 0;
+  pump_cycles = 0;
+  pump_rest_battery = 0;
+  pump_loaded_battery = 0;
+  dryrun_seconds = 0;
+  stall_seconds = 0;
+
+  // Pin starts out as a plain low output
+  TA1CCTL0 = OUTMOD_0; // OUT bit -> low
+  PUMPSOLAR_PORT_SEL &= ~PUMP_CONTROL;
+  PUMPSOLAR_PORT_OUT &= ~PUMP_CONTROL;
+  PUMPSOLAR_PORT_DIR |= PUMP_CONTROL;
+}
+
+void pump_start(void)
+{
+  if(pump_state != PumpStateOff)
+    return;
+
+  pump_cycles++;
+  dryrun_seconds = 0;
+  stall_seconds = 0;
+  pump_duty = PUMP_DUTY_START;
+  pwm_output_high = 0;
+  pwm_ramp_periods = 0;
+  pwm_sample_requested = 0;
+  pwm_sample_pending = 0;
+  pump_state = PumpStateRamping;
+  trace_event(TracePump, PumpStateRamping);
+
+  // Hand the pin over to the timer (output is low until the first compare)
+  TA1CCTL0 = OUTMOD_0;
+  PUMPSOLAR_PORT_SEL |= PUMP_CONTROL;
+
+  // First compare turns the pump on, then the interrupt keeps it going
+  TA1CCR0 = TA1R + PUMP_PWM_MIN_PHASE;
+  TA1CCTL0 = OUTMOD_4 | CCIE; // toggle on every compare
+}
+
+void pump_stop(void)
+{
+  TA1CCTL0 = OUTMOD_0; // stop toggling, interrupts off
+  PUMPSOLAR_PORT_OUT &= ~PUMP_CONTROL;
+  PUMPSOLAR_PORT_SEL &= ~PUMP_CONTROL; // back to gpio (low)
+  pump_state = PumpStateOff;
+  trace_event(TracePump, PumpStateOff);
+}
+
+int pump_can_run(void)
+{
+  return pump_lockout == 0;
+}
+
+int pump_is_ramping(void)
+{
+  return pump_state == PumpStateRamping;
+}
+
+void pump_tick(char battery)
+{
+  if(pump_state == PumpStateOff)
+  {
+    pump_rest_battery = battery; // nothing is loading the battery
+    if(pump_lockout)
+      pump_lockout--;
+    return;
+  }
+
+  pump_runtime++;
+
+  if(TA1CCTL0 & CCIE)
+    pwm_sample_requested = 1; // still switching, sample in the middle of an on phase
+  else
+    pump_load_sample(battery); // fully on, any reading is a loaded reading
+
+  // Only judge the load once the ramp is done
+  if(pump_state != PumpStateRunning)
+    return;
+
+  if(pump_load_sag <= PUMP_SAG_DRYRUN)
+    dryrun_seconds++;
+  else
+    dryrun_seconds = 0;
+
+  if(pump_load_sag >= PUMP_SAG_STALL)
+    stall_seconds++;
+  else
+    stall_seconds = 0;
+
+  if(dryrun_seconds >= PUMP_FAULT_SECONDS || stall_seconds >= PUMP_FAULT_SECONDS)
+  {
+    pump_fault = (stall_seconds >= PUMP_FAULT_SECONDS) ? PumpFaultStall : PumpFaultDryRun;
+    trace_event(TracePumpFault, pump_fault);
+    pump_lockout = PUMP_FAULT_LOCKOUT;
+    pump_stop();
+  }
+  else if(dryrun_seconds == 0 && stall_seconds == 0)
+    pump_fault = PumpFaultNone; // pumping normally
+}
+
+void pump_load_sample(char battery)
+{
+  pump_loaded_battery = battery;
+  if(pump_rest_battery > battery)
+    pump_load_sag = pump_rest_battery - battery;
+  else
+    pump_load_sag = 0;
+}
+
+unsigned int pump_load_current(void)
+{
+  // I = V / R, with V in mV and R in mOhm -> A, times 1000 for mA
+  return (unsigned long)pump_load_sag * BATTERY_MV_PER_COUNT * 1000 / BATTERY_RESISTANCE_MOHM;
+}
+
+
+// INTERRUPT HANDLERS =========================================================
+
+
+// TA1CCR0 only. The output unit toggles TA1.0 on each compare, this just
+// queues up the next edge.
+#pragma vector=TIMER1_A0_VECTOR
+__interrupt void pump_pwm_interrupt_handler()
+{
+  PROFILE_ENTER();
+
+  // Middle of the on phase: output was left alone, sample the battery now
+  if(pwm_sample_pending)
+  {
+    pwm_sample_pending = 0;
+    adc_start_load_conversion();
+    TA1CCTL0 = OUTMOD_4 | CCIE; // next compare turns the pump off
+    TA1CCR0 += pump_duty - pump_duty / 2;
+    PROFILE_RETURN(ProfilePwm);
+  }
+
+  pwm_output_high ^= 1;
+
+  if(pwm_output_high) // on phase just started
+  {
+    if(pwm_sample_requested)
+    {
+      pwm_sample_requested = 0;
+      pwm_sample_pending = 1;
+      TA1CCTL0 = OUTMOD_1 | CCIE; // 'set' mode, so the half-way compare keeps it on
+      TA1CCR0 += pump_duty / 2;
+    }
+    else
+      TA1CCR0 += pump_duty;
+    PROFILE_RETURN(ProfilePwm);
+  }
+
+  // Off phase just started (a full period has gone by)
+  if(pump_state == PumpStateRamping && ++pwm_ramp_periods >= PUMP_RAMP_STEP_PERIODS)
+  {
+    pwm_ramp_periods = 0;
+    pump_duty++;
+    if(pump_duty >= PUMP_DUTY_RUN)
+    {
+      pump_duty = PUMP_DUTY_RUN;
+      pump_state = PumpStateRunning;
+    }
+  }
+
+  // Fully on, or too close to fully on for the timer: just hold the pin high
+  if(pump_duty > PUMP_PWM_PERIOD - PUMP_PWM_MIN_PHASE)
+  {
+    TA1CCTL0 = OUTMOD_0;
+    PUMPSOLAR_PORT_OUT |= PUMP_CONTROL;
+    PUMPSOLAR_PORT_SEL &= ~PUMP_CONTROL;
+    pump_state = PumpStateRunning;
+    trace_event(TracePump, PumpStateRunning);
+    PROFILE_RETURN(ProfilePwm);
+  }
+
+  TA1CCR0 += PUMP_PWM_PERIOD - pump_duty;
+
+  PROFILE_EXIT(ProfilePwm);
+}
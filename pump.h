@@ -0,0 +1,61 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * pump.h
+ *
+ * Water pump driver. The pump is driven with pwm from timer A1 (CCR0 -> TA1.0
+ * on P1.7) so it can soft-start, and the battery is sampled in the middle of
+ * the on phase to estimate how much current the pump is pulling.
+ */
+
+#ifndef PUMP_H_
+#define PUMP_H_
+
+// What the pump is doing right now
+enum PumpState {
+  PumpStateOff,
+  PumpStateRamping, // soft-start, duty is going up
+  PumpStateRunning  // at PUMP_DUTY_RUN
+};
+
+// Why the pump was shut off on its own
+enum PumpFault {
+  PumpFaultNone,
+  PumpFaultDryRun, // hardly any load -> no water going through
+  PumpFaultStall   // way too much load -> rotor stuck
+};
+
+extern volatile char pump_state;
+extern volatile char pump_fault; // last fault, stays set until the pump runs fine again
+extern volatile unsigned int pump_lockout; // seconds until the pump is allowed to run again
+extern volatile char pump_load_sag; // rest battery minus loaded battery (adc counts)
+extern volatile unsigned long pump_runtime; // total seconds the pump has been on
+extern volatile unsigned int pump_cycles; // how many times the pump has been started
+
+// Set up the pump pin (timer A1 has to be running already)
+void pump_initialize(void);
+
+// Start the soft-start ramp (does nothing if already on)
+void pump_start(void);
+
+// Turn the pump off right away
+void pump_stop(void);
+
+// Returns 1 if the pump is not locked out by a fault
+int pump_can_run(void);
+
+// Returns 1 while the soft-start ramp is going
+int pump_is_ramping(void);
+
+// Called once a second with the latest battery reading; runs the dry run/stall
+// detection and may stop the pump
+void pump_tick(char battery);
+
+// Called from the adc interrupt with a battery reading taken mid on-phase
+void pump_load_sample(char battery);
+
+// Estimated pump current in mA from the last load sample
+unsigned int pump_load_current(void);
+
+#endif /* PUMP_H_ */
@@ -7,33 +7,138 @@
 
 #include "rtc.h"
 
+volatile char rtc_source;
+unsigned long rtc_last_sync; // when the time was last set from the network
+unsigned long rtc_last_attempt; // when we last asked
+
+// Days in the year before each month (not counting Feb 29)
+const unsigned int rtc_days_before[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+// Seconds since 2000-01-01 00:00 for a date (2000-2099)
+unsigned long rtc_to_seconds(unsigned int year, unsigned char month, unsigned char day,
+                             unsigned char hour, unsigned char minute, unsigned char second);
+
+// Sets the calendar (binary, not BCD)
+void rtc_set(unsigned int year, unsigned char month, unsigned char day,
+             unsigned char hour, unsigned char minute, unsigned char second);
+
+// Waits until the calendar registers are safe to read (RTCRDY drops for the
+// last ~4 ms before each update)
+#define rtc_wait_ready() while(!(RTCCTL01 & RTCRDY))
+
 void rtc_initialize()
 {
-  // Set up the timer intervals, etc... it will count by seconds
-  // (32768/256)/128 = 1
-  RTCCTL01 |= RTCSSEL__RT1PS; // source the 32bit counter from RT1PS
-  RTCPS0CTL |= RT0PSDIV_7; // divide ACLK by /256
-  RTCPS1CTL |= RT1PSDIV_6 | RT1SSEL_2; // use RT0PS for clock input, divide by 128
+  rtc_source = RtcSourceNone;
+  rtc_last_sync = 0;
+  rtc_last_attempt = 0;
 
-  // Reset the time to a day in (86400 seconds -> 0x15180)
-  RTCTIM0 = 0x5180; // low 16 bits
-  RTCTIM1 = 0x1;    // high 16 bits
+  // Still going from before a reset? Then the time is good (it only gets
+  // past RTC_YEAR_MIN by being set)
+  if((RTCCTL01 & RTCMODE) && !(RTCCTL01 & RTCHOLD) && RTCYEAR > RTC_YEAR_MIN)
+  {
+    rtc_source = RtcSourceText; // don't know how, check with the network
+    return;
+  }
 
-  // Start all the timers
-  RTCPS0CTL &= ~RT0PSHOLD;
-  RTCPS1CTL &= ~RT1PSHOLD;
-  RTCCTL01 &= ~RTCHOLD;
+  // Calendar mode counts seconds off ACLK by itself (32768 Hz crystal)
+  RTCCTL01 = RTCMODE | RTCHOLD;
+  rtc_set(RTC_YEAR_MIN, 1, 1, 0, 0, 0);
 }
 
-/*
-#pragma vector=RTC_VECTOR
-__interrupt void rtc_interrupt()
+unsigned long rtc_get_time(void)
+{
+  rtc_wait_ready();
+  return rtc_to_seconds(RTCYEAR, RTCMON, RTCDAY, RTCHOUR, RTCMIN, RTCSEC);
+}
+
+char rtc_set_from_modem(const char *stamp, char source)
 {
-  switch(RTCIV)
+  unsigned char field[6]; // yy MM dd hh mm ss
+  unsigned char i;
+
+  if(source < rtc_source)
+    return 0;
+
+  for(i = 0; i < 6; ++i)
   {
-  case RTCIV_RT1PSIFG:
-    LED_PORT_OUT ^= LED_MSP_2;
-  default:
-    break;
+    if(stamp[0] < '0' || stamp[0] > '9' || stamp[1] < '0' || stamp[1] > '9')
+      return 0;
+    field[i] = (stamp[0] - '0') * 10 + (stamp[1] - '0');
+    stamp += 3; // two digits and a separator
   }
-}*/
+
+  // Modems that haven't heard from the network say 2000 or 2004
+  if(2000 + field[0] <= RTC_YEAR_MIN || field[1] < 1 || field[1] > 12 || field[2] < 1 || field[2] > 31
+     || field[3] > 23 || field[4] > 59 || field[5] > 59)
+    return 0;
+
+  rtc_set(2000 + field[0], field[1], field[2], field[3], field[4], field[5]);
+  rtc_source = source;
+  if(source == RtcSourceNetwork)
+    rtc_last_sync = rtc_get_time();
+  return 1;
+}
+
+char rtc_sync_due(void)
+{
+  unsigned long now = rtc_get_time();
+
+  if(now - rtc_last_attempt < RTC_SYNC_RETRY)
+    return 0;
+  return rtc_source != RtcSourceNetwork || now - rtc_last_sync >= RTC_SYNC_PERIOD;
+}
+
+void rtc_sync_attempt(void)
+{
+  rtc_last_attempt = rtc_get_time();
+}
+
+void rtc_set_alarm(unsigned long seconds)
+{
+  RTCCTL01 &= ~RTCAIE;
+  RTCAMIN = (seconds / 60) % 60 | RTCAE;
+  RTCAHOUR = (seconds / 3600) % 24 | RTCAE;
+  RTCADOW = 0; // any day
+  RTCADAY = 0;
+  RTCCTL01 &= ~RTCAIFG;
+  RTCCTL01 |= RTCAIE;
+}
+
+char rtc_quiet_hours(void)
+{
+  unsigned char hour;
+
+  if(rtc_source == RtcSourceNone)
+    return 0;
+
+  rtc_wait_ready();
+  hour = RTCHOUR;
+  if(QUIET_HOURS_START > QUIET_HOURS_END) // over midnight
+    return hour >= QUIET_HOURS_START || hour < QUIET_HOURS_END;
+  return hour >= QUIET_HOURS_START && hour < QUIET_HOURS_END;
+}
+
+unsigned long rtc_to_seconds(unsigned int year, unsigned char month, unsigned char day,
+                             unsigned char hour, unsigned char minute, unsigned char second)
+{
+  unsigned int years = year - 2000;
+  unsigned long days = years * 365UL + (years + 3) / 4 + rtc_days_before[(month - 1) % 12] + day - 1;
+
+  if(years % 4 == 0 && month > 2) // this year's Feb 29
+    days++;
+  return ((days * 24 + hour) * 60 + minute) * 60 + second;
+}
+
+void rtc_set(unsigned int year, unsigned char month, unsigned char day,
+             unsigned char hour, unsigned char minute, unsigned char second)
+{
+  RTCCTL01 |= RTCHOLD;
+  RTCYEAR = year;
+  RTCMON = month;
+  RTCDAY = day;
+  RTCDOW = (rtc_to_seconds(year, month, day, 0, 0, 0) / 86400 + 6) % 7; // 2000-01-01 was a Saturday
+  RTCHOUR = hour;
+  RTCMIN = minute;
+  RTCSEC = second;
+  RTCCTL01 &= ~RTCHOLD;
+}
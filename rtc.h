@@ -3,6 +3,11 @@
  *
  *  Created on: Apr 20, 2016
  *      Author: User
+ *
+ * RTC in calendar mode, set from the network clock (AT+CCLK?) or, until that
+ * works, from the timestamp on a text. Times are seconds since 2000-01-01
+ * 00:00 local time (whatever zone the network reports), so they mean the same
+ * thing across resets. The daily digest is an RTC alarm.
  */
 
 #include "msp430f5529.h"
@@ -11,6 +16,33 @@
 #ifndef RTC_H_
 #define RTC_H_
 
+// Where the time came from
+enum RtcSource {
+  RtcSourceNone, // never set, counting from RTC_YEAR_MIN
+  RtcSourceText, // timestamp on a text (when the service centre got it, may be old)
+  RtcSourceNetwork // modem clock, set by the network (AT+CLTS=1)
+};
+extern volatile char rtc_source;
+
+// Starts the calendar (left alone if it kept running through a reset)
 void rtc_initialize(void);
 
+// Seconds since 2000-01-01 00:00
+unsigned long rtc_get_time(void);
+
+// Sets the calendar from a modem timestamp "yy/MM/dd,hh:mm:ss" (zone is left
+// off), returns 1 if it looked right. Doesn't replace a better source.
+char rtc_set_from_modem(const char *stamp, char source);
+
+// Time to ask the modem for the time again (not set from the network yet, or
+// it's been RTC_SYNC_PERIOD), and marking that we asked
+char rtc_sync_due(void);
+void rtc_sync_attempt(void);
+
+// Daily alarm at seconds into the day (goes by the minute)
+void rtc_set_alarm(unsigned long seconds);
+
+// Between QUIET_HOURS_START and QUIET_HOURS_END (never before the time is known)
+char rtc_quiet_hours(void);
+
 #endif /* RTC_H_ */
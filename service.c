@@ -0,0 +1,768 @@
+#include "service.h"
+#include "uart.h"
+#include "flash.h"
+#include "pump.h"
+#include "floatswitch.h"
+#include "network.h"
+#include "datalog.h"
+#include "rtc.h"
+#include "warm.h"
+#include "profile.h"
+#include "trace.h"
+#include "stack.h"
+#include "bench.h"
+#include "capture.h"
+#include "charge.h"
+#include "adc.h"
+#include "update.h"
+#include <string.h>
+#ifdef USB_SERVICE_PORT
+#include "USB_API/USB_Common/device.h"
+#include "USB_API/USB_Common/usb.h"
+#include "USB_API/USB_CDC_API/UsbCdc.h"
+#include "USB_config/descriptors.h"
+#endif
+
+/*
+ * service.c
+ */
+
+// Kept by main.c
+extern volatile char battery_charge;
+extern volatile char solarpanel_voltage;
+extern volatile char floatswitches;
+extern char phone_number[MAX_PHONE_LENGTH];
+extern volatile unsigned long digest_time;
+
+volatile char service_connected;
+
+// Output waiting to go out, sent in order (text replies, or straight out of
+// the log bank)
+struct ServicePiece {
+  const char *data;
+  unsigned int length;
+};
+struct ServicePiece service_queue[SERVICE_QUEUE_SIZE];
+unsigned char service_queue_head;
+unsigned char service_queue_count;
+
+// Buffers go in the part of USBRAM the endpoints don't use (.usbram in the
+// linker file) so they don't come out of main RAM
+#pragma DATA_SECTION(service_text, ".usbram")
+char service_text[SERVICE_TEXT_SIZE]; // reply being put together
+#pragma DATA_SECTION(service_line, ".usbram")
+char service_line[SERVICE_LINE_SIZE]; // command being put together
+#pragma DATA_SECTION(service_rx, ".usbram")
+char service_rx[SERVICE_RX_SIZE]; // bytes from the host
+unsigned char service_line_length;
+unsigned char service_rx_length; // bytes in service_rx
+unsigned char service_rx_index; // next one to look at
+
+const char service_help[] = "live, diag, ram, log, trace [flash|save], phone <number>, digest <seconds>, update [check], key <hex>\r\n";
+const char service_log_end[] = "\r\nend\r\n";
+
+// Forget queued output and half read commands
+void service_reset(void);
+
+// Carries out one command line
+void service_command(char *line);
+
+// Command replies (into service_text)
+void service_live(void);
+void service_diag(void);
+void service_phone(const char *number);
+void service_digest(const char *seconds);
+void service_update(const char *which);
+void service_key(const char *hex);
+#ifdef ISR_PROFILING
+void service_isr(const char *which);
+#endif
+#ifdef BENCHMARK
+void service_bench(void);
+#endif
+#ifdef UART_CAPTURE
+void service_capture(const char *which);
+void service_replay(const char *speed);
+#endif
+
+// Queues the log dump (header, records, end marker)
+void service_log(void);
+
+// Trace dumps (raw TraceRecords), or copying the ring to flash
+void service_trace(const char *which);
+
+// Static RAM by section, stack use
+void service_ram(void);
+
+// Adds a piece of output (data has to stay put until it's sent)
+void service_queue_add(const char *data, unsigned int length);
+
+// Adds to service_text
+void service_print(const char *text);
+void service_print_number(unsigned long value);
+
+// USB side
+void service_usb_initialize(void);
+char service_usb_busy(void); // last write is still going out
+unsigned int service_usb_read(char *buffer, unsigned int max);
+char service_usb_write(const char *data, unsigned int length); // 1 -> taken (goes out in the background)
+
+void service_initialize(void)
+{
+  service_connected = 0;
+  service_reset();
+  service_usb_initialize();
+}
+
+char service_tick(void)
+{
+#ifdef USB_SERVICE_PORT
+  service_connected = (USBPWRCTL & USBBGVBV) ? 1 : 0;
+#endif
+  return service_connected;
+}
+
+void service_poll(void)
+{
+  // Whatever was going out went with the cable
+  if(!service_connected)
+  {
+    service_reset();
+    return;
+  }
+
+  // Output first, one piece after the other
+  if(service_usb_busy())
+    return;
+  if(service_queue_count)
+  {
+    struct ServicePiece *piece = &service_queue[service_queue_head];
+
+    if(service_usb_write(piece->data, piece->length))
+    {
+      service_queue_head = (service_queue_head + 1) % SERVICE_QUEUE_SIZE;
+      service_queue_count--;
+    }
+    return;
+  }
+
+  // Then the next command (only one, its reply has to be out before
+  // service_text gets used again)
+  for(;;)
+  {
+    char c;
+
+    if(service_rx_index == service_rx_length)
+    {
+      service_rx_length = service_usb_read(service_rx, SERVICE_RX_SIZE);
+      service_rx_index = 0;
+      if(!service_rx_length)
+        return;
+    }
+
+    c = service_rx[service_rx_index++];
+    if(c == '\r' || c == '\n')
+    {
+      if(!service_line_length) // blank line, or the \n of \r\n
+        continue;
+      service_line[service_line_length] = '\0';
+      service_line_length = 0;
+      service_command(service_line);
+      return;
+    }
+    if(service_line_length < SERVICE_LINE_SIZE - 1) // too long gets cut off (and won't match)
+      service_line[service_line_length++] = c;
+  }
+}
+
+void service_reset(void)
+{
+  service_queue_head = 0;
+  service_queue_count = 0;
+  service_line_length = 0;
+  service_rx_length = 0;
+  service_rx_index = 0;
+}
+
+void service_command(char *line)
+{
+  STACK_MARK(StackService);
+  service_text[0] = '\0';
+
+  if(strcmp(line, "log") == 0)
+  {
+    service_log();
+    return;
+  }
+  if(strncmp(line, "trace", 5) == 0)
+  {
+    service_trace(line + 5);
+    return;
+  }
+
+  if(strcmp(line, "live") == 0)
+    service_live();
+  else if(strcmp(line, "diag") == 0)
+    service_diag();
+  else if(strcmp(line, "ram") == 0)
+    service_ram();
+  else if(strncmp(line, "phone ", 6) == 0)
+    service_phone(line + 6);
+  else if(strncmp(line, "digest ", 7) == 0)
+    service_digest(line + 7);
+  else if(strncmp(line, "update", 6) == 0)
+    service_update(line + 6);
+  else if(strncmp(line, "key ", 4) == 0)
+    service_key(line + 4);
+#ifdef ISR_PROFILING
+  else if(strncmp(line, "isr", 3) == 0)
+    service_isr(line + 3);
+#endif
+#ifdef BENCHMARK
+  else if(strcmp(line, "bench") == 0)
+    service_bench();
+#endif
+#ifdef UART_CAPTURE
+  else if(strncmp(line, "capture", 7) == 0)
+  {
+    service_capture(line + 7);
+    if(strcmp(line + 7, " dump") == 0)
+      return; // queued its own output
+  }
+  else if(strncmp(line, "replay", 6) == 0)
+    service_replay(line + 6);
+#endif
+  else
+    service_print(service_help);
+
+  service_queue_add(service_text, strlen(service_text));
+}
+
+void service_live(void)
+{
+  service_print("Bat ");
+  service_print_number((unsigned long)(unsigned char)battery_charge * BATTERY_MV_PER_COUNT);
+  service_print("mV Temp ");
+  if(adc_temperature < 0)
+    service_print("-");
+  service_print_number(adc_temperature < 0 ? -adc_temperature : adc_temperature);
+  service_print("C Panel ");
+  service_print_number((unsigned char)solarpanel_voltage);
+  service_print(" Switches ");
+  service_print_number((unsigned char)floatswitches);
+  service_print(" Level ");
+  if(floatswitch_level < 0)
+    service_print("?");
+  else
+    service_print_number(floatswitch_level);
+  service_print("\r\nPump ");
+  service_print_number(pump_state);
+  service_print(" Sag ");
+  service_print_number((unsigned char)pump_load_sag);
+  service_print(" Lockout ");
+  service_print_number(pump_lockout);
+  service_print("s Runtime ");
+  service_print_number(pump_runtime);
+  service_print("s Starts ");
+  service_print_number(pump_cycles);
+  service_print("\r\nCharge ");
+  service_print(charge_stage == ChargeBulk ? "bulk" : charge_stage == ChargeAbsorb ? "absorption" : "float");
+  service_print(" duty ");
+  service_print_number((unsigned long)charge_duty * 100 / CHARGE_PWM_PERIOD);
+  service_print("% on ");
+  service_print_number(charge_on_seconds);
+  service_print("s\r\n");
+}
+
+void service_diag(void)
+{
+  // Modem link: speed, overruns, framing errors, dropped bytes
+  service_print("Uart ");
+  service_print(uart_bauds[uart_baud_index].name);
+  service_print(" OE ");
+  service_print_number(uart_overrun_count);
+  service_print(" FE ");
+  service_print_number(uart_framing_count);
+  service_print(" Drop ");
+  service_print_number(uart_dropped_count);
+  service_print("\r\n");
+
+  // Network: registration, signal, failed/tried texts, registration lost, waiting on coverage
+  service_print("Net ");
+  service_print_number(network_registration);
+  service_print(" CSQ ");
+  service_print_number(network_rssi);
+  service_print(" Fail ");
+  service_print_number(network_send_failures);
+  service_print("/");
+  service_print_number(network_send_attempts);
+  service_print(" Lost ");
+  service_print_number(network_lost_count);
+  service_print(" Deferred ");
+  service_print_number(network_deferred_seconds);
+  service_print("s\r\n");
+
+  // History log: records kept, not uploaded yet, next sequence
+  service_print("Log ");
+  service_print_number(datalog_count);
+  service_print(" Pending ");
+  service_print_number(datalog_pending);
+  service_print(" Next ");
+  service_print_number(datalog_next_sequence);
+  service_print("\r\n");
+
+  // Float switches we don't trust, last pump fault
+  service_print("Float stuck on ");
+  service_print_number((unsigned char)floatswitch_suspect_high);
+  service_print(" off ");
+  service_print_number((unsigned char)floatswitch_suspect_low);
+  service_print(" Pump fault ");
+  service_print_number(pump_fault);
+  service_print("\r\nPhone ");
+  service_print(phone_number[0] != '\0' ? phone_number : "none");
+  service_print(" Digest ");
+  service_print_number(digest_time);
+  service_print("\r\nClock ");
+  service_print_number(rtc_get_time());
+  service_print(rtc_source == RtcSourceNetwork ? " network" : rtc_source == RtcSourceText ? " text" : " unset");
+  service_print("\r\n");
+
+  // Resets since power up, why the last one, how long it took to get going
+  service_print("Resets ");
+  service_print_number(warm_state.resets);
+  service_print(" Cause ");
+  service_print_number(warm_state.reset_cause);
+  service_print(" Boot ");
+  service_print_number(warm_state.boot_ms);
+  service_print("ms\r\n");
+}
+
+void service_ram(void)
+{
+  static const char * const names[StackSiteCount] = { "Main", "Tick", "Uart", "Inbox", "Report", "Service", "Flash" };
+  unsigned char i;
+
+  // Statics (bytes), then the stack: deepest so far and what's left under it
+  service_print("Bss ");
+  service_print_number(&bss_end - &bss_start);
+  service_print(" Data ");
+  service_print_number(&data_end - &data_start);
+  service_print(" Noinit ");
+  service_print_number(&noinit_end - &noinit_start);
+  service_print(" Sysmem ");
+  service_print_number(&sysmem_end - &sysmem_start);
+  service_print("\r\nStack ");
+  service_print_number(stack_used());
+  service_print(" Free ");
+  service_print_number(stack_headroom());
+  if(stack_headroom() < STACK_HEADROOM_MIN)
+    service_print(" LOW");
+
+  // How deep each site has started out
+  service_print("\r\nDepth");
+  for(i = 0; i < StackSiteCount; ++i)
+  {
+    service_print(" ");
+    service_print(names[i]);
+    service_print(" ");
+    service_print_number(stack_depth(i));
+  }
+  service_print("\r\n");
+}
+
+void service_log(void)
+{
+  const char *first;
+  const char *second;
+  unsigned int first_count;
+  unsigned int second_count;
+
+  // Oldest records up to the end of the bank, then the ones at the start
+  first_count = datalog_span(0, &first);
+  second_count = datalog_span(first_count, &second);
+
+  service_print("log ");
+  service_print_number(first_count + second_count);
+  service_print(" x ");
+  service_print_number(sizeof(struct DatalogRecord));
+  service_print("\r\n");
+
+  service_queue_add(service_text, strlen(service_text));
+  service_queue_add(first, first_count * sizeof(struct DatalogRecord));
+  service_queue_add(second, second_count * sizeof(struct DatalogRecord));
+  service_queue_add(service_log_end, sizeof(service_log_end) - 1);
+}
+
+// "trace": the RAM ring, "trace flash": what the last flush saved,
+// "trace save": flush now. Dumps are like the log's: a "trace <n> x <size>"
+// line, the records oldest first, then "end"
+void service_trace(const char *which)
+{
+  const char *first;
+  const char *second;
+  unsigned int first_count;
+  unsigned int second_count;
+
+  if(strcmp(which, " save") == 0)
+  {
+    trace_flush();
+    service_print("Saved\r\n");
+    service_queue_add(service_text, strlen(service_text));
+    return;
+  }
+
+  if(strcmp(which, " flash") == 0)
+  {
+    // Whole segment, blank records and all (event TRACE_BLANK)
+    first = TRACE_ADDRESS;
+    first_count = TRACE_RECORDS;
+    second = 0;
+    second_count = 0;
+  }
+  else
+  {
+    first_count = trace_span(0, &first);
+    second_count = trace_span(first_count, &second);
+  }
+
+  service_print("trace ");
+  service_print_number(first_count + second_count);
+  service_print(" x ");
+  service_print_number(sizeof(struct TraceRecord));
+  service_print("\r\n");
+
+  service_queue_add(service_text, strlen(service_text));
+  service_queue_add(first, first_count * sizeof(struct TraceRecord));
+  service_queue_add(second, second_count * sizeof(struct TraceRecord));
+  service_queue_add(service_log_end, sizeof(service_log_end) - 1);
+}
+
+void service_phone(const char *number)
+{
+  unsigned int length = strlen(number);
+  unsigned int i;
+
+  // Same rules as the saved number at startup: +1 and then digits
+  if(strncmp(number, "+1", 2) != 0 || length >= MAX_PHONE_LENGTH)
+  {
+    service_print("bad number\r\n");
+    return;
+  }
+  for(i = 1; i < length; ++i)
+  {
+    if(number[i] < '0' || number[i] > '9')
+    {
+      service_print("bad number\r\n");
+      return;
+    }
+  }
+
+  memset(phone_number, '\0', MAX_PHONE_LENGTH);
+  strncpy(phone_number, number, MAX_PHONE_LENGTH);
+  flash_erase(PHONE_ADDRESS);
+  flash_write_phone_number(phone_number, MAX_PHONE_LENGTH);
+  service_print("ok\r\n");
+}
+
+void service_digest(const char *seconds)
+{
+  unsigned long value = 0;
+
+  if(*seconds < '0' || *seconds > '9')
+  {
+    service_print("bad time\r\n");
+    return;
+  }
+  while(*seconds >= '0' && *seconds <= '9' && value < 86400)
+    value = value * 10 + (*seconds++ - '0');
+  if(*seconds != '\0' || value >= 86400)
+  {
+    service_print("bad time\r\n");
+    return;
+  }
+
+  digest_time = value; // until the next restart
+  rtc_set_alarm(digest_time);
+  service_print("ok\r\n");
+}
+
+void service_update(const char *which)
+{
+  if(strcmp(which, " check") == 0)
+    update_check(); // goes with the next upload session
+
+  service_print("Fw ");
+  service_print_number(update_image_crc);
+  service_print(" Update ");
+  service_print_number(update_state);
+  service_print(" Patch ");
+  service_print_number(update_received);
+  service_print(" Image ");
+  service_print_number(update_written);
+  service_print("/");
+  service_print_number(UPDATE_IMAGE_SIZE);
+  service_print(update_key_present() ? " Key\r\n" : " No key\r\n");
+}
+
+void service_key(const char *hex)
+{
+  if(update_key_set(hex))
+    service_print("ok\r\n");
+  else
+    service_print("bad key\r\n");
+}
+
+#ifdef ISR_PROFILING
+// "isr": count, shortest, longest for every handler
+// "isr <n>": histogram of handler n (under 16us, under 32us, ... 1024us and up)
+// "isr reset": start over
+void service_isr(const char *which)
+{
+  unsigned char i;
+
+  if(strcmp(which, " reset") == 0)
+  {
+    profile_reset();
+    service_print("Cleared\r\n");
+    return;
+  }
+
+  if(*which == ' ' && which[1] >= '0' && which[1] < '0' + ProfileCount)
+  {
+    struct ProfileStats *stats = &profile_stats[which[1] - '0'];
+
+    service_print(profile_names[which[1] - '0']);
+    for(i = 0; i < PROFILE_BUCKETS; ++i)
+    {
+      service_print(" ");
+      service_print_number(stats->histogram[i]);
+    }
+    service_print("\r\n");
+    return;
+  }
+
+  for(i = 0; i < ProfileCount; ++i)
+  {
+    service_print_number(i);
+    service_print(" ");
+    service_print(profile_names[i]);
+    service_print(" ");
+    service_print_number(profile_stats[i].count);
+    service_print(" ");
+    service_print_number(profile_stats[i].count ? profile_stats[i].min : 0);
+    service_print("-");
+    service_print_number(profile_stats[i].max);
+    service_print("us\r\n");
+  }
+}
+#endif
+
+#ifdef BENCHMARK
+// "bench": cycles per kernel against the baseline, then the numbers as a
+// line to paste into bench_baseline once they're taken as good
+void service_bench(void)
+{
+  unsigned char i;
+
+  for(i = 0; i < BenchCount; ++i)
+  {
+    service_print(bench_names[i]);
+    service_print(" ");
+    service_print_number(bench_cycles[i]);
+    service_print(" base ");
+    service_print_number(bench_baseline[i]);
+    if(bench_slower & (1 << i))
+      service_print(" SLOWER");
+    service_print("\r\n");
+  }
+
+  service_print("{");
+  for(i = 0; i < BenchCount; ++i)
+  {
+    service_print(i ? ", " : " ");
+    service_print_number(bench_cycles[i]);
+  }
+  service_print(" }\r\n");
+}
+#endif
+
+#ifdef UART_CAPTURE
+// "capture start", "capture stop", "capture dump" (raw CaptureRecords, like
+// the log), "capture": where it's at and how the last replay went
+void service_capture(const char *which)
+{
+  if(strcmp(which, " start") == 0)
+  {
+    service_print(capture_start() ? "Recording\r\n" : "Busy\r\n");
+    return;
+  }
+  if(strcmp(which, " stop") == 0)
+    capture_stop();
+  else if(strcmp(which, " dump") == 0)
+  {
+    service_print("capture ");
+    service_print_number(capture_count);
+    service_print(" x ");
+    service_print_number(sizeof(struct CaptureRecord));
+    service_print("\r\n");
+    service_queue_add(service_text, strlen(service_text));
+    service_queue_add((const char *)capture_records, capture_count * sizeof(struct CaptureRecord));
+    service_queue_add(service_log_end, sizeof(service_log_end) - 1);
+    return;
+  }
+
+  service_print("Records ");
+  service_print_number(capture_count);
+  service_print(capture_state == CaptureRecording ? " recording" : capture_state == CaptureReplaying ? " replaying" : "");
+  service_print("\r\n");
+  if(capture_state != CaptureReplayed)
+    return;
+
+  // Commands/results that differ (and the first one's record), bytes fed
+  // too fast, fullest rx buffer, command turnaround in ms
+  service_print("Mismatches ");
+  service_print_number(replay_mismatches);
+  if(replay_mismatches)
+  {
+    service_print(" at ");
+    service_print_number(replay_first_mismatch);
+  }
+  service_print(" Overruns ");
+  service_print_number(replay_overruns);
+  service_print(" Rx peak ");
+  service_print_number(replay_rx_peak);
+  service_print("\r\nCommand ms avg ");
+  service_print_number(replay_latency_count ? replay_latency_total * 1000 / 32768 / replay_latency_count : 0);
+  service_print(" max ");
+  service_print_number((unsigned long)replay_latency_max * 1000 / 32768);
+#ifdef ISR_PROFILING
+  service_print("\r\nIsr cycles/byte avg ");
+  service_print_number(profile_stats[ProfileUart].count ? profile_stats[ProfileUart].total / profile_stats[ProfileUart].count : 0);
+  service_print(" max ");
+  service_print_number(profile_stats[ProfileUart].max);
+#endif
+  service_print("\r\n");
+}
+
+// "replay <speed>": 1 is as recorded, 10 is ten times as fast
+void service_replay(const char *speed)
+{
+  unsigned char value = 0;
+
+  while(*speed == ' ')
+    speed++;
+  while(*speed >= '0' && *speed <= '9')
+    value = value * 10 + (*speed++ - '0');
+
+  service_print(replay_start(value) ? "Replaying\r\n" : "Nothing to replay, or busy\r\n");
+}
+#endif
+
+void service_queue_add(const char *data, unsigned int length)
+{
+  if(!length || service_queue_count >= SERVICE_QUEUE_SIZE)
+    return;
+  service_queue[(service_queue_head + service_queue_count) % SERVICE_QUEUE_SIZE].data = data;
+  service_queue[(service_queue_head + service_queue_count) % SERVICE_QUEUE_SIZE].length = length;
+  service_queue_count++;
+}
+
+void service_print(const char *text)
+{
+  strncat(service_text, text, SERVICE_TEXT_SIZE - 1 - strlen(service_text));
+}
+
+void service_print_number(unsigned long value)
+{
+  char digits[11];
+  int i = sizeof(digits) - 1;
+
+  digits[i] = '\0';
+  do
+  {
+    digits[--i] = '0' + value % 10;
+    value /= 10;
+  } while(value);
+
+  service_print(&digits[i]);
+}
+
+#ifdef USB_SERVICE_PORT
+
+// Raises the core voltage one level (has to go up a step at a time, SVS/SVM
+// high side first, then the core, then the low side)
+void service_core_level(unsigned char level)
+{
+  PMMCTL0_H = PMMPW_H; // unlock
+  SVSMHCTL = SVSHE | SVSHRVL0 * level | SVMHE | SVSMHRRL0 * level;
+  SVSMLCTL = SVSLE | SVMLE | SVSMLRRL0 * level;
+  while(!(PMMIFG & SVSMLDLYIFG));
+  PMMIFG &= ~(SVMLVLRIFG | SVMLIFG);
+  PMMCTL0_L = PMMCOREV0 * level;
+  if(PMMIFG & SVMLIFG) // wait for the core to get there
+    while(!(PMMIFG & SVMLVLRIFG));
+  SVSMLCTL = SVSLE | SVSLRVL0 * level | SVMLE | SVSMLRRL0 * level;
+  PMMCTL0_H = 0x00; // lock
+}
+
+void service_usb_initialize(void)
+{
+  service_core_level(1);
+  service_core_level(2);
+
+  // XT2 pins (P5.2/P5.3), the USB API starts the crystal and the PLL itself
+  P5SEL |= BIT2 | BIT3;
+
+  // Connects by itself when VBUS shows up (and lets go when it's gone)
+  USB_setup(TRUE, TRUE);
+}
+
+char service_usb_busy(void)
+{
+  uint16_t sent;
+  uint16_t received;
+
+  return (USBCDC_getInterfaceStatus(CDC0_INTFNUM, &sent, &received) & kUSBCDC_waitingForSend) ? 1 : 0;
+}
+
+unsigned int service_usb_read(char *buffer, unsigned int max)
+{
+  if(USB_getConnectionState() != ST_ENUM_ACTIVE)
+    return 0;
+  return USBCDC_receiveDataInBuffer((uint8_t *)buffer, max, CDC0_INTFNUM);
+}
+
+char service_usb_write(const char *data, unsigned int length)
+{
+  uint8_t result;
+
+  if(USB_getConnectionState() != ST_ENUM_ACTIVE)
+    return 0;
+  result = USBCDC_sendData((const uint8_t *)data, length, CDC0_INTFNUM);
+  return result == kUSBCDC_sendStarted || result == kUSBCDC_sendComplete;
+}
+
+#else
+
+// No USB stack built in: the port never comes up
+
+void service_usb_initialize(void)
+{
+}
+
+char service_usb_busy(void)
+{
+  return 0;
+}
+
+unsigned int service_usb_read(char *buffer, unsigned int max)
+{
+  return 0;
+}
+
+char service_usb_write(const char *data, unsigned int length)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * service.h
+ *
+ * Service port for whoever is standing at the pump with a laptop. With a USB
+ * cable plugged in (VBUS shows up) the F5529's USB module comes up as a CDC
+ * serial port that takes one command a line:
+ *   live            readings right now
+ *   diag            counters (the Diag text and then some)
+ *   ram             static RAM by section, stack depth and what's left
+ *   log             the whole history log, as raw DatalogRecords, oldest first
+ *   trace           the event trace, as raw TraceRecords ("trace flash" for
+ *                   the copy in flash, "trace save" to make one)
+ *   isr             handler timing, with ISR_PROFILING ("isr <n>", "isr reset")
+ *   bench           startup cycle counts, with BENCHMARK
+ *   capture         modem traffic recording, with UART_CAPTURE ("capture
+ *                   start|stop|dump", "replay <speed>", see capture.h)
+ *   phone <number>  save a new phone number (like +14445556666)
+ *   digest <secs>   seconds into the day the digest goes out
+ *   update          firmware update progress ("update check" asks the
+ *                   collector at the next upload session)
+ *   key <hex>       save the update key (64 hex digits, see update.h)
+ * Nobody minds the current while a laptop is plugged in, so the main loop
+ * stays awake then and output goes out as fast as the host takes it.
+ *
+ * The CDC class itself is TI's USB API (USB_API/ and a USB_config/ made with
+ * the descriptor tool, endpoint buffers at START_OF_USB_BUFFER 0x1C00), it
+ * goes in with USB_SERVICE_PORT. USB needs XT2 (4 MHz) for its PLL and core
+ * voltage level 2, which service_initialize sets up.
+ */
+
+#ifndef SERVICE_H_
+#define SERVICE_H_
+
+#define SERVICE_LINE_SIZE 72 // longest command (key <64 hex digits>)
+#define SERVICE_RX_SIZE 32 // bytes read from the host at a time
+#define SERVICE_TEXT_SIZE 256 // longest text reply
+#define SERVICE_QUEUE_SIZE 4 // pieces of output waiting (a log dump takes all 4)
+
+extern volatile char service_connected; // VBUS is there
+
+// Powers up the USB module (if it's built in); it connects by itself once
+// VBUS shows up
+void service_initialize(void);
+
+// Called once a second, watches VBUS. Returns 1 while connected (main loop
+// shouldn't sleep then)
+char service_tick(void);
+
+// Called from the main loop: sends queued output, then takes the next command
+void service_poll(void);
+
+#endif /* SERVICE_H_ */
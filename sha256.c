@@ -0,0 +1,110 @@
+#include "sha256.h"
+#include <string.h>
+
+/*
+ * sha256.c
+ */
+
+const unsigned long sha256_k[64] = {
+  0x428A2F98UL, 0x71374491UL, 0xB5C0FBCFUL, 0xE9B5DBA5UL, 0x3956C25BUL, 0x59F111F1UL, 0x923F82A4UL, 0xAB1C5ED5UL,
+  0xD807AA98UL, 0x12835B01UL, 0x243185BEUL, 0x550C7DC3UL, 0x72BE5D74UL, 0x80DEB1FEUL, 0x9BDC06A7UL, 0xC19BF174UL,
+  0xE49B69C1UL, 0xEFBE4786UL, 0x0FC19DC6UL, 0x240CA1CCUL, 0x2DE92C6FUL, 0x4A7484AAUL, 0x5CB0A9DCUL, 0x76F988DAUL,
+  0x983E5152UL, 0xA831C66DUL, 0xB00327C8UL, 0xBF597FC7UL, 0xC6E00BF3UL, 0xD5A79147UL, 0x06CA6351UL, 0x14292967UL,
+  0x27B70A85UL, 0x2E1B2138UL, 0x4D2C6DFCUL, 0x53380D13UL, 0x650A7354UL, 0x766A0ABBUL, 0x81C2C92EUL, 0x92722C85UL,
+  0xA2BFE8A1UL, 0xA81A664BUL, 0xC24B8B70UL, 0xC76C51A3UL, 0xD192E819UL, 0xD6990624UL, 0xF40E3585UL, 0x106AA070UL,
+  0x19A4C116UL, 0x1E376C08UL, 0x2748774CUL, 0x34B0BCB5UL, 0x391C0CB3UL, 0x4ED8AA4AUL, 0x5B9CCA4FUL, 0x682E6FF3UL,
+  0x748F82EEUL, 0x78A5636FUL, 0x84C87814UL, 0x8CC70208UL, 0x90BEFFFAUL, 0xA4506CEBUL, 0xBEF9A3F7UL, 0xC67178F2UL
+};
+
+#define sha256_ror(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Runs the block through the compression function
+void sha256_block(struct Sha256 *sha);
+
+void sha256_start(struct Sha256 *sha)
+{
+  sha->state[0] = 0x6A09E667UL;
+  sha->state[1] = 0xBB67AE85UL;
+  sha->state[2] = 0x3C6EF372UL;
+  sha->state[3] = 0xA54FF53AUL;
+  sha->state[4] = 0x510E527FUL;
+  sha->state[5] = 0x9B05688CUL;
+  sha->state[6] = 0x1F83D9ABUL;
+  sha->state[7] = 0x5BE0CD19UL;
+  sha->length = 0;
+  sha->used = 0;
+}
+
+void sha256_add(struct Sha256 *sha, const void *data, unsigned int length)
+{
+  const unsigned char *p = data;
+
+  sha->length += length;
+  while(length--)
+  {
+    sha->block[sha->used++] = *p++;
+    if(sha->used == SHA256_BLOCK)
+    {
+      sha256_block(sha);
+      sha->used = 0;
+    }
+  }
+}
+
+void sha256_finish(struct Sha256 *sha, unsigned char *digest)
+{
+  unsigned long bits = sha->length << 3; // images are well under 512 MB
+  char i;
+
+  sha->block[sha->used++] = 0x80;
+  if(sha->used > SHA256_BLOCK - 8)
+  {
+    memset(sha->block + sha->used, 0, SHA256_BLOCK - sha->used);
+    sha256_block(sha);
+    sha->used = 0;
+  }
+  memset(sha->block + sha->used, 0, SHA256_BLOCK - 4 - sha->used);
+  for(i = 0; i < 4; ++i)
+    sha->block[SHA256_BLOCK - 1 - i] = bits >> (8 * i);
+  sha256_block(sha);
+
+  for(i = 0; i < SHA256_SIZE; ++i)
+    digest[i] = sha->state[i >> 2] >> (24 - 8 * (i & 3));
+}
+
+void sha256_block(struct Sha256 *sha)
+{
+  unsigned long w[16];
+  unsigned long v[8];
+  unsigned long s0, s1, t1, t2;
+  char i;
+
+  for(i = 0; i < 16; ++i)
+    w[i] = (unsigned long)sha->block[4 * i] << 24 | (unsigned long)sha->block[4 * i + 1] << 16
+         | (unsigned int)sha->block[4 * i + 2] << 8 | sha->block[4 * i + 3];
+  memcpy(v, sha->state, sizeof(v));
+
+  for(i = 0; i < 64; ++i)
+  {
+    // Message schedule, rolling over the last 16 words
+    if(i >= 16)
+    {
+      s0 = w[(i + 1) & 15];
+      s1 = w[(i + 14) & 15];
+      s0 = sha256_ror(s0, 7) ^ sha256_ror(s0, 18) ^ (s0 >> 3);
+      s1 = sha256_ror(s1, 17) ^ sha256_ror(s1, 19) ^ (s1 >> 10);
+      w[i & 15] += s0 + w[(i + 9) & 15] + s1;
+    }
+
+    t1 = v[7] + (sha256_ror(v[4], 6) ^ sha256_ror(v[4], 11) ^ sha256_ror(v[4], 25))
+       + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i & 15];
+    t2 = (sha256_ror(v[0], 2) ^ sha256_ror(v[0], 13) ^ sha256_ror(v[0], 22))
+       + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+    memmove(v + 1, v, 7 * sizeof(unsigned long));
+    v[4] += t1;
+    v[0] = t1 + t2;
+  }
+
+  for(i = 0; i < 8; ++i)
+    sha->state[i] += v[i];
+}
@@ -0,0 +1,31 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * sha256.h
+ *
+ * SHA-256 (FIPS 180-4), for checking firmware update patches (update.c).
+ * Small rather than quick: 64 byte blocks, 16 word schedule on the stack,
+ * about 25 ms a block at 1 MHz.
+ */
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#define SHA256_SIZE 32 // digest bytes
+#define SHA256_BLOCK 64
+
+struct Sha256 {
+  unsigned long state[8];
+  unsigned long length; // bytes added so far
+  unsigned char block[SHA256_BLOCK]; // partial block
+  unsigned char used; // bytes of it
+};
+
+void sha256_start(struct Sha256 *sha);
+void sha256_add(struct Sha256 *sha, const void *data, unsigned int length);
+
+// Pads, puts the digest (SHA256_SIZE bytes) in digest
+void sha256_finish(struct Sha256 *sha, unsigned char *digest);
+
+#endif /* SHA256_H_ */
@@ -0,0 +1,69 @@
+#include "stack.h"
+
+/*
+ * stack.c
+ */
+
+unsigned int stack_lowest[StackSiteCount];
+
+// Where the statics end, whichever section the linker put last
+unsigned int *stack_bottom(void);
+
+// Deepest painted word that got written over
+unsigned int *stack_high_water(void);
+
+void stack_paint(void)
+{
+  unsigned int *word = stack_bottom();
+  unsigned int *sp = (unsigned int *)__get_SP_register();
+  unsigned char i;
+
+  // Below the stack pointer is free, this function's own frame is above it
+  while(word < sp)
+    *word++ = STACK_PAINT;
+
+  for(i = 0; i < StackSiteCount; ++i)
+    stack_lowest[i] = 0xFFFF;
+}
+
+unsigned int stack_used(void)
+{
+  return &stack_end - (char *)stack_high_water();
+}
+
+unsigned int stack_headroom(void)
+{
+  return (char *)stack_high_water() - (char *)stack_bottom();
+}
+
+unsigned int stack_depth(char site)
+{
+  unsigned int lowest = stack_lowest[(unsigned char)site];
+
+  if(lowest == 0xFFFF)
+    return 0;
+  return (unsigned long)&stack_end - lowest;
+}
+
+unsigned int *stack_bottom(void)
+{
+  char *end = &bss_end;
+
+  if(&data_end > end)
+    end = &data_end;
+  if(&noinit_end > end)
+    end = &noinit_end;
+  if(&sysmem_end > end)
+    end = &sysmem_end;
+
+  return (unsigned int *)(((unsigned long)end + 1) & ~1UL); // word aligned
+}
+
+unsigned int *stack_high_water(void)
+{
+  unsigned int *word = stack_bottom();
+
+  while(word < (unsigned int *)&stack_end && *word == STACK_PAINT)
+    word++;
+  return word;
+}
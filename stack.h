@@ -0,0 +1,61 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * stack.h
+ *
+ * How close the stack gets to the statics. Everything in RAM between the end
+ * of .bss/.data/.TI.noinit/.sysmem and the stack pointer gets painted with
+ * STACK_PAINT at boot; the first word that isn't the paint any more is as
+ * deep as the stack has been (interrupts on top of a report on top of the
+ * main loop and all). Some places also note the stack pointer on the way in
+ * (STACK_MARK), which shows who's deep when.
+ *
+ * The section bounds come from the linker file (RUN_START/RUN_END symbols).
+ */
+
+#ifndef STACK_H_
+#define STACK_H_
+
+#define STACK_PAINT 0xA55A
+
+// Places that note how deep the stack is when they start
+enum StackSite {
+  StackMain, // top of the main loop
+  StackTick, // timer A0, 1 second tick
+  StackUart, // uart interrupt
+  StackInbox, // inbox_parse_line
+  StackReport, // building a text
+  StackService, // service port command
+  StackFlash, // flash erase/write (interrupts are off in there)
+  StackSiteCount
+};
+
+// Linker file symbols, only their addresses mean anything
+extern char bss_start, bss_end;
+extern char data_start, data_end;
+extern char noinit_start, noinit_end;
+extern char sysmem_start, sysmem_end;
+extern char stack_end;
+
+extern unsigned int stack_lowest[StackSiteCount]; // lowest stack pointer seen at each site
+
+#define STACK_MARK(site) do { \
+    unsigned int stack_sp = __get_SP_register(); \
+    if(stack_sp < stack_lowest[site]) \
+      stack_lowest[site] = stack_sp; \
+  } while(0)
+
+// First thing in main, with interrupts off: paints the free RAM
+void stack_paint(void);
+
+// Bytes of stack used so far (the deepest it's been)
+unsigned int stack_used(void);
+
+// Bytes between the deepest the stack has been and the statics
+unsigned int stack_headroom(void);
+
+// Bytes below the top of RAM at a site's deepest (0 if it hasn't run)
+unsigned int stack_depth(char site);
+
+#endif /* STACK_H_ */
@@ -0,0 +1,143 @@
+#include "stats.h"
+
+/*
+ * stats.c
+ */
+
+struct StatsWindow stats_hour;
+struct StatsWindow stats_day;
+
+// Last STATS_HOURS finished hours (oldest at stats_next_hour once it's full)
+struct StatsWindow stats_hours[STATS_HOURS];
+unsigned char stats_next_hour;
+unsigned char stats_hours_filled;
+
+volatile unsigned int stats_hour_seconds; // seconds into stats_hour
+volatile char stats_last_pump_on;
+volatile char stats_last_warning;
+
+// Empties a window
+void stats_clear(struct StatsWindow *window);
+
+// Moves stats_hour into the ring and updates stats_day
+void stats_roll_hour(void);
+
+void stats_initialize(void)
+{
+  int i;
+
+  stats_clear(&stats_hour);
+  stats_clear(&stats_day);
+  for(i = 0; i < STATS_HOURS; ++i)
+    stats_clear(&stats_hours[i]);
+  stats_next_hour = 0;
+  stats_hours_filled = 0;
+  stats_hour_seconds = 0;
+  stats_last_pump_on = 0;
+  stats_last_warning = 0;
+}
+
+void stats_tick(char battery, char panel, char pump_on, int level, char warning)
+{
+  unsigned char bat = battery;
+  unsigned char pan = panel;
+
+  stats_hour.samples++;
+  stats_hour.battery_sum += bat;
+  stats_hour.panel_sum += pan;
+  if(bat < stats_hour.battery_min)
+    stats_hour.battery_min = bat;
+  if(bat > stats_hour.battery_max)
+    stats_hour.battery_max = bat;
+  if(pan < stats_hour.panel_min)
+    stats_hour.panel_min = pan;
+  if(pan > stats_hour.panel_max)
+    stats_hour.panel_max = pan;
+  if(level > stats_hour.level_peak)
+    stats_hour.level_peak = level;
+
+  // Count starts/warnings on the way up only
+  if(pump_on)
+  {
+    stats_hour.pump_seconds++;
+    if(!stats_last_pump_on)
+      stats_hour.pump_cycles++;
+  }
+  if(warning && !stats_last_warning)
+    stats_hour.warnings++;
+  stats_last_pump_on = pump_on;
+  stats_last_warning = warning;
+
+  if(++stats_hour_seconds >= STATS_HOUR_SECONDS)
+  {
+    stats_roll_hour();
+    stats_hour_seconds = 0;
+  }
+}
+
+unsigned char stats_battery_mean(const struct StatsWindow *window)
+{
+  return window->samples ? window->battery_sum / window->samples : 0;
+}
+
+unsigned char stats_panel_mean(const struct StatsWindow *window)
+{
+  return window->samples ? window->panel_sum / window->samples : 0;
+}
+
+void stats_clear(struct StatsWindow *window)
+{
+  window->samples = 0;
+  window->battery_sum = 0;
+  window->panel_sum = 0;
+  window->pump_seconds = 0;
+  window->pump_cycles = 0;
+  window->warnings = 0;
+  window->battery_min = 255;
+  window->battery_max = 0;
+  window->panel_min = 255;
+  window->panel_max = 0;
+  window->level_peak = 0;
+}
+
+void stats_roll_hour(void)
+{
+  struct StatsWindow *oldest = &stats_hours[stats_next_hour];
+  int i;
+
+  // Totals: take out the hour that falls off, add the new one
+  stats_day.samples += stats_hour.samples - oldest->samples;
+  stats_day.battery_sum += stats_hour.battery_sum - oldest->battery_sum;
+  stats_day.panel_sum += stats_hour.panel_sum - oldest->panel_sum;
+  stats_day.pump_seconds += stats_hour.pump_seconds - oldest->pump_seconds;
+  stats_day.pump_cycles += stats_hour.pump_cycles - oldest->pump_cycles;
+  stats_day.warnings += stats_hour.warnings - oldest->warnings;
+
+  *oldest = stats_hour;
+  if(++stats_next_hour >= STATS_HOURS)
+    stats_next_hour = 0;
+  if(stats_hours_filled < STATS_HOURS)
+    stats_hours_filled++;
+
+  // Extremes: redo them from the hours we have
+  stats_day.battery_min = 255;
+  stats_day.battery_max = 0;
+  stats_day.panel_min = 255;
+  stats_day.panel_max = 0;
+  stats_day.level_peak = 0;
+  for(i = 0; i < stats_hours_filled; ++i)
+  {
+    if(stats_hours[i].battery_min < stats_day.battery_min)
+      stats_day.battery_min = stats_hours[i].battery_min;
+    if(stats_hours[i].battery_max > stats_day.battery_max)
+      stats_day.battery_max = stats_hours[i].battery_max;
+    if(stats_hours[i].panel_min < stats_day.panel_min)
+      stats_day.panel_min = stats_hours[i].panel_min;
+    if(stats_hours[i].panel_max > stats_day.panel_max)
+      stats_day.panel_max = stats_hours[i].panel_max;
+    if(stats_hours[i].level_peak > stats_day.level_peak)
+      stats_day.level_peak = stats_hours[i].level_peak;
+  }
+
+  stats_clear(&stats_hour);
+}
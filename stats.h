@@ -0,0 +1,47 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * stats.h
+ *
+ * Running aggregates for the digest text. Every second goes into the hour
+ * being collected; finished hours go into a ring of the last 24, and the day
+ * totals are kept up to date by adding the new hour and taking out the one
+ * that dropped off, so nothing has to be added up again when the digest goes
+ * out. (Min/max can't be taken back out, those get redone from the 24 hours
+ * once an hour.)
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#define STATS_HOUR_SECONDS 3600
+#define STATS_HOURS 24
+
+struct StatsWindow {
+  unsigned long samples; // seconds in the window
+  unsigned long battery_sum;
+  unsigned long panel_sum;
+  unsigned long pump_seconds; // pump on-time
+  unsigned int pump_cycles; // pump starts
+  unsigned int warnings; // times the "not enough charge, too much water" condition came up
+  unsigned char battery_min, battery_max; // adc counts
+  unsigned char panel_min, panel_max;
+  signed char level_peak; // highest water level
+};
+
+extern struct StatsWindow stats_hour; // hour in progress
+extern struct StatsWindow stats_day; // last STATS_HOURS whole hours
+
+// Start everything empty
+void stats_initialize(void);
+
+// Called once a second from the timer A0 interrupt. warning is 1 while the
+// low battery/high water condition holds.
+void stats_tick(char battery, char panel, char pump_on, int level, char warning);
+
+// Average of a window's battery/panel readings (0 if it's empty)
+unsigned char stats_battery_mean(const struct StatsWindow *window);
+unsigned char stats_panel_mean(const struct StatsWindow *window);
+
+#endif /* STATS_H_ */
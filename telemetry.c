@@ -0,0 +1,80 @@
+#include "telemetry.h"
+#include "pump.h"
+#include "power.h"
+#include "floatswitch.h"
+#include "uart.h"
+#include "stats.h"
+#include "rtc.h"
+
+/*
+ * telemetry.c
+ */
+
+// Big endian helpers, return where the next field goes
+unsigned char *telemetry_put16(unsigned char *p, unsigned int value);
+unsigned char *telemetry_put32(unsigned char *p, unsigned long value);
+
+unsigned char telemetry_build(unsigned char *frame, char battery, char panel, char switches)
+{
+  unsigned char *p = frame;
+  unsigned char flags = telemetry_flags();
+
+  *p++ = TELEMETRY_VERSION;
+  *p++ = flags;
+  p = telemetry_put16(p, (unsigned char)battery * BATTERY_MV_PER_COUNT);
+  *p++ = panel;
+  *p++ = floatswitch_level;
+  *p++ = switches;
+  *p++ = floatswitch_suspect_high;
+  *p++ = floatswitch_suspect_low;
+  p = telemetry_put32(p, pump_runtime);
+  p = telemetry_put16(p, pump_cycles);
+  p = telemetry_put32(p, power_recovered_seconds);
+  p = telemetry_put16(p, uart_overrun_count);
+  p = telemetry_put16(p, uart_framing_count);
+  p = telemetry_put16(p, uart_dropped_count);
+  p = telemetry_put32(p, rtc_get_time());
+
+  // Day aggregates
+  p = telemetry_put16(p, stats_day.battery_min * BATTERY_MV_PER_COUNT);
+  p = telemetry_put16(p, stats_day.battery_max * BATTERY_MV_PER_COUNT);
+  p = telemetry_put16(p, stats_battery_mean(&stats_day) * BATTERY_MV_PER_COUNT);
+  *p++ = stats_day.panel_min;
+  *p++ = stats_day.panel_max;
+  *p++ = stats_panel_mean(&stats_day);
+  p = telemetry_put32(p, stats_day.pump_seconds);
+  p = telemetry_put16(p, stats_day.pump_cycles);
+  *p++ = stats_day.level_peak;
+  p = telemetry_put16(p, stats_day.warnings);
+
+  return p - frame;
+}
+
+unsigned char telemetry_flags(void)
+{
+  unsigned char flags = 0;
+
+  if(pump_state != PumpStateOff)
+    flags |= TelemetryFlagPump;
+  if(power_panel_connected)
+    flags |= TelemetryFlagPanel;
+  if(floatswitch_degraded)
+    flags |= TelemetryFlagDegraded;
+  if(pump_lockout)
+    flags |= TelemetryFlagLockout;
+  flags |= (pump_fault << 4) & TelemetryFlagFault;
+  return flags;
+}
+
+unsigned char *telemetry_put16(unsigned char *p, unsigned int value)
+{
+  *p++ = value >> 8;
+  *p++ = value & 0xFF;
+  return p;
+}
+
+unsigned char *telemetry_put32(unsigned char *p, unsigned long value)
+{
+  p = telemetry_put16(p, value >> 16);
+  return telemetry_put16(p, value & 0xFFFF);
+}
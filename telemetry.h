@@ -0,0 +1,51 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * telemetry.h
+ *
+ * Binary status frame, sent as an 8-bit PDU text instead of the English
+ * status report. All numbers are big endian.
+ *
+ *  0  version (TELEMETRY_VERSION)
+ *  1  flags (TelemetryFlag)
+ *  2  battery mV (2 bytes)
+ *  4  panel (adc counts)
+ *  5  water level (signed, -1 -> invalid)
+ *  6  float switches as read, suspect high, suspect low (1 byte each)
+ *  9  pump runtime, seconds (4 bytes)
+ * 13  pump cycles (2 bytes)
+ * 15  seconds of charging kept up while pumping (4 bytes)
+ * 19  uart overruns, framing errors, dropped bytes (2 bytes each)
+ * 25  time, seconds since 2000-01-01 local (4 bytes)
+ *
+ * Last 24 hours (stats_day):
+ * 29  battery min, max, mean mV (2 bytes each)
+ * 35  panel min, max, mean (adc counts)
+ * 38  pump on-time, seconds (4 bytes)
+ * 42  pump starts (2 bytes)
+ * 44  peak water level
+ * 45  warnings (2 bytes)
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#define TELEMETRY_VERSION 3
+#define TELEMETRY_FRAME_SIZE 47
+
+enum TelemetryFlag {
+  TelemetryFlagPump = 0x01, // pump on
+  TelemetryFlagPanel = 0x02, // panel connected
+  TelemetryFlagDegraded = 0x04, // float switches can't be fully trusted
+  TelemetryFlagLockout = 0x08, // pump locked out after a fault
+  TelemetryFlagFault = 0x30 // last PumpFault, shifted up by 4
+};
+
+// Current TelemetryFlag bits
+unsigned char telemetry_flags(void);
+
+// Fills in frame (TELEMETRY_FRAME_SIZE bytes), returns how many bytes were used
+unsigned char telemetry_build(unsigned char *frame, char battery, char panel, char switches);
+
+#endif /* TELEMETRY_H_ */
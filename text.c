@@ -0,0 +1,34 @@
+#include "text.h"
+#include "uart.h"
+#include <string.h>
+
+/*
+ * text.c
+ */
+
+void text_copy(unsigned int id)
+{
+  tx_buffer[0] = '\0';
+  text_append(id);
+}
+
+void text_append(unsigned int id)
+{
+  char *out = tx_buffer + strlen(tx_buffer);
+  char *end = tx_buffer + MAX_TX_BUFFER - 1; // room for the nul
+  const unsigned char *code = text_codes + id;
+  const char *word;
+  unsigned char c;
+
+  while((c = *code++) != 0 && out < end)
+  {
+    if(c < TEXT_WORD_FIRST)
+    {
+      *out++ = c;
+      continue;
+    }
+    for(word = text_words + text_word_offsets[c - TEXT_WORD_FIRST]; *word && out < end; ++word)
+      *out++ = *word;
+  }
+  *out = '\0';
+}
@@ -0,0 +1,25 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+#include "text_table.h"
+
+/*
+ * text.h
+ *
+ * Everything sent to the modem as text (AT commands, SMS bodies) lives in
+ * messages.txt, packed by tools/textgen.py into text_table.c: each string
+ * is a run of codes, either a character or a shared dictionary word, so
+ * the common prefixes and phrases are in flash once. The decoder expands a
+ * text straight into tx_buffer; numbers and other runtime parts still go
+ * in with tx_buffer_append_number / strcat in between.
+ */
+
+#ifndef TEXT_H_
+#define TEXT_H_
+
+// Puts a text (TextId) at the start of tx_buffer
+void text_copy(unsigned int id);
+
+// Adds a text (TextId) to the end of tx_buffer (cut short if it doesn't fit)
+void text_append(unsigned int id);
+
+#endif /* TEXT_H_ */
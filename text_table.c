@@ -0,0 +1,111 @@
+#include "text_table.h"
+
+/*
+ * text_table.c
+ *
+ * Generated by tools/textgen.py from messages.txt [en], don't edit.
+ */
+
+const unsigned char text_codes[] = {
+  0x80, 0x59, 0x8D, 0x70, 0x68, 0x6F, 0x6E, 0x65, 0x20, 0x6E, 0x75, 0x6D, 0x62, 0x65, 0x72, 0x20, 0x68, 0x61, 0x8E, 0x62, 0x65, 0x65, 0x6E, 0x20, 0x73, 0x75, 0x63, 0x63, 0x65, 0x73, 0x73, 0x66, 0x75, 0x6C, 0x6C, 0x79, 0x20, 0x63, 0x68, 0x61, 0x6E, 0x67, 0x65, 0x64, 0x2E, 0x84, 0x1A, 0x00, // 0 TextSmsEnd+45 TextCtrlZ+46 TextPhoneChanged
+  0x80, 0x43, 0x68, 0x65, 0x63, 0x6B, 0x20, 0x79, 0x8D, 0x62, 0x6F, 0x61, 0x74, 0x3B, 0x20, 0x77, 0x61, 0x74, 0x65, 0x72, 0x89, 0x69, 0x8E, 0x67, 0x65, 0x74, 0x74, 0x8C, 0x20, 0x68, 0x8B, 0x2E, 0x84, 0x1A, 0x00, // 48 TextWaterWarning
+  0x80, 0x48, 0x65, 0x72, 0x65, 0x27, 0x8E, 0x79, 0x8D, 0x90, 0x61, 0x74, 0x75, 0x8E, 0x72, 0x65, 0x70, 0x6F, 0x72, 0x74, 0x2E, 0x84, 0x00, // 83 TextNewline+21 TextStatusHeader
+  0x81, 0x45, 0x52, 0x52, 0x20, 0x49, 0x4E, 0x56, 0x41, 0x4C, 0x49, 0x44, 0x20, 0x52, 0x45, 0x41, 0x44, 0x49, 0x4E, 0x47, 0x84, 0x00, // 106 TextWaterInvalid
+  0x82, 0x49, 0x50, 0x53, 0x54, 0x41, 0x52, 0x54, 0x3D, 0x22, 0x54, 0x43, 0x50, 0x22, 0x2C, 0x22, 0x00, // 128 TextAtGprsConnect
+  0x86, 0x66, 0x66, 0x20, 0x28, 0x72, 0x75, 0x6E, 0x6E, 0x8C, 0x20, 0x64, 0x72, 0x79, 0x29, 0x00, // 145 TextPumpDryRun
+  0x53, 0x77, 0x69, 0x74, 0x63, 0x68, 0x20, 0x66, 0x61, 0x75, 0x6C, 0x74, 0x3A, 0x00, // 161 TextSwitchFault
+  0x80, 0x44, 0x61, 0x69, 0x6C, 0x79, 0x20, 0x64, 0x69, 0x67, 0x65, 0x90, 0x84, 0x00, // 175 TextDigestHeader
+  0x80, 0x44, 0x69, 0x61, 0x67, 0x6E, 0x6F, 0x90, 0x69, 0x63, 0x73, 0x84, 0x00, // 189 TextDiagHeader
+  0x86, 0x66, 0x66, 0x20, 0x28, 0x90, 0x61, 0x6C, 0x6C, 0x65, 0x64, 0x29, 0x00, // 202 TextPumpStall
+  0x53, 0x74, 0x61, 0x63, 0x6B, 0x20, 0x6C, 0x6F, 0x77, 0x20, 0x00, // 215 TextSpace+9 TextDiagStackLow
+  0x82, 0x8F, 0x4C, 0x3D, 0x22, 0x41, 0x4C, 0x4C, 0x22, 0x84, 0x00, // 226 TextAtListSms TextQuoteNewline+8
+  0x82, 0x47, 0x41, 0x54, 0x54, 0x3D, 0x31, 0x84, 0x00, // 237 TextAtGprsAttach
+  0x82, 0x49, 0x50, 0x53, 0x45, 0x4E, 0x44, 0x3D, 0x00, // 246 TextAtGprsSend
+  0x82, 0x49, 0x50, 0x53, 0x48, 0x55, 0x54, 0x84, 0x00, // 255 TextAtGprsShut
+  0x20, 0x43, 0x61, 0x75, 0x73, 0x65, 0x20, 0x00, // 264 TextDiagCause
+  0x20, 0x50, 0x65, 0x6E, 0x64, 0x8C, 0x20, 0x00, // 272 TextDiagPending
+  0x20, 0x57, 0x61, 0x72, 0x6E, 0x8C, 0x8E, 0x00, // 280 TextDigestPumpUnit+6 TextDigestWarnings
+  0x20, 0x90, 0x61, 0x72, 0x74, 0x73, 0x84, 0x00, // 288 TextDigestStarts
+  0x41, 0x54, 0x2B, 0x49, 0x50, 0x52, 0x3D, 0x00, // 296 TextAtBaud
+  0x82, 0x4C, 0x54, 0x53, 0x3D, 0x31, 0x84, 0x00, // 304 TextAtNetworkTime
+  0x82, 0x52, 0x45, 0x47, 0x3D, 0x31, 0x84, 0x00, // 312 TextAtRegistrationReports
+  0x20, 0x42, 0x6F, 0x6F, 0x74, 0x20, 0x00, // 320 TextDiagBoot
+  0x20, 0x44, 0x72, 0x6F, 0x70, 0x20, 0x00, // 327 TextDiagDropped
+  0x20, 0x46, 0x61, 0x69, 0x6C, 0x20, 0x00, // 334 TextDiagFailed
+  0x20, 0x66, 0x72, 0x65, 0x65, 0x84, 0x00, // 341 TextDiagStackUnit
+  0x50, 0x61, 0x6E, 0x65, 0x6C, 0x20, 0x00, // 348 TextDigestPanel
+  0x52, 0x65, 0x73, 0x65, 0x74, 0x8E, 0x00, // 355 TextDiagResets
+  0x81, 0x4E, 0x6F, 0x6E, 0x65, 0x84, 0x00, // 362 TextWaterNone
+  0x81, 0x88, 0x6C, 0x6F, 0x77, 0x84, 0x00, // 369 TextWaterVeryLow
+  0x82, 0x43, 0x4C, 0x4B, 0x3F, 0x84, 0x00, // 376 TextAtClock
+  0x82, 0x49, 0x46, 0x53, 0x52, 0x84, 0x00, // 383 TextAtGprsAddress
+  0x82, 0x49, 0x49, 0x43, 0x52, 0x84, 0x00, // 390 TextAtGprsBringUp
+  0x82, 0x52, 0x45, 0x47, 0x3F, 0x84, 0x00, // 397 TextAtRegistration
+  0x82, 0x53, 0x54, 0x54, 0x3D, 0x22, 0x00, // 404 TextAtGprsApn
+  0x82, 0x8F, 0x46, 0x3D, 0x30, 0x84, 0x00, // 411 TextAtPduMode
+  0x82, 0x8F, 0x46, 0x3D, 0x31, 0x84, 0x00, // 418 TextAtTextMode
+  0x83, 0x46, 0x75, 0x6C, 0x6C, 0x84, 0x00, // 425 TextBatteryFull
+  0x85, 0x4E, 0x6F, 0x6E, 0x65, 0x84, 0x00, // 432 TextChargeNone
+  0x20, 0x43, 0x53, 0x51, 0x20, 0x00, // 439 TextDiagSignal
+  0x20, 0x4C, 0x6F, 0x90, 0x20, 0x00, // 445 TextDiagLost
+  0x20, 0x55, 0x70, 0x64, 0x20, 0x00, // 451 TextDiagUpdate
+  0x20, 0x61, 0x76, 0x67, 0x20, 0x00, // 457 TextAverage
+  0x41, 0x54, 0x45, 0x30, 0x84, 0x00, // 463 TextAtEchoOff
+  0x50, 0x65, 0x61, 0x6B, 0x89, 0x00, // 469 TextDigestPeak
+  0x50, 0x75, 0x6D, 0x70, 0x20, 0x00, // 475 TextDigestPump
+  0x55, 0x61, 0x72, 0x74, 0x20, 0x00, // 481 TextDiagUart
+  0x81, 0x88, 0x68, 0x8B, 0x84, 0x00, // 487 TextWaterVeryHigh
+  0x82, 0x8F, 0x53, 0x3D, 0x22, 0x00, // 493 TextAtSendSmsTo
+  0x20, 0x46, 0x45, 0x20, 0x00, // 499 TextDiagFraming
+  0x20, 0x4F, 0x45, 0x20, 0x00, // 504 TextDiagOverrun
+  0x42, 0x61, 0x74, 0x20, 0x00, // 509 TextDigestBattery
+  0x49, 0x73, 0x72, 0x20, 0x00, // 514 TextDiagIsr
+  0x4C, 0x6F, 0x67, 0x20, 0x00, // 519 TextDiagLog
+  0x4E, 0x65, 0x74, 0x20, 0x00, // 524 TextDiagNetwork
+  0x55, 0x50, 0x44, 0x20, 0x00, // 529 TextUpdateRequest
+  0x81, 0x48, 0x8B, 0x84, 0x00, // 534 TextWaterHigh
+  0x82, 0x53, 0x51, 0x84, 0x00, // 539 TextAtSignal
+  0x82, 0x8F, 0x44, 0x3D, 0x00, // 544 TextAtDeleteSms
+  0x82, 0x8F, 0x53, 0x3D, 0x00, // 549 TextAtSendSmsLength
+  0x83, 0x88, 0x8A, 0x84, 0x00, // 554 TextBatteryVeryLow
+  0x85, 0x48, 0x8B, 0x84, 0x00, // 559 TextChargeHigh
+  0x41, 0x54, 0x84, 0x00, // 564 TextAt
+  0x46, 0x77, 0x20, 0x00, // 568 TextDiagFirmware
+  0x6D, 0x56, 0x84, 0x00, // 572 TextDigestBatteryUnit
+  0x6D, 0x73, 0x84, 0x00, // 576 TextDiagBootUnit
+  0x75, 0x73, 0x84, 0x00, // 580 TextDiagIsrUnit
+  0x81, 0x87, 0x84, 0x00, // 584 TextWaterMedium
+  0x81, 0x8A, 0x84, 0x00, // 588 TextWaterLow
+  0x83, 0x87, 0x84, 0x00, // 592 TextBatteryMedium
+  0x83, 0x8A, 0x84, 0x00, // 596 TextBatteryLow
+  0x85, 0x87, 0x84, 0x00, // 600 TextChargeMedium
+  0x85, 0x8A, 0x84, 0x00, // 604 TextChargeLow
+  0x86, 0x66, 0x66, 0x00, // 608 TextPumpOff
+  0x86, 0x6E, 0x00, // 612 TextPumpOn
+  0x2D, 0x00, // 615 TextDash
+  0x2F, 0x00, // 617 TextSlash
+};
+
+const char text_words[] =
+  "Msg from Sol-Mate: " "\0" // 0x80
+  "Water level: " "\0" // 0x81
+  "AT+C" "\0" // 0x82
+  "Battery level: " "\0" // 0x83
+  "\r\n" "\0" // 0x84
+  "Charge rate: " "\0" // 0x85
+  "Water pump: O" "\0" // 0x86
+  "Medium" "\0" // 0x87
+  "Very " "\0" // 0x88
+  " level " "\0" // 0x89
+  "Low" "\0" // 0x8A
+  "igh" "\0" // 0x8B
+  "ing" "\0" // 0x8C
+  "our " "\0" // 0x8D
+  "s " "\0" // 0x8E
+  "MG" "\0" // 0x8F
+  "st" "\0"; // 0x90
+
+const unsigned int text_word_offsets[TEXT_WORDS] = {
+  0, 20, 34, 39, 55, 58, 72, 86, 93, 99, 107, 111, 115, 119, 124, 127,
+  130
+};
@@ -0,0 +1,105 @@
+/*
+ * text_table.h
+ *
+ * Generated by tools/textgen.py from messages.txt [en], don't edit.
+ * 83 strings, 1146 bytes as literals, 786 packed (codes 619, words 133, offsets 34)
+ */
+
+#ifndef TEXT_TABLE_H_
+#define TEXT_TABLE_H_
+
+#define TEXT_WORD_FIRST 0x80 // codes from here on are text_words entries
+#define TEXT_WORDS 17
+
+// Offsets into text_codes
+enum TextId {
+  TextAt = 564,
+  TextAtEchoOff = 463,
+  TextAtRegistrationReports = 312,
+  TextAtRegistration = 397,
+  TextAtNetworkTime = 304,
+  TextAtTextMode = 418,
+  TextAtPduMode = 411,
+  TextAtListSms = 226,
+  TextAtDeleteSms = 544,
+  TextAtSendSmsTo = 493,
+  TextAtSendSmsLength = 549,
+  TextAtBaud = 296,
+  TextAtSignal = 539,
+  TextAtClock = 376,
+  TextAtGprsShut = 255,
+  TextAtGprsAttach = 237,
+  TextAtGprsApn = 404,
+  TextAtGprsBringUp = 390,
+  TextAtGprsAddress = 383,
+  TextAtGprsConnect = 128,
+  TextAtGprsSend = 246,
+  TextUpdateRequest = 529,
+  TextNewline = 104,
+  TextQuoteNewline = 234,
+  TextSmsEnd = 45,
+  TextCtrlZ = 46,
+  TextSlash = 617,
+  TextDash = 615,
+  TextSpace = 224,
+  TextAverage = 457,
+  TextWaterWarning = 48,
+  TextPhoneChanged = 0,
+  TextStatusHeader = 83,
+  TextBatteryFull = 425,
+  TextBatteryMedium = 592,
+  TextBatteryLow = 596,
+  TextBatteryVeryLow = 554,
+  TextChargeHigh = 559,
+  TextChargeMedium = 600,
+  TextChargeLow = 604,
+  TextChargeNone = 432,
+  TextWaterNone = 362,
+  TextWaterVeryLow = 369,
+  TextWaterLow = 588,
+  TextWaterMedium = 584,
+  TextWaterHigh = 534,
+  TextWaterVeryHigh = 487,
+  TextWaterInvalid = 106,
+  TextSwitchFault = 161,
+  TextPumpOn = 612,
+  TextPumpDryRun = 145,
+  TextPumpStall = 202,
+  TextPumpOff = 608,
+  TextDiagHeader = 189,
+  TextDiagUart = 481,
+  TextDiagOverrun = 504,
+  TextDiagFraming = 499,
+  TextDiagDropped = 327,
+  TextDiagNetwork = 524,
+  TextDiagSignal = 439,
+  TextDiagFailed = 334,
+  TextDiagLost = 445,
+  TextDiagLog = 519,
+  TextDiagPending = 272,
+  TextDiagResets = 355,
+  TextDiagCause = 264,
+  TextDiagBoot = 320,
+  TextDiagBootUnit = 576,
+  TextDiagStackLow = 215,
+  TextDiagStackUnit = 341,
+  TextDiagIsr = 514,
+  TextDiagIsrUnit = 580,
+  TextDiagFirmware = 568,
+  TextDiagUpdate = 451,
+  TextDigestHeader = 175,
+  TextDigestBattery = 509,
+  TextDigestBatteryUnit = 572,
+  TextDigestPanel = 348,
+  TextDigestPump = 475,
+  TextDigestPumpUnit = 286,
+  TextDigestStarts = 288,
+  TextDigestPeak = 469,
+  TextDigestWarnings = 280
+};
+
+extern const unsigned char text_codes[];
+extern const char text_words[];
+extern const unsigned int text_word_offsets[TEXT_WORDS];
+
+#endif /* TEXT_TABLE_H_ */
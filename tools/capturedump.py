@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Prints a service port modem capture ("capture dump") as a transcript.
+
+    cat /dev/ttyACM0 > dump.bin &   then send "capture dump"
+    tools/capturedump.py dump.bin
+
+Bytes going the same way are run together into lines, like
+    12.345 <  +CMTI: "SM",3
+    12.360 >  AT+CMGL="ALL"
+    12.402 =  command CommandStateListSMS
+Times are seconds from the first record (timer A1 wraps every 2 s, so a
+longer quiet spell comes out short).
+"""
+
+import os
+import re
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from tracedump import read_enum  # noqa: E402
+
+RECORD = struct.Struct("<HBB")  # struct CaptureRecord
+TICKS = 32768  # TA1R counts per second
+
+KINDS = read_enum("capture.h", "CaptureKind")
+STATES = read_enum("uart.h", "CommandState")
+RESULTS = read_enum("uart.h", "ReturnResult")
+
+
+def dumps(data):
+    """Yields the records of every "capture <n> x <size>" dump in a file."""
+    for match in re.finditer(rb"capture (\d+) x (\d+)\r\n", data):
+        count, size = int(match.group(1)), int(match.group(2))
+        if size != RECORD.size:
+            sys.exit("record size %d, expected %d (capturedump.py is out of date)" % (size, RECORD.size))
+        body = data[match.end():match.end() + count * size]
+        yield [RECORD.unpack_from(body, i * size) for i in range(len(body) // size)]
+
+
+def printable(text):
+    return "".join(c if " " <= c <= "~" else "\\x%02x" % ord(c) for c in text)
+
+
+def transcript(records):
+    elapsed = 0
+    last = None
+    line = None  # [start, arrow, text]
+
+    def flush():
+        if line and line[2]:
+            print("%8.3f %s  %s" % (line[0] / TICKS, line[1], printable(line[2])))
+
+    for time, kind, byte in records:
+        if last is not None:
+            elapsed += (time - last) & 0xFFFF
+        last = time
+        name = KINDS.get(kind, str(kind))
+
+        if name in ("CaptureRx", "CaptureTx"):
+            arrow = "<" if name == "CaptureRx" else ">"
+            if line is None or line[1] != arrow:
+                flush()
+                line = [elapsed, arrow, ""]
+            if byte == 0x0A:  # end of a line
+                flush()
+                line = None
+            elif byte != 0x0D:
+                line[2] += chr(byte)
+            continue
+
+        flush()
+        line = None
+        if name == "CaptureCommand":
+            print("%8.3f =  command %s" % (elapsed / TICKS, STATES.get(byte, str(byte))))
+        else:
+            result = byte - 0x100 if byte & 0x80 else byte
+            print("%8.3f =  result %s" % (elapsed / TICKS, RESULTS.get(result, str(result))))
+    flush()
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: capturedump.py <file>")
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    found = False
+    for records in dumps(data):
+        if found:
+            print()
+        transcript(records)
+        found = True
+    if not found:
+        sys.exit("no capture dump in " + sys.argv[1])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""Makes a firmware update patch (update.h) from two builds.
+
+    tools/mkpatch.py old.txt new.txt key.txt patch.bin
+
+old.txt/new.txt are TI-TXT images (the project's hex output, --ti_txt),
+key.txt the board's update key (64 hex digits, the same ones given to "key"
+on the service port). Nothing happens to old.txt's board unless it's running
+exactly that build: the patch carries its image CRC.
+
+The image layout comes out of boot.h and lnk_msp430f5529.cmd, so it stays in
+step with the firmware. Both builds need the same BOOT (boot.c, the installer
+doesn't get updated); that gets checked. The patch gets applied here once to
+make sure it gives back new.txt.
+"""
+
+import hashlib
+import hmac
+import os
+import re
+import struct
+import sys
+
+SOURCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+SEGMENT = 512  # FLASH_SEGMENT_SIZE
+MAGIC = b"SMD1"
+OP_ADD, OP_COPY, OP_FILL, OP_END = range(4)
+MATCH_MIN = 5  # shorter copies cost as much as adding the bytes
+FILL_MIN = 5
+CANDIDATES = 32  # earlier places a 4 byte key is looked up in
+
+
+def read_defines(header):
+    with open(os.path.join(SOURCE, header)) as f:
+        text = f.read()
+    return {name: int(value, 0)
+            for name, value in re.findall(r"#define\s+(\w+)\s+(0x[0-9A-Fa-f]+|\d+)(?:UL|U|L)?\b", text)}
+
+
+def read_region(name):
+    with open(os.path.join(SOURCE, "lnk_msp430f5529.cmd")) as f:
+        text = f.read()
+    match = re.search(r"^\s*%s\s*:\s*origin\s*=\s*(0x[0-9A-Fa-f]+),\s*length\s*=\s*(0x[0-9A-Fa-f]+)" % name, text, re.M)
+    return int(match.group(1), 16), int(match.group(2), 16)
+
+
+BOOT = read_defines("boot.h")
+IMAGE_RANGES = [
+    (BOOT["UPDATE_FLASH_START"], BOOT["UPDATE_FLASH_SEGMENTS"] * SEGMENT),
+    (BOOT["UPDATE_FLASH2_START"], BOOT["UPDATE_FLASH2_SEGMENTS"] * SEGMENT),
+    (BOOT["UPDATE_VECTORS_START"], SEGMENT),
+]
+IMAGE_SIZE = sum(length for _, length in IMAGE_RANGES)
+
+
+def read_ti_txt(path):
+    """{address: byte} of everything in a TI-TXT file."""
+    memory = {}
+    address = None
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line == "q":
+                continue
+            if line.startswith("@"):
+                address = int(line[1:], 16)
+                continue
+            for byte in line.split():
+                memory[address] = int(byte, 16)
+                address += 1
+    return memory
+
+
+def image(memory, path):
+    """Image bytes in update order (blank flash is 0xFF), and the BOOT bytes."""
+    out = bytearray()
+    for start, length in IMAGE_RANGES:
+        out += bytes(memory.get(address, 0xFF) for address in range(start, start + length))
+    boot_start, boot_length = read_region("BOOT")
+    boot = bytes(memory.get(address, 0xFF) for address in range(boot_start, boot_start + boot_length))
+    for address in memory:
+        inside = any(start <= address < start + length for start, length in IMAGE_RANGES)
+        if not inside and not boot_start <= address < boot_start + boot_length and address >= 0x4400:
+            sys.exit("%s: 0x%05X is outside the image (linker file changed?)" % (path, address))
+    return bytes(out), boot
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, what the CRC module gives with CRCDIRB."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return value * 2 if value >= 0 else -value * 2 - 1
+
+
+def match_length(old, new, source, target):
+    length = 0
+    while source + length < len(old) and target + length < len(new) and old[source + length] == new[target + length]:
+        length += 1
+    return length
+
+
+def encode(old, new):
+    """Greedy ops: the longest copy from old (same shift as the last one if it
+    does as well), runs as fills, the rest added."""
+    index = {}
+    for i in range(len(old) - 3):
+        places = index.setdefault(old[i:i + 4], [])
+        if len(places) < CANDIDATES:
+            places.append(i)
+
+    ops = bytearray()
+    pending = bytearray()
+    shift = 0
+    counts = {"add": 0, "copy": 0, "fill": 0}
+
+    def flush():
+        if pending:
+            ops.extend(bytes([OP_ADD]) + varint(len(pending)) + pending)
+            counts["add"] += len(pending)
+            pending.clear()
+
+    i = 0
+    while i < len(new):
+        best, best_shift = 0, shift
+        if 0 <= i + shift < len(old):
+            best = match_length(old, new, i + shift, i)
+        for source in index.get(new[i:i + 4], ()):
+            length = match_length(old, new, source, i)
+            if length > best + 2:  # a new shift costs a byte or two more
+                best, best_shift = length, source - i
+
+        run = 1
+        while i + run < len(new) and new[i + run] == new[i]:
+            run += 1
+
+        if run >= FILL_MIN and run >= best:
+            flush()
+            ops.extend(bytes([OP_FILL]) + varint(run) + bytes([new[i]]))
+            counts["fill"] += run
+            i += run
+        elif best >= MATCH_MIN:
+            flush()
+            ops.extend(bytes([OP_COPY]) + varint(best) + varint(zigzag(best_shift)))
+            counts["copy"] += best
+            shift = best_shift
+            i += best
+        else:
+            pending.append(new[i])
+            i += 1
+    flush()
+    ops.append(OP_END)
+    return bytes(ops), counts
+
+
+def apply(old, patch):
+    """What update.c does, to check the patch."""
+    out = bytearray()
+    position = 48
+
+    def read_varint():
+        nonlocal position
+        value, bits = 0, 0
+        while True:
+            byte = patch[position]
+            position += 1
+            value |= (byte & 0x7F) << bits
+            bits += 7
+            if not byte & 0x80:
+                return value
+
+    while True:
+        op = patch[position]
+        position += 1
+        if op == OP_END:
+            return bytes(out)
+        length = read_varint()
+        if op == OP_ADD:
+            out += patch[position:position + length]
+            position += length
+        elif op == OP_COPY:
+            value = read_varint()
+            shift = value >> 1 if not value & 1 else -(value >> 1) - 1
+            for _ in range(length):
+                out.append(old[len(out) + shift])
+        else:
+            out += bytes([patch[position]]) * length
+            position += 1
+
+
+def main():
+    if len(sys.argv) != 5:
+        sys.exit("usage: mkpatch.py <old.txt> <new.txt> <key.txt> <patch.bin>")
+    old, old_boot = image(read_ti_txt(sys.argv[1]), sys.argv[1])
+    new, new_boot = image(read_ti_txt(sys.argv[2]), sys.argv[2])
+    if old_boot != new_boot:
+        sys.exit("BOOT differs between the builds (boot.c has to stay the same)")
+    with open(sys.argv[3]) as f:
+        key = bytes.fromhex(f.read().strip())
+    if len(key) != 32:
+        sys.exit("key has to be 64 hex digits")
+
+    header = MAGIC + struct.pack("<HHI", crc16(old), crc16(new), IMAGE_SIZE)
+    mac = hmac.new(key, header + new, hashlib.sha256).digest()
+    ops, counts = encode(old, new)
+    patch = header + mac + bytes(4) + ops
+
+    if apply(old, patch) != new:
+        sys.exit("patch doesn't give back the new image (mkpatch.py bug)")
+    with open(sys.argv[4], "wb") as f:
+        f.write(patch)
+    print("image %d bytes, CRC %d -> %d; patch %d bytes (copied %d, filled %d, added %d)" % (
+        IMAGE_SIZE, crc16(old), crc16(new), len(patch), counts["copy"], counts["fill"], counts["add"]))
+
+
+if __name__ == "__main__":
+    main()
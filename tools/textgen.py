@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""Packs messages.txt into text_table.c / text_table.h.
+
+    tools/textgen.py [--language xx]
+
+Every string is stored once as a run of codes ending in 0: a code under
+0x80 is that character, 0x80 + n stands for dictionary word n. Words are
+picked greedily (the substring saving the most bytes, again and again,
+until nothing pays for its own entry), so the "Msg from Sol-Mate: ",
+"Water level: ", "AT+C"... prefixes are only in flash once. A string whose
+codes end another one's (like "\\r\\n") just points into it. A TextId is the
+offset of its codes, so there's no per-string table. text.c decodes.
+
+Ids missing from the chosen language fall back to [en].
+"""
+
+import argparse
+import os
+import re
+import sys
+
+SOURCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+WORD_FIRST = 0x80
+WORDS_MAX = 0x100 - WORD_FIRST
+WORD_LENGTH_MAX = 32
+ENTRY = re.compile(r'^(Text\w+)\s+"((?:[^"\\]|\\.)*)"\s*$')
+ESCAPES = {"r": "\r", "n": "\n", '"': '"', "\\": "\\"}
+
+
+def unescape(text, where):
+    out = []
+    i = 0
+    while i < len(text):
+        c = text[i]
+        if c != "\\":
+            out.append(c)
+            i += 1
+        elif text[i + 1] == "x":
+            out.append(chr(int(text[i + 2:i + 4], 16)))
+            i += 4
+        elif text[i + 1] in ESCAPES:
+            out.append(ESCAPES[text[i + 1]])
+            i += 2
+        else:
+            sys.exit("%s: unknown escape \\%s" % (where, text[i + 1]))
+    result = "".join(out)
+    if any(ord(c) >= WORD_FIRST or c == "\0" for c in result):
+        sys.exit("%s: 7 bit text only (and no nul)" % where)
+    return result
+
+
+def read_messages(path):
+    """{language: [(id, text), ...]} in file order."""
+    languages = {}
+    section = None
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            where = "%s:%d" % (os.path.basename(path), number)
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            if line.startswith("[") and line.endswith("]"):
+                section = languages.setdefault(line[1:-1], [])
+                continue
+            match = ENTRY.match(line)
+            if not match or section is None:
+                sys.exit("%s: expected Id \"text\" in a [language] section" % where)
+            section.append((match.group(1), unescape(match.group(2), where)))
+    return languages
+
+
+def pick_words(texts):
+    """Chooses dictionary words, returns (words, texts with words coded in)."""
+    words = []
+    while len(words) < WORDS_MAX:
+        # Upper bound first (overlapping counts), exact counts for the promising ones
+        counts = {}
+        for text in texts:
+            for i in range(len(text)):
+                for j in range(i + 2, min(len(text), i + WORD_LENGTH_MAX) + 1):
+                    piece = text[i:j]
+                    if ord(piece[-1]) >= WORD_FIRST:
+                        break
+                    if ord(piece[0]) >= WORD_FIRST:
+                        break
+                    counts[piece] = counts.get(piece, 0) + 1
+
+        def gain(piece, uses):
+            return uses * (len(piece) - 1) - (len(piece) + 1 + 2)  # word, its nul, its offset
+
+        candidates = sorted(counts, key=lambda piece: (-gain(piece, counts[piece]), piece))
+        best, best_gain = None, 0
+        for piece in candidates:
+            if gain(piece, counts[piece]) <= best_gain:
+                break
+            exact = gain(piece, sum(text.count(piece) for text in texts))
+            if exact > best_gain:
+                best, best_gain = piece, exact
+        if best is None:
+            break
+        code = chr(WORD_FIRST + len(words))
+        words.append(best)
+        texts = [text.replace(best, code) for text in texts]
+    return words, texts
+
+
+def layout(coded):
+    """Places coded strings (suffixes share), returns (blob, {text: offset})."""
+    blob = ""
+    offsets = {}
+    for text in sorted(set(coded), key=lambda text: (-len(text), text)):
+        for placed, offset in offsets.items():
+            if placed.endswith(text):
+                offsets[text] = offset + len(placed) - len(text)
+                break
+        else:
+            offsets[text] = len(blob)
+            blob += text + "\0"
+    return blob, offsets
+
+
+def c_bytes(text):
+    return ", ".join("0x%02X" % ord(c) for c in text)
+
+
+def c_string(text):
+    out = ""
+    for c in text:
+        if c == "\r":
+            out += "\\r"
+        elif c == "\n":
+            out += "\\n"
+        elif c in '"\\':
+            out += "\\" + c
+        elif " " <= c <= "~":
+            out += c
+        else:
+            out += "\\x%02X" % ord(c)
+    return '"' + out + '"'
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Packs messages.txt into text_table.c/h")
+    parser.add_argument("--language", default="en")
+    args = parser.parse_args()
+
+    languages = read_messages(os.path.join(SOURCE, "messages.txt"))
+    if "en" not in languages:
+        sys.exit("messages.txt has no [en] section")
+    if args.language not in languages:
+        sys.exit("messages.txt has no [%s] section" % args.language)
+    ids = [name for name, _ in languages["en"]]
+    if len(set(ids)) != len(ids):
+        sys.exit("messages.txt: an id is listed twice in [en]")
+    chosen = dict(languages["en"])
+    for name, text in languages[args.language]:
+        if name not in chosen:
+            sys.exit("messages.txt: [%s] has %s, [en] doesn't" % (args.language, name))
+        chosen[name] = text
+
+    unique = sorted(set(chosen.values()))
+    words, coded = pick_words(unique)
+    coded_by_text = dict(zip(unique, coded))
+    blob, offsets = layout(coded)
+    text_offset = {text: offsets[coded_by_text[text]] for text in unique}
+
+    literal_size = sum(len(text) + 1 for text in unique)
+    word_size = sum(len(word) + 1 for word in words)
+    packed_size = len(blob) + word_size + 2 * len(words)
+    summary = "%d strings, %d bytes as literals, %d packed (codes %d, words %d, offsets %d)" % (
+        len(ids), literal_size, packed_size, len(blob), word_size, 2 * len(words))
+
+    with open(os.path.join(SOURCE, "text_table.h"), "w", newline="\n") as f:
+        f.write("/*\n * text_table.h\n *\n")
+        f.write(" * Generated by tools/textgen.py from messages.txt [%s], don't edit.\n" % args.language)
+        f.write(" * %s\n */\n\n" % summary)
+        f.write("#ifndef TEXT_TABLE_H_\n#define TEXT_TABLE_H_\n\n")
+        f.write("#define TEXT_WORD_FIRST 0x%02X // codes from here on are text_words entries\n" % WORD_FIRST)
+        f.write("#define TEXT_WORDS %d\n\n" % len(words))
+        f.write("// Offsets into text_codes\nenum TextId {\n")
+        for i, name in enumerate(ids):
+            f.write("  %s = %d%s\n" % (name, text_offset[chosen[name]], "," if i + 1 < len(ids) else ""))
+        f.write("};\n\n")
+        f.write("extern const unsigned char text_codes[];\n")
+        f.write("extern const char text_words[];\n")
+        f.write("extern const unsigned int text_word_offsets[TEXT_WORDS];\n\n")
+        f.write("#endif /* TEXT_TABLE_H_ */\n")
+
+    with open(os.path.join(SOURCE, "text_table.c"), "w", newline="\n") as f:
+        f.write('#include "text_table.h"\n\n')
+        f.write("/*\n * text_table.c\n *\n")
+        f.write(" * Generated by tools/textgen.py from messages.txt [%s], don't edit.\n */\n\n" % args.language)
+        f.write("const unsigned char text_codes[] = {\n")
+        offset = 0
+        for piece in blob.split("\0")[:-1]:
+            names = []
+            for name in ids:
+                start = text_offset[chosen[name]]
+                if offset <= start <= offset + len(piece):
+                    names.append(name if start == offset else "%s+%d" % (name, start - offset))
+            f.write("  %s, 0x00, // %d %s\n" % (c_bytes(piece), offset, " ".join(names)) if piece else "  0x00,\n")
+            offset += len(piece) + 1
+        f.write("};\n\n")
+        f.write("const char text_words[] =\n")
+        for i, word in enumerate(words):
+            f.write("  %s \"\\0\"%s // 0x%02X\n" % (c_string(word), ";" if i + 1 == len(words) else "", WORD_FIRST + i))
+        if not words:
+            f.write('  "";\n')
+        f.write("\nconst unsigned int text_word_offsets[TEXT_WORDS] = {\n")
+        position = 0
+        entries = []
+        for word in words:
+            entries.append(str(position))
+            position += len(word) + 1
+        for i in range(0, len(entries), 16):
+            f.write("  %s%s\n" % (", ".join(entries[i:i + 16]), "," if i + 16 < len(entries) else ""))
+        f.write("};\n")
+
+    print(summary)
+
+
+if __name__ == "__main__":
+    main()
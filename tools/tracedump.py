@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Turns a service port trace dump into a timeline.
+
+Capture the session with anything that saves raw bytes, e.g.
+    cat /dev/ttyACM0 > dump.bin &   then send "trace" (or "trace flash")
+and run
+    tools/tracedump.py dump.bin
+
+Event, state and result names come straight out of trace.h, uart.h,
+pump.h, charge.h and update.h, so they stay in step with the firmware.
+"""
+
+import os
+import re
+import struct
+import sys
+
+SOURCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+RECORD = struct.Struct("<HHHBB")  # struct TraceRecord
+BLANK = 0xFF  # TRACE_BLANK
+TICKS = 4096  # TA0R counts per second
+
+
+def read_enum(header, name):
+    """Value -> name for enum <name> in a firmware header."""
+    with open(os.path.join(SOURCE, header)) as f:
+        text = f.read()
+    body = re.search(r"enum\s+%s\s*\{(.*?)\}" % name, text, re.S).group(1)
+    names = {}
+    value = -1
+    for line in body.splitlines():
+        line = line.split("//")[0].strip().rstrip(",")
+        if not line:
+            continue
+        if "=" in line:
+            line, number = (part.strip() for part in line.split("="))
+            value = int(number, 0)
+        else:
+            value += 1
+        names[value] = line
+    return names
+
+
+EVENTS = read_enum("trace.h", "TraceEvent")
+STATES = read_enum("uart.h", "CommandState")
+RESULTS = read_enum("uart.h", "ReturnResult")
+PUMP_STATES = read_enum("pump.h", "PumpState")
+PUMP_FAULTS = read_enum("pump.h", "PumpFault")
+CHARGE_STAGES = read_enum("charge.h", "ChargeStage")
+UPDATE_STATES = read_enum("update.h", "UpdateState")
+
+
+def describe(event, arg):
+    name = EVENTS.get(event, "Event%d" % event)
+    if name == "TraceCommand":
+        return "command  " + STATES.get(arg, str(arg))
+    if name == "TraceResult":
+        result = arg & 0xFF
+        result = result - 0x100 if result & 0x80 else result
+        return "result   %s %s" % (STATES.get(arg >> 8, str(arg >> 8)), RESULTS.get(result, str(result)))
+    if name == "TracePump":
+        return "pump     " + PUMP_STATES.get(arg, str(arg))
+    if name == "TracePumpFault":
+        return "fault    " + PUMP_FAULTS.get(arg, str(arg))
+    if name == "TracePanel":
+        return "panel    " + ("connected" if arg else "disconnected")
+    if name == "TraceReading":
+        return "reading  battery %d panel %d" % (arg >> 8, arg & 0xFF)
+    if name == "TraceBoot":
+        return "boot     reset cause 0x%02x" % arg
+    if name == "TraceNetwork":
+        return "network  creg %d" % arg
+    if name == "TraceCharge":
+        return "charge   " + CHARGE_STAGES.get(arg, str(arg))
+    if name == "TraceUpdate":
+        return "update   " + UPDATE_STATES.get(arg, str(arg))
+    if name == "TraceFlush":
+        return "flush    %d records" % arg
+    return "%-8s %d" % (name[len("Trace"):].lower(), arg)
+
+
+def dumps(data):
+    """Yields the records of every "trace <n> x <size>" dump in a capture."""
+    for match in re.finditer(rb"trace (\d+) x (\d+)\r\n", data):
+        count, size = int(match.group(1)), int(match.group(2))
+        if size != RECORD.size:
+            sys.exit("record size %d, expected %d (tracedump.py is out of date)" % (size, RECORD.size))
+        start = match.end()
+        body = data[start:start + count * size]
+        yield [RECORD.unpack_from(body, i * size) for i in range(len(body) // size)]
+
+
+def timeline(records):
+    last = None
+    for seconds, ticks, arg, event, sequence in records:
+        if event == BLANK:
+            continue
+        if last is not None and sequence != (last + 1) & 0xFF:
+            print("         ... %d missing" % ((sequence - last - 1) & 0xFF))
+        last = sequence
+        print("%5d.%03d %s" % (seconds, ticks * 1000 // TICKS, describe(event, arg)))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: tracedump.py <capture>")
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    found = False
+    for records in dumps(data):
+        if found:
+            print()
+        timeline(records)
+        found = True
+    if not found:
+        sys.exit("no trace dump in " + sys.argv[1])
+
+
+if __name__ == "__main__":
+    main()
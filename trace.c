@@ -0,0 +1,112 @@
+#include "trace.h"
+#include "uart.h"
+#include "flash.h"
+
+/*
+ * trace.c
+ */
+
+// Out of main RAM, next to the service port buffers (.usbram in the linker file)
+#pragma DATA_SECTION(trace_ring, ".usbram")
+struct TraceRecord trace_ring[TRACE_RECORDS];
+volatile unsigned char trace_head;
+volatile unsigned char trace_count;
+volatile char trace_flush_wanted;
+
+volatile unsigned char trace_sequence;
+volatile unsigned int trace_seconds;
+volatile unsigned int trace_flush_holdoff; // seconds until a stall may flush again
+unsigned char trace_last_battery; // last TraceReading
+unsigned char trace_last_panel;
+
+void trace_initialize(unsigned int reset_cause)
+{
+  trace_head = 0;
+  trace_count = 0;
+  trace_sequence = 0;
+  trace_flush_wanted = 0;
+  trace_flush_holdoff = 0;
+  trace_last_battery = 0;
+  trace_last_panel = 0;
+  trace_event(TraceBoot, reset_cause);
+}
+
+void trace_event(char event, unsigned int arg)
+{
+  unsigned int sr = __get_SR_register();
+  struct TraceRecord *record;
+
+  _DINT();
+  record = &trace_ring[trace_head];
+  record->seconds = trace_seconds;
+  record->ticks = TA0R;
+  record->arg = arg;
+  record->event = event;
+  record->sequence = trace_sequence++;
+  trace_head = (trace_head + 1) & (TRACE_RECORDS - 1);
+  if(trace_count < TRACE_RECORDS)
+    trace_count++;
+  if(sr & GIE)
+    _EINT();
+
+  // A command that never got an answer: keep what led up to it
+  if(event == TraceResult && (signed char)arg == UartResultTimeout && !trace_flush_holdoff)
+    trace_flush_wanted = 1;
+}
+
+void trace_reading(char battery, char panel)
+{
+  unsigned char b = battery;
+  unsigned char p = panel;
+
+  if(b > trace_last_battery + TRACE_READING_DELTA || b + TRACE_READING_DELTA < trace_last_battery
+     || p > trace_last_panel + TRACE_READING_DELTA || p + TRACE_READING_DELTA < trace_last_panel)
+  {
+    trace_last_battery = b;
+    trace_last_panel = p;
+    trace_event(TraceReading, (unsigned int)b << 8 | p);
+  }
+}
+
+void trace_tick(unsigned long time)
+{
+  trace_seconds = (unsigned int)time;
+  if(trace_flush_holdoff)
+    trace_flush_holdoff--;
+}
+
+void trace_flush(void)
+{
+  unsigned char count = trace_count;
+  unsigned char index = (trace_head - count) & (TRACE_RECORDS - 1);
+  unsigned char i;
+
+  trace_flush_wanted = 0;
+  trace_flush_holdoff = TRACE_FLUSH_HOLDOFF;
+
+  // A record at a time, so interrupts aren't off for long (anything added
+  // meanwhile shows up as a jump in the sequence)
+  flash_erase(TRACE_ADDRESS);
+  for(i = 0; i < count; ++i)
+  {
+    flash_write_bytes(TRACE_ADDRESS + i * sizeof(struct TraceRecord), (const char *)&trace_ring[index],
+                      sizeof(struct TraceRecord));
+    index = (index + 1) & (TRACE_RECORDS - 1);
+  }
+
+  trace_event(TraceFlush, count);
+}
+
+unsigned int trace_span(unsigned int from, const char **data)
+{
+  unsigned int first = (trace_head - trace_count) & (TRACE_RECORDS - 1);
+  unsigned int start = (first + from) & (TRACE_RECORDS - 1);
+  unsigned int count = trace_count - from;
+
+  if(from >= trace_count)
+    return 0;
+  *data = (const char *)&trace_ring[start];
+  if(start + count > TRACE_RECORDS)
+    count = TRACE_RECORDS - start;
+  return count;
+}
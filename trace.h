@@ -0,0 +1,78 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * trace.h
+ *
+ * What the firmware has been up to, for when the LEDs aren't enough. Events
+ * (a command going out, what came back, pump/panel switching, readings
+ * moving) go into a small RAM ring as fixed 8 byte records, oldest dropped
+ * first. Adding one takes a few dozen cycles with interrupts off, so it's
+ * fine from the handlers.
+ *
+ * A command timing out (the modem stalled) copies the ring to TRACEBANK in
+ * flash, at most once per TRACE_FLUSH_HOLDOFF, so it's still there after the
+ * watchdog or a technician resets things. The service port dumps either one
+ * ("trace", "trace flash", "trace save") and tools/tracedump.py turns a dump
+ * into a timeline.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#define TRACE_ADDRESS (char *) 0xFC00 // TRACEBANK, one flash segment
+#define TRACE_RECORDS 64 // power of two, 64 x 8 bytes fills the segment
+#define TRACE_BLANK 0xFF // event of an erased record
+
+// Event ids (tools/tracedump.py reads these names from here, keep them
+// TraceSomething and add new ones at the end)
+enum TraceEvent {
+  TraceBoot, // arg: SYSRSTIV reset cause
+  TraceCommand, // arg: CommandState a command went out in
+  TraceResult, // arg: CommandState << 8 | ReturnResult (low byte, 0xFF undefined)
+  TracePump, // arg: PumpState
+  TracePumpFault, // arg: PumpFault
+  TracePanel, // arg: 1 panel connected, 0 disconnected
+  TraceReading, // arg: battery << 8 | panel (adc counts)
+  TraceModemPower, // arg: 0 (power key pulsed)
+  TraceNetwork, // arg: +CREG stat
+  TraceFlush, // arg: records copied to flash
+  TraceCharge, // arg: ChargeStage
+  TraceUpdate // arg: UpdateState
+};
+
+// One event, 8 bytes (little endian, as stored)
+struct TraceRecord {
+  unsigned int seconds; // low 16 bits of rtc_get_time
+  unsigned int ticks; // TA0R, 1/4096 s into that second
+  unsigned int arg;
+  unsigned char event; // TraceEvent
+  unsigned char sequence; // counts up, shows where records are missing
+};
+
+extern struct TraceRecord trace_ring[TRACE_RECORDS];
+extern volatile unsigned char trace_head; // next slot written
+extern volatile unsigned char trace_count; // records in the ring
+extern volatile char trace_flush_wanted; // a stall, main loop copies the ring to flash
+
+// Clears the ring and notes the reset
+void trace_initialize(unsigned int reset_cause);
+
+// Adds one event (any context)
+void trace_event(char event, unsigned int arg);
+
+// Adds a TraceReading if either reading moved TRACE_READING_DELTA since the last one
+void trace_reading(char battery, char panel);
+
+// Called once a second from timer A0 with rtc_get_time
+void trace_tick(unsigned long time);
+
+// Copies the ring to TRACEBANK, oldest first (main loop, takes a few ms)
+void trace_flush(void);
+
+// Records in ring order starting with the oldest: points data at the first
+// and returns how many follow it contiguously (second call with from = the
+// first count gets the rest)
+unsigned int trace_span(unsigned int from, const char **data);
+
+#endif /* TRACE_H_ */
@@ -1,5 +1,10 @@
 #include "uart.h"
+#include "profile.h"
 #include "definitions.h"
+#include "network.h"
+#include "trace.h"
+#include "stack.h"
+#include "capture.h"
 #include <string.h>
 
 /*
@@ -7,10 +12,25 @@
  *
  */
 
+// Pool blocks (uart_initialize)
+char *rx_buffer;
+char *tx_buffer;
+
+volatile char uart_command_state;
+volatile char uart_command_has_completed;
+volatile int uart_command_result;
+volatile char sent_text;
+
 // To keep track of the current index of the buffers
 volatile unsigned int rx_buffer_index;
 volatile unsigned int tx_buffer_index;
 
+// What the tx interrupt sends: tx_buffer up to the nul normally, or
+// tx_length bytes from anywhere (uart_send_data)
+const char *tx_data;
+volatile unsigned int tx_length; // 0 -> up to the nul
+#define tx_more() (tx_length ? tx_buffer_index < tx_length : tx_data[tx_buffer_index] != '\0')
+
 // Represents whether a command is being currently 'worked on' or not,
 // not to be confused with the UCA0STAT register with the UCIDLE/UCBUSY bits
 enum UartState {
@@ -31,40 +51,123 @@ const char *result_INPUT_ptr;
 const char code_cmti[] = "+CMTI:";
 const char *code_cmti_ptr;
 char code_received;
+const char code_creg[] = "+CREG: ";
+const char *code_creg_ptr;
+char creg_parsing; // matched code_creg, reading the numbers after it
+unsigned char creg_value;
+
+// Speeds
+const struct UartBaud uart_bauds[UART_BAUD_COUNT] = {
+	{ 115200, "115200", UART_BRW(115200UL), UART_MCTL(115200UL) },
+	{ 57600, "57600", UART_BRW(57600UL), UART_MCTL(57600UL) },
+	{ 14400, "14400", UART_BRW(14400UL), UART_MCTL(14400UL) },
+	{ 9600, "9600", UART_BRW(9600UL), UART_MCTL(9600UL) }
+};
+volatile char uart_baud_index;
+volatile char uart_baud_best;
+volatile unsigned int uart_baud_errors;
+
+// Command timeout (seconds left, 0 -> none)
+volatile char uart_timeout;
+
+// Bytes moved by the last command (for uart_wire_time)
+volatile unsigned int uart_last_bytes;
+
+volatile unsigned int uart_overrun_count;
+volatile unsigned int uart_framing_count;
+volatile unsigned int uart_dropped_count;
+
+// Ring buffer for streamed responses (head written by the isr, tail by the main loop)
+char *rx_ring; // tx_buffer's run, only while streaming
+volatile unsigned int rx_ring_head;
+volatile unsigned int rx_ring_tail;
+volatile unsigned int rx_ring_count; // bytes in the ring
+volatile unsigned char rx_ring_lines; // complete lines in the ring
+volatile char uart_streaming;
+volatile char uart_stream_lost;
+volatile char uart_inbox_pending;
+
+#ifdef UART_FLOW_CONTROL
+volatile char uart_rx_holds; // RTS stays off while this isn't 0
+volatile char uart_tx_held; // waiting on CTS
+
+// Sets RTS to match whether we can take bytes right now
+void uart_update_rts(void);
 
-// Called when a uart command is done
-//void completion_handler(int result);
+// Check CTS again in a bit
+void uart_schedule_cts_poll(void);
+#else
+#define uart_update_rts()
+#endif
+
+// Called when a uart command is done (caller still has to LPM0_EXIT)
+void uart_command_done(int result);
+
+// Common start of uart_send_command/uart_send_data/uart_listen
+void uart_send_command_start(void);
 
 // Initializes the msp's UART on the USCI A0
 void uart_initialize()
 {
+	// Buffers for good
+	if(!rx_buffer)
+	{
+		rx_buffer = pool_take(PoolOwnerRx, MAX_RX_BUFFER / POOL_BLOCK_SIZE);
+		tx_buffer = pool_take(PoolOwnerTx, RX_RING_SIZE / POOL_BLOCK_SIZE);
+		rx_ring = tx_buffer;
+	}
+
 	// Initialize variables
 	rx_buffer_index = 0;
 	tx_buffer_index = 0;
+	tx_data = tx_buffer;
+	tx_length = 0;
 	uart_state = UartStateIdle;
 	uart_command_state = CommandStateSendingAT;
 	result_OK_ptr = result_OK; // Start at beginning of array
 	result_ERROR_ptr = result_ERROR;
 	result_INPUT_ptr = result_INPUT;
 	code_cmti_ptr = code_cmti;
+	code_creg_ptr = code_creg;
+	creg_parsing = 0;
 	uart_command_has_completed = 0;
 	uart_command_result = UartResultUndefined;
 	sent_text = 0;
 	code_received = 0;
+	uart_baud_index = UART_BAUD_BOOT;
+	uart_baud_best = 0;
+	uart_baud_errors = 0;
+	uart_timeout = 0;
+	uart_last_bytes = 0;
+	uart_overrun_count = 0;
+	uart_framing_count = 0;
+	uart_dropped_count = 0;
+	uart_streaming = 0;
+	uart_stream_lost = 0;
+	uart_inbox_pending = 0;
+
+#ifdef UART_FLOW_CONTROL
+	// RTS is an output, off (high) until rx is enabled; CTS is an input
+	uart_rx_holds = 0;
+	uart_tx_held = 0;
+	GSM_PORT_OUT |= UART_PIN_RTS;
+	GSM_PORT_DIR |= UART_PIN_RTS;
+	GSM_PORT_DIR &= ~UART_PIN_CTS;
+#endif
 
 	// Enable uart mode on the correct pins
 	GSM_PORT_SEL |= UART_PIN_RX | UART_PIN_TX;
 
 	// Configure the USCI for uart
 	UCA0CTL1 |= UCSWRST; // Keep the USCI in reset mode
-	UCA0CTL1 |= UCSSEL__SMCLK; // sub-main clock source
-	UCA0BR0 = BAUDSPEED_BR0; // Set up the baud speed
-	UCA0BR1 = BAUDSPEED_BR1;
-	UCA0MCTL = BAUDSPEED_MCTL;
+	UCA0CTL1 |= UCSSEL__SMCLK | UCRXEIE; // sub-main clock source, keep bad bytes so we can count them
+	UCA0BRW = uart_bauds[uart_baud_index].brw; // Set up the baud speed
+	UCA0MCTL = uart_bauds[uart_baud_index].mctl;
 	UCA0CTL1 &= ~UCSWRST; // Turn off reset mode
 
 	// Enable uart interrupts for receive and transmit
 	UCA0IE |= UCRXIE | UCTXIE;
+	uart_update_rts();
 
 	// Clear all usci interrupt flags (this prevents the usual behavior where
 	// the transmit interrupt is called (one time) as soon as interrupts are enabled)
@@ -75,6 +178,9 @@ void uart_initialize()
 #pragma vector=USCI_A0_VECTOR
 __interrupt void uart_interrupt_handler()
 {
+	PROFILE_ENTER();
+	STACK_MARK(StackUart);
+
 	// Check the interrupt flag to see if this is rx or tx //
 	// We are reading from UCA0IV, which automatically resets the interrupt flag
 	switch(UCA0IV)
@@ -84,12 +190,104 @@ __interrupt void uart_interrupt_handler()
 //			TA0R = 0;
 //			TA0CTL |= MC__CONTINUOUS;
 
-			if(rx_buffer_index < MAX_RX_BUFFER) // Make sure we don't read more bytes than the buffer can hold
+			// Check the error flags before reading the byte (reading clears them)
+			char rx_status = UCA0STAT;
+			if(rx_status & UCOE) // lost at least one byte before this one
+			{
+				uart_overrun_count++;
+				uart_dropped_count++;
+			}
+
+			// Byte came in garbled (wrong speed or noise), count it and drop it
+			if(rx_status & UCFE)
 			{
-				// ** To-do: Add code to only store the bytes coming in some cases (e.g. when receiving an sms)
+				uart_framing_count++;
+				uart_dropped_count++;
+				uart_baud_errors++;
+				(void)UCA0RXBUF; // clears the flags
+				break;
+			}
+
+			if(!uart_streaming && rx_buffer_index >= MAX_RX_BUFFER) // No room, throw it away
+			{
+				uart_dropped_count++;
+				(void)UCA0RXBUF;
+				break;
+			}
+
+			{
+				char rx_byte = CAPTURE_RX_BYTE(); // Get the received byte (UCA0RXBUF)
+
+				if(uart_streaming) // goes into the ring, main loop takes it a line at a time
+				{
+					if(rx_ring_count >= RX_RING_SIZE) // No room, throw it away
+					{
+						uart_dropped_count++;
+						uart_stream_lost = 1;
+						break;
+					}
+					rx_ring[rx_ring_head] = rx_byte;
+					rx_ring_head = (rx_ring_head + 1) & (RX_RING_SIZE - 1);
+					rx_ring_count++;
+					if(rx_byte == '\n')
+					{
+						rx_ring_lines++;
+						LPM0_EXIT; // let the main loop have it
+					}
+				}
+				else
+					rx_buffer[rx_buffer_index] = rx_byte; // Copy the received byte into buffer
+				CAPTURE_RX(rx_byte, uart_streaming ? rx_ring_count : rx_buffer_index);
+
+				// Registration status, in any state (+CREG: <stat> when it changes,
+				// +CREG: <n>,<stat> when asked; stat is the last number either way)
+				if(creg_parsing)
+				{
+					if(rx_byte >= '0' && rx_byte <= '9')
+						creg_value = creg_value * 10 + (rx_byte - '0');
+					else if(rx_byte == ',')
+						creg_value = 0;
+					else if(rx_byte == '\r')
+					{
+						network_registration_update(creg_value);
+						creg_parsing = 0;
+					}
+				}
+				else if(rx_byte == *code_creg_ptr) // match
+				{
+					code_creg_ptr++;
+					if(*code_creg_ptr == '\0') // end of string
+					{
+						creg_parsing = 1;
+						creg_value = 0;
+						code_creg_ptr = code_creg;
+					}
+				}
+				else // wrong character, start over
+					if(rx_byte == code_creg[0])
+						code_creg_ptr = code_creg + 1; // start of new (possible) match
+					else
+						code_creg_ptr = code_creg; // no match at all right now
 
-				char rx_byte = UCA0RXBUF; // Get the received byte
-				rx_buffer[rx_buffer_index] = rx_byte; // Copy the received byte into buffer
+				// A new sms came in while we're in the middle of something, the
+				// main loop goes through the inbox once it's done
+				if(uart_command_state != CommandStateIdle)
+				{
+					if(rx_byte == *code_cmti_ptr) // match
+					{
+						code_cmti_ptr++;
+						if(*code_cmti_ptr == '\0') // end of string
+						{
+							uart_inbox_pending = 1;
+							code_cmti_ptr = code_cmti;
+						}
+					}
+					else // wrong character, start over
+						if(rx_byte == code_cmti[0])
+							code_cmti_ptr = code_cmti + 1; // start of new (possible) match
+						else
+							code_cmti_ptr = code_cmti; // no match at all right now
+				}
 
 				// For unsolicited messages
 				if(uart_command_state == CommandStateIdle)
@@ -104,9 +302,7 @@ __interrupt void uart_interrupt_handler()
               code_received = 0; // reset the flag
 
               // Stop here and go to main loop to decode the received message
-              uart_state = UartStateIdle;
-              UCA0IE &= ~UCRXIE; // Turn off receive interrupts for now
-              uart_command_has_completed = 1;
+              uart_command_done(uart_command_result);
               uart_command_state = CommandStateUnsolicitedMsg; // Going to process it in the main loop
               LPM0_EXIT; // Turn on cpu
             }
@@ -125,11 +321,18 @@ __interrupt void uart_interrupt_handler()
                 code_cmti_ptr = code_cmti + 1; // start of new (possible) match
               else
                 code_cmti_ptr = code_cmti; // no match at all right now
+
+				    // Some other line (+CREG etc.), don't let them pile up in the buffer
+				    if(rx_byte == '\n')
+				    {
+				      rx_buffer_index = 0;
+				      PROFILE_RETURN(ProfileUart);
+				    }
 				  }
 
 				  // Increment the buffer index
           rx_buffer_index++;
-					return; // don't need to check for OK,ERROR,> , etc... when it's idle
+					PROFILE_RETURN(ProfileUart); // don't need to check for OK,ERROR,> , etc... when it's idle
 				}
 
 				// The following string-checking code is a limited version of the KMP algorithm. It doesn't
@@ -143,13 +346,10 @@ __interrupt void uart_interrupt_handler()
 					result_OK_ptr++;
 					if(*result_OK_ptr == '\0') // End of string array
 					{
-						uart_state = UartStateIdle; // Done running a command
-						UCA0IE &= ~UCRXIE; // Turn off receive interrupts for now
-						uart_command_result = UartResultOK; // Tells main loop what the result is
-						uart_command_has_completed = 1; // Tells main loop that we're done
+						uart_command_done(UartResultOK); // Tells main loop that we're done
 						LPM0_EXIT; // Turn on CPU to run the main loop
 //						TA0CTL |= MC__STOP;
-						return;
+						PROFILE_RETURN(ProfileUart);
 					}
 				}
 				else // wrong character, start over
@@ -164,12 +364,9 @@ __interrupt void uart_interrupt_handler()
 					result_ERROR_ptr++; // we have a match
 					if(*result_ERROR_ptr == '\0')
 					{
-						uart_state = UartStateIdle; // Done running a command
-						UCA0IE &= ~UCRXIE; // Turn off receive interrupts for now
-						uart_command_result = UartResultError; // Tells main loop what the result is
-						uart_command_has_completed = 1; // Tells main loop that we're done
+						uart_command_done(UartResultError); // Tells main loop that we're done
 						LPM0_EXIT; // Turn on CPU to run the main loop
-						return;
+						PROFILE_RETURN(ProfileUart);
 					}
 				}
 				else // wrong character, start over
@@ -184,12 +381,9 @@ __interrupt void uart_interrupt_handler()
 					result_INPUT_ptr++;
 					if(*result_INPUT_ptr == '\0') // Match found
 					{
-						uart_state = UartStateIdle; // Done running a command
-						UCA0IE &= ~UCRXIE; // Turn off receive interrupts for now
-						uart_command_result = UartResultInput; // Tells main loop what the result is
-						uart_command_has_completed = 1; // Tells main loop that we're done
+						uart_command_done(UartResultInput); // Tells main loop that we're done
 						LPM0_EXIT; // Turn on CPU to run the main loop
-						return;
+						PROFILE_RETURN(ProfileUart);
 					}
 				}
 				else // wrong character, start over
@@ -199,7 +393,8 @@ __interrupt void uart_interrupt_handler()
 						result_INPUT_ptr = result_INPUT; // no match at all right now
 
 				// Increment the buffer index
-				rx_buffer_index++;
+				if(!uart_streaming)
+					rx_buffer_index++;
 			}
 
 			break;
@@ -207,26 +402,36 @@ __interrupt void uart_interrupt_handler()
 
 		case USCI_UCTXIFG: // Ready to transmit a new byte
 		{
-			// Get the desired byte to send
-			char tx_byte = tx_buffer[tx_buffer_index];
+#ifdef UART_FLOW_CONTROL
+			// Modem can't take it right now, wait for CTS (the poll sends this byte)
+			if(tx_more() && (GSM_PORT_IN & UART_PIN_CTS))
+			{
+				uart_tx_held = 1;
+				uart_schedule_cts_poll();
+				break;
+			}
+#endif
 
 			// Send a byte if we are not at the end of the buffer yet
-			if(tx_byte != '\0')
+			if(tx_more())
 			{
-				UCA0TXBUF = tx_byte; // Send the byte
+				UCA0TXBUF = tx_data[tx_buffer_index]; // Send the byte
+				CAPTURE_TX(tx_data[tx_buffer_index]);
 				tx_buffer_index++; // Increment the buffer index
 			}
 
 			break;
 		}
 	}
+
+	PROFILE_EXIT(ProfileUart);
 }
 
 // Clears out the receive buffer and sets the buffer index to zero
 void rx_buffer_reset()
 {
 	// Set everything to nul-character
-	memset(&rx_buffer, '\0', MAX_RX_BUFFER);
+	memset(rx_buffer, '\0', MAX_RX_BUFFER);
 
 	// Reset current index
 	rx_buffer_index = 0;
@@ -236,16 +441,29 @@ void rx_buffer_reset()
 	result_ERROR_ptr = result_ERROR;
 	result_INPUT_ptr = result_INPUT;
 	code_cmti_ptr = code_cmti;
+	code_creg_ptr = code_creg;
+	creg_parsing = 0;
+
+	// Empty the ring
+	// (starts in the half tx_buffer doesn't use, the command that asked for
+	// the listing may still be going out)
+	rx_ring_head = RX_RING_SIZE / 2;
+	rx_ring_tail = RX_RING_SIZE / 2;
+	rx_ring_count = 0;
+	rx_ring_lines = 0;
+	uart_stream_lost = 0;
 }
 
 // Clears out the transmit buffer and sets the buffer index to zero
 void tx_buffer_reset()
 {
 	// Set everything to nul-character
-	memset(&tx_buffer, '\0', MAX_TX_BUFFER);
+	memset(tx_buffer, '\0', MAX_TX_BUFFER);
 
 	// Reset current index
 	tx_buffer_index = 0;
+	tx_data = tx_buffer;
+	tx_length = 0;
 }
 
 // Send a character array to the cell module while also recording the
@@ -257,20 +475,75 @@ void uart_send_command()
 	if(uart_state != UartStateIdle)
 		return;
 
+	uart_send_command_start();
+	tx_data = tx_buffer;
+	tx_length = 0;
+
+#ifdef UART_FLOW_CONTROL
+	if(GSM_PORT_IN & UART_PIN_CTS) // modem isn't ready, the poll starts sending
+	{
+		tx_buffer_index = 0;
+		uart_tx_held = 1;
+		uart_schedule_cts_poll();
+		return;
+	}
+#endif
+
+	// Put the first byte into the transmit buffer (this starts the process)
+	tx_buffer_index = 1; // Interrupt handler will start at the second byte (index 1)
+	UCA0TXBUF = tx_buffer[0];
+	CAPTURE_TX(tx_buffer[0]);
+}
+
+void uart_send_data(const char *data, unsigned int length)
+{
+	if(uart_state != UartStateIdle || length == 0)
+		return;
+
+	// Same as uart_send_command, the tx interrupt just reads from data
+	uart_send_command_start();
+	tx_data = data;
+	tx_length = length;
+
+#ifdef UART_FLOW_CONTROL
+	if(GSM_PORT_IN & UART_PIN_CTS) // modem isn't ready, the poll starts sending
+	{
+		tx_buffer_index = 0;
+		uart_tx_held = 1;
+		uart_schedule_cts_poll();
+		return;
+	}
+#endif
+
+	tx_buffer_index = 1;
+	UCA0TXBUF = data[0];
+	CAPTURE_TX(data[0]);
+}
+
+void uart_listen(void)
+{
+	if(uart_state != UartStateIdle)
+		return;
+	uart_send_command_start();
+}
+
+// Gets ready for a response (before anything is sent)
+void uart_send_command_start(void)
+{
 	// Reset the buffers, flags
 	uart_command_has_completed = 0;
+	uart_timeout = 0;
 	uart_command_result = UartResultUndefined;
 	rx_buffer_reset();
+	trace_event(TraceCommand, uart_command_state);
+	CAPTURE_EVENT(CaptureCommand, uart_command_state);
 
 	// Don't allow sending strings until this one is finished
 	uart_state = UartStateBusy;
 
 	// Enable rx interrupts
 	UCA0IE |= UCRXIE;
-
-	// Put the first byte into the transmit buffer (this starts the process)
-	tx_buffer_index = 1; // Interrupt handler will start at the second byte (index 1)
-	UCA0TXBUF = tx_buffer[0];
+	uart_update_rts();
 }
 
 // Go into idle mode
@@ -278,8 +551,11 @@ void uart_enter_idle_mode()
 {
 	uart_command_state = CommandStateIdle;
 	uart_command_has_completed = 0; // In general, reset (zero) this flag if uart_send_str(..) is not called
+	if(uart_streaming)
+		uart_stream_stop(); // ring goes back to being tx_buffer
 	rx_buffer_reset(); // Clear rx buffer (make room for messages from the module)
 	UCA0IE |= UCRXIE; // enable rx interrupt
+	uart_update_rts();
 }
 
 // Returns 1 if the uart is currently sending a command, and 0 if it is not
@@ -292,6 +568,166 @@ int uart_command_in_progress()
 }
 
 // Called when a command is finished
-//void completion_handler(int result)
-//{
-//}
+void uart_command_done(int result)
+{
+	uart_state = UartStateIdle; // Done running a command
+	UCA0IE &= ~UCRXIE; // Turn off receive interrupts for now
+	uart_update_rts();
+	uart_timeout = 0;
+	uart_last_bytes = tx_buffer_index + rx_buffer_index;
+	uart_command_result = result; // Tells main loop what the result is
+	uart_command_has_completed = 1;
+	trace_event(TraceResult, (unsigned int)uart_command_state << 8 | (unsigned char)result);
+	CAPTURE_EVENT(CaptureResult, result);
+}
+
+void uart_set_timeout(char seconds)
+{
+	uart_timeout = seconds;
+}
+
+int uart_tick(void)
+{
+	if(uart_timeout == 0 || uart_state == UartStateIdle)
+		return 0;
+
+	if(--uart_timeout == 0)
+	{
+		uart_command_done(UartResultTimeout);
+		return 1;
+	}
+	return 0;
+}
+
+void uart_set_baud(char index)
+{
+	char enabled = UCA0IE & (UCRXIE | UCTXIE); // reset clears these
+
+	uart_baud_index = index;
+
+	UCA0CTL1 |= UCSWRST; // has to be in reset to change speed
+	UCA0BRW = uart_bauds[index].brw;
+	UCA0MCTL = uart_bauds[index].mctl;
+	UCA0CTL1 &= ~UCSWRST;
+
+	UCA0IE |= enabled;
+}
+
+#ifdef UART_FLOW_CONTROL
+void uart_rx_hold(void)
+{
+	uart_rx_holds++;
+	GSM_PORT_OUT |= UART_PIN_RTS;
+}
+
+void uart_rx_release(void)
+{
+	if(uart_rx_holds)
+		uart_rx_holds--;
+	uart_update_rts();
+}
+
+void uart_update_rts(void)
+{
+	if(uart_rx_holds == 0 && (UCA0IE & UCRXIE))
+		GSM_PORT_OUT &= ~UART_PIN_RTS; // go ahead
+	else
+		GSM_PORT_OUT |= UART_PIN_RTS; // hold off
+}
+
+void uart_schedule_cts_poll(void)
+{
+	TA0CCR2 = TA0R + UART_CTS_POLL;
+	if(TA0CCR2 > TA0CCR0) // timer A0 wraps at TA0CCR0
+		TA0CCR2 -= TA0CCR0 + 1;
+	TA0CCTL2 = CCIE; // one shot (also clears the flag)
+}
+
+void uart_cts_poll(void)
+{
+	if(!uart_tx_held)
+		return;
+
+	if(GSM_PORT_IN & UART_PIN_CTS) // still held off
+	{
+		uart_schedule_cts_poll();
+		return;
+	}
+
+	// Send the byte we were holding, the tx interrupt takes it from here
+	// (it read UCA0IV when it stopped, so the flag is gone and we have to prime it)
+	uart_tx_held = 0;
+	if(tx_more())
+	{
+		CAPTURE_TX(tx_data[tx_buffer_index]);
+		UCA0TXBUF = tx_data[tx_buffer_index++];
+	}
+}
+#endif
+
+void uart_stream_start(void)
+{
+	pool_pass(rx_ring, RX_RING_SIZE / POOL_BLOCK_SIZE, PoolOwnerRing);
+	uart_streaming = 1;
+}
+
+void uart_stream_stop(void)
+{
+	uart_streaming = 0;
+	pool_pass(tx_buffer, RX_RING_SIZE / POOL_BLOCK_SIZE, PoolOwnerTx);
+}
+
+int uart_line_ready(void)
+{
+	return rx_ring_lines != 0;
+}
+
+char *uart_read_line(void)
+{
+	unsigned int length = 0;
+	unsigned int taken = 0;
+	char c;
+
+	if(rx_ring_lines == 0)
+		return 0;
+
+	// The isr only adds past the end of this line, so no need to lock while copying
+	do
+	{
+		c = rx_ring[rx_ring_tail];
+		rx_ring_tail = (rx_ring_tail + 1) & (RX_RING_SIZE - 1);
+		taken++;
+		if(c != '\r' && c != '\n' && length < MAX_RX_BUFFER - 1)
+			rx_buffer[length++] = c;
+	} while(c != '\n');
+	rx_buffer[length] = '\0';
+
+	_DINT();
+	rx_ring_count -= taken;
+	rx_ring_lines--;
+	_EINT();
+
+	return rx_buffer;
+}
+
+void tx_buffer_append_number(unsigned long value)
+{
+	char digits[11];
+	int i = sizeof(digits) - 1;
+	int length = strlen(tx_buffer);
+
+	digits[i] = '\0';
+	do
+	{
+		digits[--i] = '0' + value % 10;
+		value /= 10;
+	} while(value);
+
+	strncat(tx_buffer, &digits[i], MAX_TX_BUFFER - 1 - length);
+}
+
+unsigned int uart_wire_time(void)
+{
+	// 10 bits a byte (start, 8 data, stop)
+	return (unsigned long)uart_last_bytes * 10000 / uart_bauds[uart_baud_index].rate;
+}
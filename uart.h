@@ -1,4 +1,5 @@
 #include "msp430f5529.h"
+#include "pool.h"
 
 /*
  * uart.h
@@ -8,62 +9,120 @@
 #ifndef UART_H_
 #define UART_H_
 
-// Set the speed here
-#define BAUDSPEED_9600
-
-// Values for 9600 baud
-#if defined BAUDSPEED_9600
-#define BAUDSPEED_BR0 0x6
-#define BAUDSPEED_BR1 0x0
-#define BAUDSPEED_MCTL 0xD1
-// Values for 14400
-#elif defined BAUDSPEED_14400
-#define BAUDSPEED_BR0 0x4
-#define BAUDSPEED_BR1 0x0
-#define BAUDSPEED_MCTL 0x91
-#endif
+// SMCLK feeds the USCI (left at the default DCO setting, 1.048576 MHz)
+#define UART_SMCLK_HZ 1048576UL
+
+// Baud rate register values, worked out at compile time for UART_SMCLK_HZ.
+// N = SMCLK / baud. For big N we oversample (UCOS16) and UCBRF is the
+// fraction of N/16, otherwise low frequency mode with UCBRS the fraction of N
+// (same as the tables in the user's guide, e.g. 9600 -> BR 6, MCTL 0xD1).
+#define UART_N(baud) (UART_SMCLK_HZ / (baud))
+#define UART_OVERSAMPLE(baud) (UART_N(baud) >= 64)
+#define UART_BRW(baud) (UART_OVERSAMPLE(baud) ? UART_N(baud) / 16 : UART_N(baud))
+#define UART_MCTL(baud) (UART_OVERSAMPLE(baud) \
+  ? ((((UART_SMCLK_HZ + (baud) / 2) / (baud) - UART_BRW(baud) * 16) << 4) | UCOS16) \
+  : (((UART_SMCLK_HZ * 8 + (baud) / 2) / (baud) - UART_BRW(baud) * 8) << 1))
+
+// Speeds we can talk to the modem at, fastest first
+#define UART_BAUD_COUNT 4
+#define UART_BAUD_BOOT 3 // 9600, what the modem comes out of the box with
+struct UartBaud {
+  unsigned long rate;
+  const char *name; // for AT+IPR=
+  unsigned int brw;
+  unsigned char mctl;
+};
+extern const struct UartBaud uart_bauds[UART_BAUD_COUNT];
+
+extern volatile char uart_baud_index; // speed we're using now
+extern volatile char uart_baud_best; // fastest speed that hasn't failed on us
+extern volatile unsigned int uart_baud_errors; // framing errors since the speed was locked in
+
+// Error counters (for diagnostics)
+extern volatile unsigned int uart_overrun_count; // a byte came in before we read the last one
+extern volatile unsigned int uart_framing_count; // garbled bytes
+extern volatile unsigned int uart_dropped_count; // bytes thrown away (buffer full or garbled)
+
+#define UART_PROBE_TIMEOUT 2 // seconds to wait for an answer while probing speeds
+#define UART_FRAMING_LIMIT 8 // framing errors at one speed before we step down
 
-// Maximum buffer sizes in bytes for sending and receiving
-#define MAX_RX_BUFFER 190
-#define MAX_TX_BUFFER 190
+// Maximum buffer sizes in bytes for sending and receiving (pool blocks,
+// taken by uart_initialize)
+#define MAX_RX_BUFFER (2 * POOL_BLOCK_SIZE)
+#define MAX_TX_BUFFER (2 * POOL_BLOCK_SIZE)
 
 // Buffers for sending and receiving data //
-char rx_buffer[MAX_RX_BUFFER]; // The receive buffer
-char tx_buffer[MAX_TX_BUFFER]; // The transmit buffer
+extern char *rx_buffer; // The receive buffer
+extern char *tx_buffer; // The transmit buffer
+
+// Long responses (AT+CMGL) are streamed through a ring buffer instead and
+// picked up a line at a time with uart_read_line. The ring is tx_buffer's
+// pool run (nothing gets built while the listing comes in).
+#define RX_RING_SIZE (4 * POOL_BLOCK_SIZE) // has to be a power of 2
+extern volatile char uart_stream_lost; // bytes were dropped since uart_stream_start (ring was full)
+
+// Set by the receive interrupt when a +CMTI (new sms) shows up while we're busy
+extern volatile char uart_inbox_pending;
 
 // Return possibilities
 enum ReturnResult {
 	UartResultUndefined = -1,
 	UartResultOK = 0,
 	UartResultError = 1,
-	UartResultInput = 2
+	UartResultInput = 2,
+	UartResultTimeout = 3 // only if uart_set_timeout was used
 };
 
 // States of the system
 enum CommandState {
 	CommandStateSendingAT,
 	CommandStateTurnOffEcho,
+	CommandStateSetBaud, // sent AT+IPR
+	CommandStateCheckBaud, // sent AT at the new speed
 	CommandStateGoToSMSMode,
+	CommandStateEnableRegistration, // sent AT+CREG=1 (registration changes get reported)
+	CommandStateCheckRegistration, // sent AT+CREG?
+	CommandStateCheckSignal, // sent AT+CSQ
+	CommandStateEnableClock, // sent AT+CLTS=1 (modem clock follows the network)
+	CommandStateReadClock, // sent AT+CCLK?
 	CommandStateIdle,
 	CommandStatePrepareWarningSMS,
 	CommandStateSendWarningSMS,
 	CommandStateUnsolicitedMsg,
-	CommandStateReadSMS,
+	CommandStateListSMS, // sent AT+CMGL, lines are streaming in
 	CommandStatePreparePhoneSMS,
 	CommandStateSendPhoneSMS,
 	CommandStatePrepareStatusSMS,
 	CommandStateSendStatusSMS,
-	CommandStateDeleteSMS
+	CommandStateDeleteSMS,
+	CommandStateSetPDUMode, // sent AT+CMGF=0 for a telemetry text
+	CommandStatePrepareTelemetrySMS,
+	CommandStateSendTelemetrySMS,
+	CommandStateSetTextMode, // sent AT+CMGF=1 after the telemetry text
+	CommandStateGprsReset, // sent AT+CIPSHUT (start from a clean slate)
+	CommandStateGprsAttach, // sent AT+CGATT=1
+	CommandStateGprsApn, // sent AT+CSTT
+	CommandStateGprsBringUp, // sent AT+CIICR
+	CommandStateGprsAddress, // sent AT+CIFSR (answers with just the address, no OK)
+	CommandStateGprsConnect, // sent AT+CIPSTART
+	CommandStateGprsConnected, // waiting for CONNECT OK
+	CommandStateGprsPrepareSend, // sent AT+CIPSEND=<length>
+	CommandStateGprsSend, // sent a batch of log records
+	CommandStateGprsClose, // sent AT+CIPSHUT at the end
+	CommandStateGprsUpdatePrepare, // sent AT+CIPSEND=<length> for an update request
+	CommandStateGprsUpdateSend, // sent the request (UPD ...)
+	CommandStateGprsUpdateReceive, // patch lines are streaming in
+	CommandStateGprsUpdateApply // modem quiet, window going into flash
 };
-volatile char uart_command_state; // Controls what commands are sent to the gsm module
+extern volatile char uart_command_state; // Controls what commands are sent to the gsm module
 
 // Flags that are set when a UART command is completed (the main loop in main.c checks this
 // to see when it should act)
-volatile char uart_command_has_completed;
-volatile int uart_command_result;
+extern volatile char uart_command_has_completed;
+extern volatile int uart_command_result;
 
 // Only send text once
-volatile char sent_text;
+extern volatile char sent_text;
 
 // Functions //
 
@@ -75,6 +134,55 @@ int uart_command_in_progress();
 
 // Send a string over the uart
 void uart_send_command();
+
+// Same, but length bytes from data (binary is fine, data has to stay put
+// until the command completes)
+void uart_send_data(const char *data, unsigned int length);
+
+// Wait for a result (OK/ERROR/timeout) without sending anything, for
+// responses that come in two parts
+void uart_listen(void);
+
+// Give up on the command in progress after this many seconds (0 -> wait forever,
+// uart_send_command resets it to 0)
+void uart_set_timeout(char seconds);
+
+// Called once a second, returns 1 if a command just timed out (wake the main loop)
+int uart_tick(void);
+
+// Switch the USCI to uart_bauds[index]
+void uart_set_baud(char index);
+
+// Hardware flow control. Hold RTS off while we can't service rx interrupts
+// (long isrs, flash erase with interrupts off), holds nest.
+#ifdef UART_FLOW_CONTROL
+void uart_rx_hold(void);
+void uart_rx_release(void);
+
+// Called from the timer while the modem has CTS off
+void uart_cts_poll(void);
+#else
+#define uart_rx_hold()
+#define uart_rx_release()
+#endif
+
+// Send the response to the next command through the ring buffer (lines wake
+// up the main loop), until uart_stream_stop
+void uart_stream_start(void);
+void uart_stream_stop(void);
+
+// Is there a whole line waiting in the ring buffer?
+int uart_line_ready(void);
+
+// Copies the next line out of the ring buffer into rx_buffer (without the
+// \r\n, cut short if it doesn't fit) and returns it, 0 if there isn't one yet
+char *uart_read_line(void);
+
+// Appends a number in decimal to the transmit buffer
+void tx_buffer_append_number(unsigned long value);
+
+// Time the last command spent on the wire, in ms (bytes both ways at the current speed)
+unsigned int uart_wire_time(void);
 //void uart_send_str(const char *send_str);
 
 // Go into idle mode
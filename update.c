@@ -0,0 +1,697 @@
+#include "update.h"
+#include "flash.h"
+#include "uart.h"
+#include "pump.h"
+#include "network.h"
+#include "trace.h"
+#include "sha256.h"
+#include "text.h"
+#include <string.h>
+
+/*
+ * update.c
+ */
+
+volatile char update_state;
+unsigned int update_image_crc;
+unsigned long update_received;
+unsigned long update_written;
+
+#define UPDATE_MAGIC_0 'S' // "SMD1"
+#define UPDATE_MAGIC_1 'M'
+#define UPDATE_MAGIC_2 'D'
+#define UPDATE_MAGIC_3 '1'
+#define UPDATE_MAC_COVERS 12 // header bytes the MAC covers (before the image)
+
+// Patch header, as it comes in
+struct UpdateHeader {
+  unsigned char magic[4];
+  unsigned int base_crc;
+  unsigned int image_crc;
+  unsigned long length;
+  unsigned char mac[SHA256_SIZE];
+  unsigned char reserved[4];
+};
+struct UpdateHeader update_header;
+unsigned char update_header_used;
+
+// Where the patch reader is
+enum UpdateStep {
+  UpdateStepHeader,
+  UpdateStepOp, // next byte is an op
+  UpdateStepLength, // op's n
+  UpdateStepShift, // copy's shift
+  UpdateStepFill, // fill's byte
+  UpdateStepData, // add's bytes
+  UpdateStepCopy, // copying n bytes (no input needed)
+  UpdateStepRun // filling n bytes (no input needed)
+};
+enum UpdateOp {
+  UpdateOpAdd,
+  UpdateOpCopy,
+  UpdateOpFill,
+  UpdateOpEnd
+};
+char update_step;
+char update_op;
+unsigned long update_count; // bytes left in the op
+unsigned long update_varint;
+char update_varint_bits;
+long update_shift;
+unsigned char update_fill;
+
+// Patch bytes waiting to be applied
+unsigned char update_fifo[UPDATE_FIFO_SIZE];
+unsigned int update_fifo_head;
+unsigned int update_fifo_tail;
+unsigned int update_fifo_count;
+
+// Running image CRC, worked out a segment at a time after a reset
+unsigned int update_crc_segment; // segments done (UPDATE_SEGMENTS -> ready)
+unsigned int update_crc_running;
+
+// Checking STAGING
+unsigned long update_checked; // bytes
+unsigned int update_check_crc;
+struct Sha256 update_sha;
+
+// When to ask, and for how long
+unsigned long update_check_wait; // seconds to the next check
+char update_check_due;
+unsigned int update_session_wait; // seconds before the next session while downloading
+char update_windows; // asked for this session
+unsigned long update_session_received; // update_received when it started
+char update_stalls; // sessions in a row that got nothing
+unsigned int update_rejected_crc; // image that got rolled back (not taken again)
+unsigned int update_confirm_wait; // seconds on the network left before confirming
+
+// Running image / STAGING address of an image offset (boot.h layout)
+const unsigned char *update_image(unsigned long offset);
+#define update_staged(offset) ((unsigned char *)UPDATE_STAGING_START + (offset))
+
+// CRC-16/CCITT-FALSE on the CRC module (bit reversed input), crc carried in
+unsigned int update_crc(unsigned int crc, const unsigned char *data, unsigned int length);
+
+// Applies patch bytes from the fifo, UPDATE_SLICE bytes of output at most
+void update_apply(void);
+
+// Writes the next length bytes of the new image (erases segments on the way)
+void update_emit(const unsigned char *data, unsigned int length);
+
+// Checks the header once it's all in, 1 if it's a patch we can take
+char update_header_check(void);
+
+// Checks the next UPDATE_SLICE bytes of STAGING (Ready at the end if it's good)
+void update_verify(void);
+
+// Starts the HMAC (inner hash) over update_sha, and finishes it into mac
+void update_mac_start(void);
+void update_mac_finish(unsigned char *mac);
+
+// Writes the journal for the installer (STAGING checked out)
+void update_journal_write(void);
+
+// Starts taking a patch in (first line of one came in)
+void update_download_start(void);
+
+// Number (decimal) at *text, moves *text past it
+unsigned long update_number(const char **text);
+
+// Value of a hex digit, 0xFF if it isn't one
+unsigned char update_nibble(char c);
+
+// Pump off and the modem idle (fine to reset, fine to write flash for a while)
+char update_quiet(void);
+
+void update_set_state(char state);
+void update_fail(void);
+
+void update_initialize(void)
+{
+  update_state = UpdateIdle;
+  update_received = 0;
+  update_written = 0;
+  update_fifo_head = 0;
+  update_fifo_tail = 0;
+  update_fifo_count = 0;
+  update_crc_segment = 0;
+  update_crc_running = 0xFFFF;
+  update_image_crc = 0;
+  update_check_wait = UPDATE_CHECK_FIRST;
+  update_check_due = 0;
+  update_session_wait = 0;
+  update_windows = 0;
+  update_stalls = 0;
+  update_rejected_crc = 0;
+  update_confirm_wait = UPDATE_CONFIRM_SECONDS;
+
+  // What the installer did (it has run already)
+  if(boot_journal->magic == UPDATE_MAGIC)
+  {
+    if(boot_journal_byte(BOOT_JOURNAL_CONFIRM) != 0xFF)
+      update_state = UpdateConfirmed;
+    else if(boot_journal_byte(BOOT_JOURNAL_ROLLBACK) != 0xFF)
+    {
+      update_rejected_crc = boot_journal->new_crc;
+      update_set_state(UpdateRolledBack);
+    }
+    else
+      update_set_state(UpdateTrial);
+  }
+}
+
+void update_tick(void)
+{
+  if(update_check_wait && --update_check_wait == 0)
+  {
+    update_check_due = 1;
+    update_check_wait = UPDATE_CHECK_INTERVAL;
+  }
+  if(update_session_wait)
+    update_session_wait--;
+
+  // New image has been on the network long enough, it's a keeper
+  if(update_state == UpdateTrial && (network_registration == 1 || network_registration == 5))
+  {
+    if(--update_confirm_wait == 0)
+    {
+      unsigned char done = 0;
+      flash_write_bytes((char *)UPDATE_JOURNAL_START + BOOT_JOURNAL_CONFIRM, (const char *)&done, 1);
+      update_set_state(UpdateConfirmed);
+    }
+  }
+}
+
+char update_busy(void)
+{
+  if(update_crc_segment < UPDATE_SEGMENTS)
+    return 1;
+  switch(update_state)
+  {
+  case UpdateDownloading:
+    return !uart_command_in_progress() && update_applying();
+  case UpdateVerifying:
+    return 1;
+  case UpdateReady:
+    return update_quiet();
+  }
+  return 0;
+}
+
+char update_applying(void)
+{
+  return update_state == UpdateDownloading
+      && (update_fifo_count || update_step == UpdateStepCopy || update_step == UpdateStepRun);
+}
+
+void update_work(void)
+{
+  // Running image CRC first, a segment a pass
+  if(update_crc_segment < UPDATE_SEGMENTS)
+  {
+    update_crc_running = update_crc(update_crc_running,
+                                    update_image((unsigned long)update_crc_segment * FLASH_SEGMENT_SIZE),
+                                    FLASH_SEGMENT_SIZE);
+    if(++update_crc_segment == UPDATE_SEGMENTS)
+      update_image_crc = update_crc_running;
+    return;
+  }
+
+  switch(update_state)
+  {
+  case UpdateDownloading:
+    if(!uart_command_in_progress()) // flash writes hold interrupts off
+      update_apply();
+    break;
+
+  case UpdateVerifying:
+    update_verify();
+    break;
+
+  case UpdateReady:
+    if(update_quiet())
+    {
+      update_journal_write();
+      trace_flush(); // so the trace shows how we got here
+      PMMCTL0 = PMMPW | PMMSWBOR; // installer takes it from here
+    }
+    break;
+  }
+}
+
+void update_check(void)
+{
+  update_check_due = 1;
+}
+
+char update_wanted(void)
+{
+  if(update_crc_segment < UPDATE_SEGMENTS || update_session_wait || !update_key_present())
+    return 0;
+  if(update_state == UpdateDownloading)
+    return 1;
+  return update_check_due && update_state != UpdateTrial
+      && update_state != UpdateVerifying && update_state != UpdateReady;
+}
+
+char update_window_start(void)
+{
+  if(!update_wanted() || update_windows >= UPDATE_SESSION_WINDOWS)
+    return 0;
+  if(update_windows++ == 0)
+    update_session_received = update_received;
+  if(update_state != UpdateDownloading)
+  {
+    update_check_due = 0; // one go per check
+    update_received = 0; // from the top
+  }
+  return 1;
+}
+
+void update_request(void)
+{
+  tx_buffer_reset();
+  text_copy(TextUpdateRequest);
+  tx_buffer_append_number(update_image_crc);
+  text_append(TextSpace);
+  tx_buffer_append_number(update_received);
+  text_append(TextSpace);
+  tx_buffer_append_number(UPDATE_FIFO_SIZE - update_fifo_count);
+  text_append(TextNewline);
+}
+
+void update_parse_line(const char *line)
+{
+  unsigned char data[UPDATE_LINE_BYTES];
+  unsigned int length = 0;
+  unsigned long offset;
+  unsigned char high, low;
+  unsigned int i;
+
+  if(strncmp(line, "+UPD: ", 6) != 0)
+    return;
+  line += 6;
+
+  // Nothing for this image
+  if(strcmp(line, "NONE") == 0)
+  {
+    update_check_due = 0;
+    if(update_state == UpdateDownloading) // patch went away under us
+      update_fail();
+    return;
+  }
+
+  // <offset>,<hex>,<crc>
+  offset = update_number(&line);
+  if(*line++ != ',')
+    return;
+  while(*line != ',')
+  {
+    high = update_nibble(line[0]);
+    low = update_nibble(line[1]);
+    if(high > 15 || low > 15 || length == UPDATE_LINE_BYTES)
+      return;
+    data[length++] = high << 4 | low;
+    line += 2;
+  }
+  line++;
+  if(update_number(&line) != update_crc(0xFFFF, data, length) || *line || length == 0)
+    return;
+
+  // Has to be the next bytes, and fit
+  if(offset != update_received || length > UPDATE_FIFO_SIZE - update_fifo_count)
+    return;
+  if(update_state != UpdateDownloading)
+  {
+    if(offset != 0)
+      return;
+    update_download_start();
+  }
+
+  update_received += length;
+  update_fifo_count += length;
+  for(i = 0; i < length; ++i)
+  {
+    update_fifo[update_fifo_head] = data[i];
+    update_fifo_head = (update_fifo_head + 1) & (UPDATE_FIFO_SIZE - 1);
+  }
+}
+
+void update_session_end(void)
+{
+  update_windows = 0;
+  if(update_state != UpdateDownloading)
+    return;
+
+  // Rest of it next time, unless the collector has stopped sending it
+  if(update_received != update_session_received)
+    update_stalls = 0;
+  else if(++update_stalls >= UPDATE_STALL_SESSIONS)
+  {
+    update_fail();
+    return;
+  }
+  update_session_wait = UPDATE_SESSION_WAIT;
+}
+
+char update_key_present(void)
+{
+  char i;
+
+  for(i = 0; i < UPDATE_KEY_SIZE; ++i)
+    if(UPDATE_KEY[i] != 0xFF)
+      return 1;
+  return 0;
+}
+
+char update_key_set(const char *hex)
+{
+  unsigned char key[UPDATE_KEY_SIZE];
+  unsigned char high, low;
+  char i;
+
+  for(i = 0; i < UPDATE_KEY_SIZE; ++i, hex += 2)
+  {
+    high = update_nibble(hex[0]);
+    low = update_nibble(hex[1]);
+    if(high > 15 || low > 15)
+      return 0;
+    key[i] = high << 4 | low;
+  }
+  if(*hex)
+    return 0;
+
+  // Segment A has its own lock (writing LOCKA toggles it)
+  if(FCTL3 & LOCKA)
+    FCTL3 = FWKEY | LOCKA;
+  flash_erase((char *)UPDATE_KEY);
+  flash_write_bytes((char *)UPDATE_KEY, (const char *)key, UPDATE_KEY_SIZE);
+  if(!(FCTL3 & LOCKA))
+    FCTL3 = FWKEY | LOCK | LOCKA;
+  return 1;
+}
+
+void update_download_start(void)
+{
+  update_set_state(UpdateDownloading);
+  update_stalls = 0;
+  update_received = 0;
+  update_written = 0;
+  update_fifo_head = 0;
+  update_fifo_tail = 0;
+  update_fifo_count = 0;
+  update_step = UpdateStepHeader;
+  update_header_used = 0;
+}
+
+void update_apply(void)
+{
+  unsigned char out[UPDATE_SLICE];
+  unsigned int used = 0;
+  unsigned long source;
+  unsigned char byte;
+
+  while(used < UPDATE_SLICE)
+  {
+    // Copies and fills don't need input
+    if(update_step == UpdateStepCopy || update_step == UpdateStepRun)
+    {
+      if(update_count == 0)
+      {
+        update_step = UpdateStepOp;
+        continue;
+      }
+      if(update_step == UpdateStepCopy)
+      {
+        source = update_written + used + update_shift;
+        if(source >= UPDATE_IMAGE_SIZE) // (negative wraps around)
+        {
+          update_fail();
+          return;
+        }
+        out[used++] = *update_image(source);
+      }
+      else
+        out[used++] = update_fill;
+      update_count--;
+      continue;
+    }
+
+    if(update_fifo_count == 0)
+      break;
+    byte = update_fifo[update_fifo_tail];
+    update_fifo_tail = (update_fifo_tail + 1) & (UPDATE_FIFO_SIZE - 1);
+    update_fifo_count--;
+
+    switch(update_step)
+    {
+    case UpdateStepHeader:
+      ((unsigned char *)&update_header)[update_header_used++] = byte;
+      if(update_header_used == sizeof(struct UpdateHeader))
+      {
+        if(!update_header_check())
+        {
+          update_fail();
+          return;
+        }
+        update_step = UpdateStepOp;
+      }
+      break;
+
+    case UpdateStepOp:
+      update_op = byte;
+      update_varint = 0;
+      update_varint_bits = 0;
+      if(byte == UpdateOpEnd)
+      {
+        update_emit(out, used);
+        if(update_written != UPDATE_IMAGE_SIZE)
+        {
+          update_fail();
+          return;
+        }
+
+        // Check it over before anything else happens
+        update_checked = 0;
+        update_check_crc = 0xFFFF;
+        update_mac_start();
+        update_set_state(UpdateVerifying);
+        return;
+      }
+      if(byte > UpdateOpEnd)
+      {
+        update_fail();
+        return;
+      }
+      update_step = UpdateStepLength;
+      break;
+
+    case UpdateStepLength:
+    case UpdateStepShift:
+      update_varint |= (unsigned long)(byte & 0x7F) << update_varint_bits;
+      update_varint_bits += 7;
+      if(byte & 0x80)
+      {
+        if(update_varint_bits > 28) // more than the image ever needs
+        {
+          update_fail();
+          return;
+        }
+        break;
+      }
+      if(update_step == UpdateStepShift)
+      {
+        update_shift = (long)(update_varint >> 1) ^ -(long)(update_varint & 1);
+        update_step = UpdateStepCopy;
+        break;
+      }
+      update_count = update_varint;
+      if(update_written + used + update_count > UPDATE_IMAGE_SIZE)
+      {
+        update_fail();
+        return;
+      }
+      update_varint = 0;
+      update_varint_bits = 0;
+      update_step = update_op == UpdateOpAdd ? UpdateStepData
+                  : update_op == UpdateOpCopy ? UpdateStepShift : UpdateStepFill;
+      if(update_step == UpdateStepData && update_count == 0)
+        update_step = UpdateStepOp;
+      break;
+
+    case UpdateStepFill:
+      update_fill = byte;
+      update_step = UpdateStepRun;
+      break;
+
+    case UpdateStepData:
+      out[used++] = byte;
+      if(--update_count == 0)
+        update_step = UpdateStepOp;
+      break;
+    }
+  }
+
+  update_emit(out, used);
+}
+
+void update_emit(const unsigned char *data, unsigned int length)
+{
+  unsigned int offset;
+  unsigned int part;
+
+  while(length)
+  {
+    // STAGING gets erased just ahead of the writing
+    offset = update_written & (FLASH_SEGMENT_SIZE - 1);
+    if(offset == 0)
+      flash_erase((char *)update_staged(update_written));
+    part = FLASH_SEGMENT_SIZE - offset;
+    if(part > length)
+      part = length;
+    flash_write_bytes((char *)update_staged(update_written), (const char *)data, part);
+    update_written += part;
+    data += part;
+    length -= part;
+  }
+}
+
+char update_header_check(void)
+{
+  return update_header.magic[0] == UPDATE_MAGIC_0 && update_header.magic[1] == UPDATE_MAGIC_1
+      && update_header.magic[2] == UPDATE_MAGIC_2 && update_header.magic[3] == UPDATE_MAGIC_3
+      && update_header.base_crc == update_image_crc
+      && update_header.image_crc != update_rejected_crc
+      && update_header.length == UPDATE_IMAGE_SIZE;
+}
+
+void update_verify(void)
+{
+  const unsigned char *data = update_staged(update_checked);
+  unsigned char mac[SHA256_SIZE];
+  unsigned char difference = 0;
+  char i;
+
+  update_check_crc = update_crc(update_check_crc, data, UPDATE_SLICE);
+  sha256_add(&update_sha, data, UPDATE_SLICE);
+  update_checked += UPDATE_SLICE;
+  if(update_checked < UPDATE_IMAGE_SIZE)
+    return;
+
+  // Compared all the way through so the time doesn't tell how much matched
+  update_mac_finish(mac);
+  for(i = 0; i < SHA256_SIZE; ++i)
+    difference |= mac[i] ^ update_header.mac[i];
+  if(difference || update_check_crc != update_header.image_crc)
+  {
+    update_fail();
+    return;
+  }
+  update_set_state(UpdateReady);
+}
+
+void update_mac_start(void)
+{
+  unsigned char pad;
+  char i;
+
+  sha256_start(&update_sha);
+  for(i = 0; i < SHA256_BLOCK; ++i)
+  {
+    pad = (i < UPDATE_KEY_SIZE ? UPDATE_KEY[i] : 0) ^ 0x36;
+    sha256_add(&update_sha, &pad, 1);
+  }
+  sha256_add(&update_sha, &update_header, UPDATE_MAC_COVERS);
+}
+
+void update_mac_finish(unsigned char *mac)
+{
+  unsigned char pad;
+  char i;
+
+  sha256_finish(&update_sha, mac); // inner hash
+  sha256_start(&update_sha);
+  for(i = 0; i < SHA256_BLOCK; ++i)
+  {
+    pad = (i < UPDATE_KEY_SIZE ? UPDATE_KEY[i] : 0) ^ 0x5C;
+    sha256_add(&update_sha, &pad, 1);
+  }
+  sha256_add(&update_sha, mac, SHA256_SIZE);
+  sha256_finish(&update_sha, mac);
+}
+
+void update_journal_write(void)
+{
+  struct BootJournal journal;
+
+  journal.old_entry = *(const unsigned int *)update_image(UPDATE_IMAGE_SIZE - 2); // reset vector
+  journal.new_entry = *(const unsigned int *)update_staged(UPDATE_IMAGE_SIZE - 2);
+  journal.old_crc = update_image_crc;
+  journal.new_crc = update_header.image_crc;
+  journal.magic = UPDATE_MAGIC;
+
+  flash_erase((char *)UPDATE_JOURNAL_START);
+  flash_erase((char *)UPDATE_JOURNAL_START + FLASH_SEGMENT_SIZE);
+  flash_write_bytes((char *)UPDATE_JOURNAL_START, (const char *)&journal, sizeof(journal) - 2);
+  flash_write_bytes((char *)&boot_journal->magic, (const char *)&journal.magic, 2); // makes it count
+}
+
+const unsigned char *update_image(unsigned long offset)
+{
+  if(offset < (unsigned long)UPDATE_FLASH_SEGMENTS * FLASH_SEGMENT_SIZE)
+    return (const unsigned char *)UPDATE_FLASH_START + offset;
+  offset -= (unsigned long)UPDATE_FLASH_SEGMENTS * FLASH_SEGMENT_SIZE;
+  if(offset < (unsigned long)UPDATE_FLASH2_SEGMENTS * FLASH_SEGMENT_SIZE)
+    return (const unsigned char *)UPDATE_FLASH2_START + offset;
+  offset -= (unsigned long)UPDATE_FLASH2_SEGMENTS * FLASH_SEGMENT_SIZE;
+  return (const unsigned char *)UPDATE_VECTORS_START + offset;
+}
+
+unsigned int update_crc(unsigned int crc, const unsigned char *data, unsigned int length)
+{
+  CRCINIRES = crc;
+  while(length--)
+    CRCDIRB_L = *data++;
+  return CRCINIRES;
+}
+
+unsigned long update_number(const char **text)
+{
+  unsigned long value = 0;
+
+  while(**text >= '0' && **text <= '9')
+    value = value * 10 + (*(*text)++ - '0');
+  return value;
+}
+
+unsigned char update_nibble(char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return 0xFF;
+}
+
+char update_quiet(void)
+{
+  return uart_command_state == CommandStateIdle && !uart_command_in_progress()
+      && pump_state == PumpStateOff;
+}
+
+void update_set_state(char state)
+{
+  update_state = state;
+  trace_event(TraceUpdate, state);
+}
+
+void update_fail(void)
+{
+  update_set_state(UpdateFailed);
+  update_check_due = 0;
+  update_fifo_count = 0;
+  update_fifo_head = 0;
+  update_fifo_tail = 0;
+}
@@ -0,0 +1,116 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+#include "boot.h"
+
+/*
+ * update.h
+ *
+ * Firmware updates over the data link. The collector keeps delta patches
+ * from one image to the next (tools/mkpatch.py). At the end of an upload
+ * session the board asks for the next window of the patch for the image it
+ * runs (going by the image's CRC), and once the modem is quiet again the
+ * window gets applied to STAGING a slice at a time. Most of the new image is
+ * copied out of the running one, so only what changed goes over the air.
+ *
+ * Patch (numbers little endian):
+ *   0  "SMD1"
+ *   4  CRC of the image it applies to (CRC-16/CCITT-FALSE, like all of them here)
+ *   6  CRC of the image it makes
+ *   8  image length (UPDATE_IMAGE_SIZE, 4 bytes)
+ *  12  HMAC-SHA256 of bytes 0-11 and then the new image, keyed with this
+ *      board's update key (32 bytes in INFOA)
+ *  44  0 (4 bytes)
+ *  48  ops, each writing the next n bytes of the new image:
+ *        0x00 n bytes...   the bytes that follow
+ *        0x01 n shift      bytes of the running image, from shift (signed)
+ *                          away from where they go in the new one
+ *        0x02 n byte       byte n times
+ *        0x03              end
+ *      n and shift are LEB128 varints, shift zigzag coded.
+ *
+ * Download, on the upload connection after the log records:
+ *   -> UPD <base crc> <offset> <max>\r\n
+ *   <- +UPD: <offset>,<hex bytes>,<crc>\r\n   (64 bytes a line at most, crc of them)
+ *   <- ... up to max bytes
+ *   <- OK\r\n
+ * or "+UPD: NONE" when there's nothing newer. The collector holds its answer
+ * back a second so the modem's SEND OK is out of the way first. Numbers are
+ * decimal. A line that doesn't check out or isn't at the next offset is
+ * dropped, the next window asks again from there. Progress is only kept in
+ * RAM: after a reset the download starts over.
+ *
+ * When the patch is done STAGING gets checked (CRC and MAC), the journal
+ * (boot.h) filled in, and the board resets into the installer as soon as the
+ * pump is off and the modem idle. The new image confirms itself after it's
+ * been on the network UPDATE_CONFIRM_SECONDS; if it doesn't within
+ * UPDATE_TRIAL_BOOTS resets the old one goes back in.
+ *
+ * No key (INFOA blank, "key" on the service port sets one) -> no updates.
+ */
+
+#ifndef UPDATE_H_
+#define UPDATE_H_
+
+#define UPDATE_KEY ((const unsigned char *)0x1980) // INFOA
+#define UPDATE_KEY_SIZE 32
+#define UPDATE_LINE_BYTES 64 // most bytes in one +UPD: line
+
+enum UpdateState {
+  UpdateIdle, // nothing going on
+  UpdateDownloading, // patch coming in, going into STAGING
+  UpdateVerifying, // STAGING complete, checking it
+  UpdateReady, // checks out, resets into the installer when it's quiet
+  UpdateTrial, // running a new image that hasn't confirmed itself yet
+  UpdateConfirmed, // running a new image that has
+  UpdateRolledBack, // a new image didn't confirm itself, back on the old one
+  UpdateFailed // patch didn't apply or check out (tried again at the next check)
+};
+
+extern volatile char update_state; // UpdateState
+extern unsigned int update_image_crc; // of the running image (worked out after a reset)
+extern unsigned long update_received; // patch bytes taken in
+extern unsigned long update_written; // new image bytes in STAGING
+
+// After warm_restore: reads the journal (trial, rollback) and starts the
+// running image's CRC
+void update_initialize(void);
+
+// Called once a second: checks coming due, confirming a new image
+void update_tick(void);
+
+// There's work for update_work right now (main loop shouldn't sleep)
+char update_busy(void);
+
+// Patch bytes are still waiting to go into STAGING (the window isn't done)
+char update_applying(void);
+
+// One slice of work (a few ms): image CRC, applying the patch (only while
+// the modem is quiet), checking STAGING, resetting into the installer
+void update_work(void);
+
+// Check at the next chance instead of waiting for UPDATE_CHECK_INTERVAL
+void update_check(void);
+
+// A GPRS session should ask for (more of) a patch
+char update_wanted(void);
+
+// Starts the next window of this session if there should be one (0 -> the
+// session can end)
+char update_window_start(void);
+
+// Puts the UPD request for the window into tx_buffer
+void update_request(void);
+
+// A line from the collector while a window comes in
+void update_parse_line(const char *line);
+
+// The GPRS session is over
+void update_session_end(void);
+
+// Saves a new update key (UPDATE_KEY_SIZE bytes as hex), returns 1 if it took
+char update_key_set(const char *hex);
+
+// Whether there's a key
+char update_key_present(void);
+
+#endif /* UPDATE_H_ */
@@ -0,0 +1,127 @@
+#include "warm.h"
+#include "uart.h"
+#include "pump.h"
+#include "network.h"
+#include "datalog.h"
+
+/*
+ * warm.c
+ */
+
+// Kept by main.c
+extern volatile unsigned long last_sent_warningtext;
+extern volatile char battery_can_drain;
+extern volatile unsigned long digest_time;
+extern volatile char upload_pending;
+extern volatile char digest_pending;
+
+#pragma NOINIT(warm_state)
+struct WarmState warm_state;
+
+volatile char warm_restored;
+volatile char warm_modem_ready;
+volatile char warm_timing; // boot timer running
+
+// CRC of the block, not counting the crc field (from the timer tick, so it
+// leaves the CRC module the way it found it: update.c works out image CRCs
+// a slice at a time in the main loop)
+unsigned int warm_crc(void);
+
+void warm_initialize(void)
+{
+  unsigned int cause = SYSRSTIV; // highest priority reason
+  while(SYSRSTIV); // clear the rest
+
+  warm_restored = warm_state.magic == WARM_MAGIC && warm_state.crc == warm_crc()
+                  && cause != SYSRSTIV_BOR; // power-up (RAM could pass by luck)
+  if(warm_restored)
+  {
+    warm_state.resets++;
+    warm_state.reset_cause = cause;
+  }
+  else
+  {
+    warm_state.resets = 0;
+    warm_state.reset_cause = cause;
+    warm_state.boot_ms = 0;
+    warm_state.modem_ready = 0;
+  }
+  warm_modem_ready = warm_restored && warm_state.modem_ready;
+
+  // Time to operational, 512 Hz (wraps after 128 s)
+  TA2CTL = TACLR;
+  TA2EX0 = TAIDEX_7;
+  TA2CTL = TASSEL__ACLK | ID__8 | MC__CONTINUOUS;
+  warm_timing = 1;
+}
+
+void warm_restore(void)
+{
+  if(!warm_restored)
+    return;
+
+  last_sent_warningtext = warm_state.last_sent_warningtext;
+  battery_can_drain = warm_state.battery_can_drain;
+  digest_time = warm_state.digest_time;
+  upload_pending = warm_state.upload_pending;
+  digest_pending = warm_state.digest_pending;
+  pump_runtime = warm_state.pump_runtime;
+  pump_cycles = warm_state.pump_cycles;
+  pump_lockout = warm_state.pump_lockout;
+  pump_fault = warm_state.pump_fault;
+  network_send_attempts = warm_state.network_send_attempts;
+  network_send_failures = warm_state.network_send_failures;
+  network_lost_count = warm_state.network_lost_count;
+  if(warm_state.datalog_pending < datalog_count)
+    datalog_pending = warm_state.datalog_pending;
+  if(warm_state.baud_index < UART_BAUD_COUNT)
+  {
+    uart_baud_best = warm_state.baud_index;
+    uart_set_baud(warm_state.baud_index);
+  }
+}
+
+void warm_save(void)
+{
+  warm_state.magic = WARM_MAGIC;
+  warm_state.last_sent_warningtext = last_sent_warningtext;
+  warm_state.digest_time = digest_time;
+  warm_state.pump_runtime = pump_runtime;
+  warm_state.pump_cycles = pump_cycles;
+  warm_state.pump_lockout = pump_lockout;
+  warm_state.datalog_pending = datalog_pending;
+  warm_state.network_send_attempts = network_send_attempts;
+  warm_state.network_send_failures = network_send_failures;
+  warm_state.network_lost_count = network_lost_count;
+  warm_state.pump_fault = pump_fault;
+  warm_state.battery_can_drain = battery_can_drain;
+  warm_state.upload_pending = upload_pending;
+  warm_state.digest_pending = digest_pending;
+  warm_state.modem_ready = warm_modem_ready;
+  warm_state.baud_index = uart_baud_index;
+  warm_state.crc = warm_crc();
+}
+
+void warm_operational(void)
+{
+  if(!warm_timing)
+    return;
+  warm_timing = 0;
+  warm_state.boot_ms = (unsigned long)TA2R * 1000 / 512;
+  TA2CTL = MC__STOP;
+}
+
+unsigned int warm_crc(void)
+{
+  const unsigned int *word = (const unsigned int *)&warm_state;
+  unsigned int saved = CRCINIRES;
+  unsigned int crc;
+  unsigned int i;
+
+  CRCINIRES = 0xFFFF;
+  for(i = 0; i < sizeof(struct WarmState) / 2 - 1; ++i)
+    CRCDI = word[i];
+  crc = CRCINIRES;
+  CRCINIRES = saved;
+  return crc;
+}
@@ -0,0 +1,60 @@
+#include "msp430f5529.h"
+#include "definitions.h"
+
+/*
+ * warm.h
+ *
+ * State that rides through a reset (watchdog, brownout of the supervisor,
+ * reset pin) in .TI.noinit RAM: the warning rate limiter, pump lockout and
+ * counters, upload position, and whether the modem is already set up so the
+ * AT/ATE0/AT+IPR/AT+CMGF bring-up can be skipped. It's checked with a CRC
+ * (CRC module, CCITT) so a power-up's random RAM never gets taken for it.
+ */
+
+#ifndef WARM_H_
+#define WARM_H_
+
+#define WARM_MAGIC 0x5741 // "WA"
+
+struct WarmState {
+  unsigned int magic;
+  unsigned long last_sent_warningtext;
+  unsigned long digest_time;
+  unsigned long pump_runtime;
+  unsigned int pump_cycles;
+  unsigned int pump_lockout;
+  unsigned int datalog_pending;
+  unsigned int network_send_attempts;
+  unsigned int network_send_failures;
+  unsigned int network_lost_count;
+  unsigned int resets; // warm restarts so far
+  unsigned int reset_cause; // SYSRSTIV of the last one
+  unsigned int boot_ms; // reset to modem ready, last time
+  unsigned char pump_fault;
+  unsigned char battery_can_drain;
+  unsigned char upload_pending;
+  unsigned char digest_pending;
+  unsigned char modem_ready; // set up and answering
+  unsigned char baud_index;
+  unsigned int crc; // over everything above
+};
+extern struct WarmState warm_state;
+
+extern volatile char warm_restored; // the block was good at startup
+extern volatile char warm_modem_ready; // modem is set up (skip the bring-up after a reset)
+
+// First thing in main: reads the reset cause, checks the block, starts the
+// boot timer (TA2, ACLK / 64)
+void warm_initialize(void);
+
+// Puts the saved state back (after everything is initialized, does nothing
+// on a cold start)
+void warm_restore(void);
+
+// Saves the current state (once a second from the timer tick)
+void warm_save(void);
+
+// Modem is up: stops the boot timer and keeps the time
+void warm_operational(void);
+
+#endif /* WARM_H_ */